@@ -13,7 +13,20 @@
 *             -5 to 5 or -10 to 10 volts, depending on the coniguration of
 *             an on-board jumper.
 *
+*             Integer sums, min and max are kept for each enabled channel as
+*             samples are read, so contact quality and the noise floor can
+*             be checked by command without streaming raw data. The mean
+*             and variance are only worked out when asked for. Collection
+*             is off until channels are enabled with stat_mask.
+*
+*             Up to ANALOG_MAX_DEVICES shields can be fitted, each with its
+*             own chip select, busy and start conversion lines and range.
+*             All shields convert on the same start pulse, so their channels
+*             are sampled together, and are then read back one after the
+*             other.
+*
 *    /log     2/19/15  gcg - Initial release.
+*             10/19/26  agt - Added ADC shields, statistics and captures.
 *
 ******************************************************************************/
 
@@ -27,6 +40,8 @@
 // Local Modules
 
 #include "Analog.h"
+#include "Command.h"
+#include "Param.h"
 
 // ***** Local Definitions ****************************************************
 
@@ -40,7 +55,8 @@
 
 #define ANALOG_SCALE_20   0.00030517578
 
-// Pin definitions
+// Pin definitions. BUSY, START_CONVERSION and CHIP_SELECT are those of the
+// first shield, RESET is shared by every shield.
 
 #define BUSY 3
 #define RESET 4
@@ -50,11 +66,29 @@
 #define LED 13
 #define TOTAL_RAW_BYTES 16
 
+// Channels to keep statistics for, one bit per channel, none by default.
+// Collection stops at the count limit, or before the sum of squares would
+// overflow, until the statistics are cleared.
+
+#define STATS_MASK_DEFAULT  0x00
+#define STATS_MAX_COUNT     60000
+
+// One shield
+
+typedef struct Analog_Device_s
+{
+  unsigned char  sucChipSelect;
+  unsigned char  sucBusy;
+  unsigned char  sucStart;
+  Analog_Mode_t  seMode;
+} Analog_Device_t;
+
 // ***** Local Variables ******************************************************
 
-// The mode setting of the Analog board
+// The fitted shields
 
-static Analog_Mode_t Analog__meMode;
+static Analog_Device_t Analog__masDevices[ANALOG_MAX_DEVICES];
+static int Analog__mwNumDevices = 0;
 
 // Unformatted, raw data from ADC
 
@@ -64,10 +98,23 @@ static byte Analog__maucRawData[TOTAL_RAW_BYTES];
 
 static signed long Analog__malParsedData[ANALOG_NUM_CHANNELS];
 
+// Running statistics for each channel
+
+static Analog_Stats_t Analog__masStats[ANALOG_NUM_CHANNELS];
+static int Analog__mwStatsMask = STATS_MASK_DEFAULT;
+
 
 // ***** Local Funtions *******************************************************
 
-static void Analog__ReadRaw();
+static void Analog__Convert();
+static void Analog__ReadRaw(Analog_Device_t *zpsDevice);
+static void Analog__UpdateStats();
+static float Analog__Scale(int zwChannel);
+
+// Commands
+
+static void Cmd__Stat(String znArg);
+static void Cmd__StatClear(String znArg);
 
 // ***** Function Definitions *************************************************
 
@@ -77,6 +124,8 @@ static void Analog__ReadRaw();
 *
 *    /purpose    Performs any needed SPI configuration for the Analog board
 *                along with saving off any parameters for software config.
+*                Sets up the first shield on the default pins, others are
+*                added with Analog_AddDevice.
 *
 *    /param[in]  zeMode    Mode to set (-5 to 5 or 10 to 10)
 *
@@ -88,49 +137,146 @@ void Analog_Initialize (Analog_Mode_t zeMode)
   
   // Initialize SPI communitcations
   
-  pinMode(BUSY, INPUT);
   pinMode(RESET, OUTPUT);
   pinMode(LED, OUTPUT);
-  pinMode(START_CONVERSION, OUTPUT);
   pinMode(MISO, INPUT);
   
   SPI.begin();
-   
-  digitalWrite(START_CONVERSION, HIGH);  
-  digitalWrite(CHIP_SELECT, HIGH);
+  
+  // The first shield
+  
+  Analog__mwNumDevices = 0;
+  Analog_AddDevice(CHIP_SELECT, BUSY, START_CONVERSION, zeMode);
+  
+  // Reset every shield
+  
   digitalWrite(RESET, HIGH);
   delay(1);
   digitalWrite(RESET, LOW);
   
-  // Save the mode setting
+  // Start the statistics fresh
+  
+  Analog_ResetStats();
+  
+  // Register tunable values and commands
+  
+  Param_Add("stat_mask", PARAM_INT, &Analog__mwStatsMask, 0, 0xFF);
+  
+  Command_AddCmd("stat", Cmd__Stat);
+  Command_AddCmd("statclr", Cmd__StatClear);
+}
+
+/******************************************************************************
+*
+*    /name       Analog_AddDevice
+*
+*    /purpose    Adds a shield. Its channels follow those of the shields
+*                already added.
+*
+*    /param[in]  zucChipSelect    Chip select pin
+*    /param[in]  zucBusy          Busy pin
+*    /param[in]  zucStart         Start conversion pin, may be shared
+*    /param[in]  zeMode           Range jumper setting of the shield
+*
+*    /ret        int              Index of the shield, -1 if the build
+*                                 has no room for it
+*
+******************************************************************************/
+int Analog_AddDevice (unsigned char zucChipSelect, unsigned char zucBusy,
+                      unsigned char zucStart, Analog_Mode_t zeMode)
+{
+  Analog_Device_t *xpsDevice;
+  
+  if (Analog__mwNumDevices >= ANALOG_MAX_DEVICES)
+  {
+    return -1;
+  }
+  
+  xpsDevice = &Analog__masDevices[Analog__mwNumDevices];
+  
+  xpsDevice->sucChipSelect = zucChipSelect;
+  xpsDevice->sucBusy = zucBusy;
+  xpsDevice->sucStart = zucStart;
+  xpsDevice->seMode = zeMode;
+  
+  // Idle lines
+  
+  pinMode(zucBusy, INPUT);
+  pinMode(zucStart, OUTPUT);
+  pinMode(zucChipSelect, OUTPUT);
+  
+  digitalWrite(zucStart, HIGH);
+  digitalWrite(zucChipSelect, HIGH);
+  
+  return Analog__mwNumDevices++;
+}
 
-  Analog__meMode = zeMode;
+/******************************************************************************
+*
+*    /name       Analog_NumChannels
+*
+*    /purpose    Returns the number of channels on the fitted shields
+*
+*    /ret        int    Channel count
+*
+******************************************************************************/
+int Analog_NumChannels ()
+{
+  return Analog__mwNumDevices * ANALOG_DEVICE_CHANNELS;
 }
 
 /******************************************************************************
 *
-*    /name       Analog__ReadRaw
+*    /name       Analog__Convert
 *
-*    /purpose    Reads 16 bytes of data from the ADC. This will need to be
-*                converted before being used for any calculation.
+*    /purpose    Starts a conversion on every shield at once and waits for
+*                all of them to finish
 *
 *    /ret        void
 *
 ******************************************************************************/
-static void Analog__ReadRaw()
+static void Analog__Convert()
 {
-  unsigned char xucBytesToRead = TOTAL_RAW_BYTES;
   
-  // Toggle the start conversion line 
+  // Toggle the start conversion lines together
+  
+  for (int i=0; i < Analog__mwNumDevices; i++)
+  {
+    digitalWrite(Analog__masDevices[i].sucStart, LOW);
+  }
   
-  digitalWrite(START_CONVERSION, LOW);
   delayMicroseconds(10);
-  digitalWrite(START_CONVERSION, HIGH);
-
+  
+  for (int i=0; i < Analog__mwNumDevices; i++)
+  {
+    digitalWrite(Analog__masDevices[i].sucStart, HIGH);
+  }
+  
   // Wait for conversion to complete
   
-  while (digitalRead(BUSY) == HIGH) {}
-  digitalWrite(CHIP_SELECT, LOW);
+  for (int i=0; i < Analog__mwNumDevices; i++)
+  {
+    while (digitalRead(Analog__masDevices[i].sucBusy) == HIGH) {}
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Analog__ReadRaw
+*
+*    /purpose    Reads 16 bytes of data from one shield's ADC. This will need
+*                to be converted before being used for any calculation.
+*
+*    /param[in]  zpsDevice    Shield to read
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Analog__ReadRaw(Analog_Device_t *zpsDevice)
+{
+  unsigned char xucBytesToRead = TOTAL_RAW_BYTES;
+  
+  digitalWrite(zpsDevice->sucChipSelect, LOW);
   
   // Store raw data
   
@@ -141,14 +287,14 @@ static void Analog__ReadRaw()
   
   // Wait for next conversion
   
-  digitalWrite(CHIP_SELECT, HIGH);  
+  digitalWrite(zpsDevice->sucChipSelect, HIGH);  
 }
 
 /******************************************************************************
 *
 *    /name       Analog_Update
 *
-*    /purpose    Update the readings for each channel.
+*    /purpose    Update the readings for each channel of every shield.
 *
 *    /ref        Analog__ReadRaw
 *
@@ -157,25 +303,121 @@ static void Analog__ReadRaw()
 ******************************************************************************/
 void Analog_Update()
 {
-  unsigned char xucCurrByte = 0;
- 
-  // Read in raw data for each channel
- 
-  Analog__ReadRaw();
- 
-  // Convert to DAC counts (signed)
- 
-  for (int xwChannel=0; xwChannel < ANALOG_NUM_CHANNELS; xwChannel++)
+  
+  // Sample every shield at once
+  
+  Analog__Convert();
+  
+  for (int xwDevice=0; xwDevice < Analog__mwNumDevices; xwDevice++)
   {
     
-    // Write value
+    // Read in raw data for each channel
     
-    Analog__malParsedData [xwChannel] = 
-     (Analog__maucRawData[xucCurrByte] << 8) + Analog__maucRawData[xucCurrByte];
+    Analog__ReadRaw(&Analog__masDevices[xwDevice]);
     
-    // Update raw byte index
+    // Convert to DAC counts (signed)
     
-    xucCurrByte += 2;
+    Analog_Decode(Analog__maucRawData, 
+                  &Analog__malParsedData[xwDevice * ANALOG_DEVICE_CHANNELS]);
+  }
+  
+  // Update the running statistics
+  
+  Analog__UpdateStats();
+}
+
+/******************************************************************************
+*
+*    /name       Analog_Decode
+*
+*    /purpose    Converts one frame read from a shield to signed counts. Each
+*                channel is two bytes, high byte first, in two's complement.
+*                The word is reinterpreted as 16 bit signed and widened, so
+*                the sign is extended without a branch per channel. Counts
+*                run from ANALOG_COUNTS_MIN to ANALOG_COUNTS_MAX.
+*
+*    /param[in]  zpucRaw      Frame of ANALOG_DEVICE_CHANNELS * 2 bytes
+*    /param[out] zplCounts    Counts of each channel
+*
+*    /ret        void
+*
+******************************************************************************/
+void Analog_Decode(const unsigned char *zpucRaw, signed long *zplCounts)
+{
+  
+  for (int xwChannel=0; xwChannel < ANALOG_DEVICE_CHANNELS; xwChannel++)
+  {
+    uint16_t xuwWord = ((uint16_t)zpucRaw[2 * xwChannel] << 8) | 
+                       zpucRaw[2 * xwChannel + 1];
+    
+    zplCounts[xwChannel] = (int16_t)xuwWord;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Analog__UpdateStats
+*
+*    /purpose    Adds the latest reading of each enabled channel to its
+*                running statistics. O(1) per sample, and integer only.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Analog__UpdateStats()
+{
+  
+  for (int xwChannel=0; xwChannel < Analog_NumChannels(); xwChannel++)
+  {
+    Analog_Stats_t *xpsStats = &Analog__masStats[xwChannel];
+    int16_t xwCounts = (int16_t)Analog__malParsedData[xwChannel];
+    int32_t xlDiff;
+    uint32_t xulSquare;
+    
+    // Skip disabled channels, the mask applies to each shield alike
+    
+    if (!(Analog__mwStatsMask & (1 << (xwChannel % ANALOG_DEVICE_CHANNELS))))
+    {
+      continue;
+    }
+    
+    // The first sample is the reference for the sums
+    
+    if (xpsStats->suwCount == 0)
+    {
+      xpsStats->swFirst = xwCounts;
+      xpsStats->swMin = xwCounts;
+      xpsStats->swMax = xwCounts;
+    }
+    
+    // Stop once full. The size of the difference is at most 65535, so its
+    // square fits 32 bits unsigned.
+    
+    xlDiff = (int32_t)xwCounts - xpsStats->swFirst;
+    xulSquare = (uint32_t)((xlDiff < 0) ? -xlDiff : xlDiff);
+    xulSquare *= xulSquare;
+    
+    if ((xpsStats->suwCount >= STATS_MAX_COUNT) ||
+        (xulSquare > 0xFFFFFFFFUL - xpsStats->sulSumSq))
+    {
+      continue;
+    }
+    
+    xpsStats->suwCount++;
+    xpsStats->slSum += xlDiff;
+    xpsStats->sulSumSq += xulSquare;
+    
+    // Extremes
+    
+    if (xwCounts < xpsStats->swMin)
+    {
+      xpsStats->swMin = xwCounts;
+    }
+    
+    if (xwCounts > xpsStats->swMax)
+    {
+      xpsStats->swMax = xwCounts;
+    }
   }
 }
 
@@ -212,18 +454,176 @@ signed long Analog_ReadCounts (Analog_Channel_t zeChannel)
 float Analog_ReadVolts (Analog_Channel_t zeChannel)
 {
   
-  // Depending on the mode, return the count value multiplied by
-  // the correct scale factor
+  // Convert the latest count reading with its shield's range
   
-  if (Analog__meMode == ANALOG_5_TO_5)
+  return (float)Analog__malParsedData[zeChannel] * Analog__Scale(zeChannel);
+}
+
+/******************************************************************************
+*
+*    /name       Analog_CountsToVolts
+*
+*    /purpose    Converts a count value to volts for the mode of the first
+*                shield, which carries the detection channels
+*
+*    /param[in]  zlCounts    Count value to convert
+*
+*    /ret        float       Voltage (signed)
+*
+******************************************************************************/
+float Analog_CountsToVolts (signed long zlCounts)
+{
+  return (float)zlCounts * Analog__Scale(ANALOG_CH0);
+}
+
+/******************************************************************************
+*
+*    /name       Analog__Scale
+*
+*    /purpose    Returns the volts per count of a channel's shield
+*
+*    /param[in]  zwChannel    Channel
+*
+*    /ret        float        Scale factor
+*
+******************************************************************************/
+static float Analog__Scale(int zwChannel)
+{
+  
+  // Depending on the mode, return the correct scale factor
+  
+  if (Analog__masDevices[zwChannel / ANALOG_DEVICE_CHANNELS].seMode == 
+      ANALOG_5_TO_5)
+  {
+    
+    return ANALOG_SCALE_10;
+  }
+  else    // seMode == ANALOG_10_TO_10
   {
     
-    return (float)Analog__malParsedData[zeChannel] * ANALOG_SCALE_10;
+    return ANALOG_SCALE_20;
+  }
+}
+  
+
+/******************************************************************************
+*
+*    /name       Analog_GetStats
+*
+*    /purpose    Returns a copy of the running statistics of a channel
+*
+*    /param[in]  zeChannel    Channel to read
+*    /param[out] zpsStats     Statistics for the channel, in counts
+*
+*    /ret        void
+*
+******************************************************************************/
+void Analog_GetStats (Analog_Channel_t zeChannel, Analog_Stats_t *zpsStats)
+{
+  
+  // Simply copy the internal static variable
+  
+  *zpsStats = Analog__masStats[zeChannel];
+}
+
+/******************************************************************************
+*
+*    /name       Analog_ResetStats
+*
+*    /purpose    Clears the running statistics of every channel
+*
+*    /ret        void
+*
+******************************************************************************/
+void Analog_ResetStats ()
+{
+  
+  for (int xwChannel=0; xwChannel < ANALOG_NUM_CHANNELS; xwChannel++)
+  {
+    Analog__masStats[xwChannel] = (Analog_Stats_t){0, 0, 0, 0, 0, 0};
   }
-  else    // Analog__meMode == ANALOG_10_TO_10
+}
+
+
+// ***** Command Definitions **************************************************
+
+/******************************************************************************
+*
+*    /name       Cmd__Stat
+*
+*    /purpose    Print the running statistics of one channel (argument given)
+*                or of every enabled channel, one line each:
+*                "<ch> <count> <mean> <std dev> <min> <max>" in Volts. The
+*                mean and deviation are worked out from the sums here.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Stat(String znArg)
+{
+  int xwFirst = 0;
+  int xwLast = Analog_NumChannels() - 1;
+  
+  // Single channel requested
+  
+  if (znArg.length() > 0)
   {
+    xwFirst = constrain((int)znArg.toInt(), 0, xwLast);
+    xwLast = xwFirst;
+  }
+  
+  for (int xwChannel=xwFirst; xwChannel <= xwLast; xwChannel++)
+  {
+    Analog_Stats_t *xpsStats = &Analog__masStats[xwChannel];
+    float xfCount = (float)xpsStats->suwCount;
+    float xfMean, xfVariance = 0.0f;
+    
+    // Skip channels with nothing collected
+    
+    if (xpsStats->suwCount == 0)
+    {
+      continue;
+    }
+    
+    xfMean = (float)xpsStats->slSum / xfCount;
+    
+    if (xpsStats->suwCount > 1)
+    {
+      xfVariance = ((float)xpsStats->sulSumSq - 
+                    (float)xpsStats->slSum * xfMean) / (xfCount - 1.0f);
+    }
+    
+    xfMean += xpsStats->swFirst;
     
-    return (float)Analog__malParsedData[zeChannel] * ANALOG_SCALE_20;
+    Serial.print(xwChannel);
+    Serial.print(' ');
+    Serial.print(xpsStats->suwCount);
+    Serial.print(' ');
+    Serial.print(xfMean * Analog__Scale(xwChannel), 5);
+    Serial.print(' ');
+    Serial.print(sqrt(max(xfVariance, 0.0f)) * Analog__Scale(xwChannel), 5);
+    Serial.print(' ');
+    Serial.print(xpsStats->swMin * Analog__Scale(xwChannel), 5);
+    Serial.print(' ');
+    Serial.println(xpsStats->swMax * Analog__Scale(xwChannel), 5);
   }
 }
+
+/******************************************************************************
+*
+*    /name       Cmd__StatClear
+*
+*    /purpose    Reset the running statistics
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__StatClear(String znArg)
+{
   
+  // Reset and acknowledge
+  
+  Analog_ResetStats();
+  
+  Command_Reply(true);
+}
@@ -13,6 +13,14 @@
 
 // ***** Definitions **********************************************************
 
+// Number of shields the build supports. Each adds 8 channels and its buffers,
+// so extra shields are compiled in only when asked for, e.g. with
+// -DANALOG_MAX_DEVICES=2.
+
+#ifndef ANALOG_MAX_DEVICES
+#define ANALOG_MAX_DEVICES   1
+#endif
+
 // State of the on board range jumper
 
 typedef enum Analog_Mode_e
@@ -21,7 +29,8 @@ typedef enum Analog_Mode_e
   ANALOG_10_TO_10,
 } Analog_Mode_t;
 
-// ADC Channels
+// ADC Channels. Channel n of shield d is d * ANALOG_DEVICE_CHANNELS + n, so
+// the first shield keeps the numbering of a single shield.
 
 typedef enum Analog_Channel_e
 {
@@ -34,19 +43,53 @@ typedef enum Analog_Channel_e
   ANALOG_CH6,
   ANALOG_CH7,
   
-  ANALOG_NUM_CHANNELS
+  ANALOG_DEVICE_CHANNELS
 } Analog_Channel_t;
 
+#define ANALOG_NUM_CHANNELS  (ANALOG_MAX_DEVICES * ANALOG_DEVICE_CHANNELS)
+
+// Range of the counts Analog_Decode gives, the rails of the ADC
+
+#define ANALOG_COUNTS_MAX    32767L
+#define ANALOG_COUNTS_MIN    (-32768L)
+#define ANALOG_CHANNEL(zwDevice, zwChannel) \
+  ((Analog_Channel_t)((zwDevice) * ANALOG_DEVICE_CHANNELS + (zwChannel)))
+
+// Running statistics for a channel, in counts. The sums are of the
+// differences from the first sample, so they stay in 32 bits. The mean is
+// swFirst + slSum / suwCount and the variance is
+// (sulSumSq - slSum^2 / suwCount) / (suwCount - 1).
+
+typedef struct Analog_Stats_s
+{
+  uint16_t       suwCount;
+  int16_t        swFirst;
+  int32_t        slSum;
+  uint32_t       sulSumSq;
+  int16_t        swMin;
+  int16_t        swMax;
+} Analog_Stats_t;
+
 // ***** Function Headers *****************************************************
 
 // Initialization functions
 
 void Analog_Initialize (Analog_Mode_t zeMode);
+int Analog_AddDevice (unsigned char zucChipSelect, unsigned char zucBusy,
+                      unsigned char zucStart, Analog_Mode_t zeMode);
+int Analog_NumChannels ();
 
 // Read Functions
 
 void Analog_Update ();
 signed long Analog_ReadCounts (Analog_Channel_t zeChannel);
 float Analog_ReadVolts (Analog_Channel_t zeChannel);
+float Analog_CountsToVolts (signed long zlCounts);
+void Analog_Decode (const unsigned char *zpucRaw, signed long *zplCounts);
+
+// Statistics Functions
+
+void Analog_GetStats (Analog_Channel_t zeChannel, Analog_Stats_t *zpsStats);
+void Analog_ResetStats ();
 
 #endif    // !defined _ANALOG_H
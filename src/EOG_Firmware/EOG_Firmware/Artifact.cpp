@@ -0,0 +1,399 @@
+/******************************************************************************
+*
+*    /file    Artifact.cpp
+*
+*    /desc    The artifact module removes motion and electrode-pop artifacts
+*             from the raw channel readings before they reach detection.
+*
+*             Each channel keeps a short window of its latest readings,
+*             the new one included. A reading further than K scaled median
+*             absolute deviations from the window median (a Hampel filter)
+*             is a spike and is replaced by the median. Real saccades are
+*             steps that persist, so they pass once they fill half the
+*             window, one sample late. Readings at or near the ADC rails, as
+*             Analog_Decode gives them, are saturated and are replaced the
+*             same way, without entering the window.
+*
+*             The filter is off until enabled with "set art 1", as it
+*             delays every saccade by a sample. While it is off the
+*             amplitude detector ignores spike sized weights instead, see
+*             Artifact_IsEnabled. Enabling it starts the windows again, so
+*             no reading is judged against readings from before. Rejected
+*             readings are counted per channel and can be read by command.
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+// Arduino Source
+
+#include <Arduino.h>
+
+// Local Modules
+
+#include "Analog.h"
+#include "Command.h"
+#include "Param.h"
+#include "Artifact.h"
+
+// ***** Local Definitions ****************************************************
+
+// Window length, in samples, the new reading included. Must be odd. A step
+// is held back for half the window, rounded down, before it is accepted.
+
+#define ARTIFACT_WINDOW     3
+
+// Hampel threshold, in scaled median absolute deviations. The deviation is
+// scaled by 1.4826 to match the standard deviation of Gaussian noise.
+
+#define ARTIFACT_K          3.0f
+#define ARTIFACT_MAD_SCALE  1.4826f
+
+// Smallest rejection distance, in counts. Keeps a flat window from
+// rejecting every small change.
+
+#define ARTIFACT_FLOOR      16
+
+// Readings within this many counts of either ADC rail are saturated
+
+#define ARTIFACT_RAIL       64
+
+// Window for one channel
+
+typedef struct Artifact_Window_s
+{
+  int16_t         sawSample[ARTIFACT_WINDOW];
+  unsigned char   sucIndex;
+  unsigned char   sucFill;
+} Artifact_Window_t;
+
+// ***** Local Variables ******************************************************
+
+// Tunable values
+
+static boolean Artifact__mbEnable = false;
+static float Artifact__mfK = ARTIFACT_K;
+static int Artifact__mwFloor = ARTIFACT_FLOOR;
+static int Artifact__mwRail = ARTIFACT_RAIL;
+
+// Whether the filter ran on the last reading, to restart the windows when
+// it is enabled
+
+static boolean Artifact__mbRunning = false;
+
+// Windows and rejection counts for each channel
+
+static Artifact_Window_t Artifact__masWindow[ANALOG_NUM_CHANNELS];
+static Artifact_Stats_t Artifact__masStats[ANALOG_NUM_CHANNELS];
+
+// ***** Local Funtions *******************************************************
+
+static void Artifact__Restart();
+static int16_t Artifact__Median(int16_t *zpwValues, unsigned char zucCount);
+
+// Commands
+
+static void Cmd__Art(String znArg);
+static void Cmd__ArtClear(String znArg);
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       Artifact_Initialize
+*
+*    /purpose    Clears the windows and counts, and registers the tunable
+*                values and commands.
+*
+*    /ret        void
+*
+******************************************************************************/
+void Artifact_Initialize ()
+{
+  
+  // Start empty
+  
+  Artifact__Restart();
+  Artifact_ResetStats();
+  
+  // Register tunable values and commands
+  
+  Param_Add("art", PARAM_BOOL, &Artifact__mbEnable, 0, 1);
+  Param_Add("art_k", PARAM_FLOAT, &Artifact__mfK, 1.0f, 20.0f);
+  Param_Add("art_floor", PARAM_INT, &Artifact__mwFloor, 0, 4096);
+  Param_Add("art_rail", PARAM_INT, &Artifact__mwRail, 0, 4096);
+  
+  Command_AddCmd("art", Cmd__Art);
+  Command_AddCmd("artclr", Cmd__ArtClear);
+}
+
+/******************************************************************************
+*
+*    /name       Artifact_Filter
+*
+*    /purpose    Passes one reading of a channel through the artifact filter.
+*                Spikes and saturated readings are replaced by the median of
+*                the recent readings. Until the window is full, readings are
+*                passed as they are. A saturated reading is replaced by the
+*                median of the window before it.
+*
+*    /param[in]  zeChannel    Channel the reading is from
+*    /param[in]  zlCounts     Reading, in counts
+*
+*    /ret        signed long  Cleaned reading, in counts
+*
+******************************************************************************/
+signed long Artifact_Filter (Analog_Channel_t zeChannel, signed long zlCounts)
+{
+  Artifact_Window_t *xpsWindow = &Artifact__masWindow[zeChannel];
+  Artifact_Stats_t *xpsStats = &Artifact__masStats[zeChannel];
+  int16_t xawSorted[ARTIFACT_WINDOW];
+  int16_t xwMedian, xwMad;
+  float xfLimit;
+  boolean xbRail;
+  
+  // Pass everything through when disabled. Once enabled again, start from
+  // empty windows.
+  
+  if (!Artifact__mbEnable)
+  {
+    Artifact__mbRunning = false;
+    
+    return zlCounts;
+  }
+  
+  if (!Artifact__mbRunning)
+  {
+    Artifact__Restart();
+    
+    Artifact__mbRunning = true;
+  }
+  
+  xpsStats->sulSamples++;
+  
+  xbRail = ((zlCounts >= (ANALOG_COUNTS_MAX - Artifact__mwRail)) ||
+            (zlCounts <= (ANALOG_COUNTS_MIN + Artifact__mwRail)));
+  
+  // Not enough history to judge, keep anything that is not saturated
+  
+  if (xpsWindow->sucFill < ARTIFACT_WINDOW)
+  {
+    if (xbRail)
+    {
+      xpsStats->sulRails++;
+    }
+    else
+    {
+      xpsWindow->sawSample[xpsWindow->sucFill++] = (int16_t)zlCounts;
+    }
+    
+    return zlCounts;
+  }
+  
+  // Saturated readings never enter the window
+  
+  if (xbRail)
+  {
+    memcpy(xawSorted, xpsWindow->sawSample, sizeof(xawSorted));
+    xpsStats->sulRails++;
+    
+    return Artifact__Median(xawSorted, ARTIFACT_WINDOW);
+  }
+  
+  // Add the reading to the window, so a step that persists takes over the
+  // median, then take the median
+  
+  xpsWindow->sawSample[xpsWindow->sucIndex] = (int16_t)zlCounts;
+  xpsWindow->sucIndex = (xpsWindow->sucIndex + 1) % ARTIFACT_WINDOW;
+  
+  memcpy(xawSorted, xpsWindow->sawSample, sizeof(xawSorted));
+  xwMedian = Artifact__Median(xawSorted, ARTIFACT_WINDOW);
+  
+  // Median absolute deviation of the window
+  
+  for (int i=0; i < ARTIFACT_WINDOW; i++)
+  {
+    xawSorted[i] = (int16_t)min(abs((signed long)xpsWindow->sawSample[i] - 
+                                    xwMedian), 32767L);
+  }
+  
+  xwMad = Artifact__Median(xawSorted, ARTIFACT_WINDOW);
+  
+  xfLimit = max(Artifact__mfK * ARTIFACT_MAD_SCALE * (float)xwMad, 
+                (float)Artifact__mwFloor);
+  
+  // Reject a spike
+  
+  if (abs(zlCounts - (signed long)xwMedian) > xfLimit)
+  {
+    xpsStats->sulSpikes++;
+    
+    return xwMedian;
+  }
+  
+  return zlCounts;
+}
+
+/******************************************************************************
+*
+*    /name       Artifact_IsEnabled
+*
+*    /purpose    Returns whether the filter is enabled
+*
+*    /ret        boolean    true if readings are filtered
+*
+******************************************************************************/
+boolean Artifact_IsEnabled ()
+{
+  return Artifact__mbEnable;
+}
+
+/******************************************************************************
+*
+*    /name       Artifact__Restart
+*
+*    /purpose    Empties the window of every channel
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Artifact__Restart()
+{
+  
+  for (int xwChannel=0; xwChannel < ANALOG_NUM_CHANNELS; xwChannel++)
+  {
+    Artifact__masWindow[xwChannel].sucIndex = 0;
+    Artifact__masWindow[xwChannel].sucFill = 0;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Artifact__Median
+*
+*    /purpose    Sorts a short array in place and returns its median
+*
+*    /param[io]  zpwValues    Values to sort
+*    /param[in]  zucCount     Number of values, odd
+*
+*    /ret        int16_t      Median value
+*
+******************************************************************************/
+static int16_t Artifact__Median(int16_t *zpwValues, unsigned char zucCount)
+{
+  
+  // Insertion sort, the window is only a few samples
+  
+  for (unsigned char i=1; i < zucCount; i++)
+  {
+    int16_t xwValue = zpwValues[i];
+    unsigned char j = i;
+    
+    while ((j > 0) && (zpwValues[j - 1] > xwValue))
+    {
+      zpwValues[j] = zpwValues[j - 1];
+      j--;
+    }
+    
+    zpwValues[j] = xwValue;
+  }
+  
+  return zpwValues[zucCount / 2];
+}
+
+/******************************************************************************
+*
+*    /name       Artifact_GetStats
+*
+*    /purpose    Returns a copy of the rejection counts of a channel
+*
+*    /param[in]  zeChannel    Channel to read
+*    /param[out] zpsStats     Rejection counts for the channel
+*
+*    /ret        void
+*
+******************************************************************************/
+void Artifact_GetStats (Analog_Channel_t zeChannel, 
+                        Artifact_Stats_t *zpsStats)
+{
+  
+  // Simply copy the internal static variable
+  
+  *zpsStats = Artifact__masStats[zeChannel];
+}
+
+/******************************************************************************
+*
+*    /name       Artifact_ResetStats
+*
+*    /purpose    Clears the rejection counts of every channel
+*
+*    /ret        void
+*
+******************************************************************************/
+void Artifact_ResetStats ()
+{
+  
+  for (int xwChannel=0; xwChannel < ANALOG_NUM_CHANNELS; xwChannel++)
+  {
+    Artifact__masStats[xwChannel] = (Artifact_Stats_t){0, 0, 0};
+  }
+}
+
+
+// ***** Command Definitions **************************************************
+
+/******************************************************************************
+*
+*    /name       Cmd__Art
+*
+*    /purpose    Print the rejection counts of every filtered channel, one
+*                line each: "<ch> <samples> <spikes> <rails>".
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Art(String znArg)
+{
+  
+  for (int xwChannel=0; xwChannel < ANALOG_NUM_CHANNELS; xwChannel++)
+  {
+    Artifact_Stats_t *xpsStats = &Artifact__masStats[xwChannel];
+    
+    // Skip channels that were never filtered
+    
+    if (xpsStats->sulSamples == 0)
+    {
+      continue;
+    }
+    
+    Serial.print(xwChannel);
+    Serial.print(' ');
+    Serial.print(xpsStats->sulSamples);
+    Serial.print(' ');
+    Serial.print(xpsStats->sulSpikes);
+    Serial.print(' ');
+    Serial.println(xpsStats->sulRails);
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__ArtClear
+*
+*    /purpose    Reset the rejection counts
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__ArtClear(String znArg)
+{
+  
+  // Reset and acknowledge
+  
+  Artifact_ResetStats();
+  
+  Command_Reply(true);
+}
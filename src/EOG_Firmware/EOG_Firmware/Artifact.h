@@ -0,0 +1,46 @@
+/******************************************************************************
+*
+*    /file    Artifact.h
+*
+*    /desc    Header file for Artifact module.
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+#ifndef _ARTIFACT_H
+#define _ARTIFACT_H
+
+// ***** Include Files ********************************************************
+
+#include "Analog.h"
+
+// ***** Definitions **********************************************************
+
+// Rejection counts for a channel
+
+typedef struct Artifact_Stats_s
+{
+  unsigned long  sulSamples;
+  unsigned long  sulSpikes;
+  unsigned long  sulRails;
+} Artifact_Stats_t;
+
+// ***** Function Headers *****************************************************
+
+// Initialization functions
+
+void Artifact_Initialize ();
+
+// Filter Functions
+
+signed long Artifact_Filter (Analog_Channel_t zeChannel, signed long zlCounts);
+boolean Artifact_IsEnabled ();
+
+// Statistics Functions
+
+void Artifact_GetStats (Analog_Channel_t zeChannel, 
+                        Artifact_Stats_t *zpsStats);
+void Artifact_ResetStats ();
+
+#endif    // !defined _ARTIFACT_H
@@ -12,7 +12,13 @@
 *             The Calibration state is set so the application knows to wait
 *             for calibration or re-calibrate.
 *
+*             A good calibration can be saved to EEPROM as a versioned,
+*             CRC protected record. On startup the record is loaded straight
+*             into the OK state so the sequence only needs to be run again
+*             when the user or electrode placement changes.
+*
 *    /log     3/16/15  gcg - Initial release.
+*             10/19/26  agt - Added EEPROM save and load of the calibration.
 *
 ******************************************************************************/
 
@@ -21,18 +27,64 @@
 // Arduino Source
 
 #include <SPI.h>
+#include <EEPROM.h>
 #include <Arduino.h>
+#include <stddef.h>
 
 // Local Modules
 
 #include "Analog.h"
 #include "Command.h"
 #include "Calibrate.h"
+#include "Direction.h"
+#include "Template.h"
 
 // ***** Local Definitions ****************************************************
 
 #define DEBUG        0
 
+// EEPROM record location and identification. Bump the version whenever the
+// layout of Direction_Cal_t or Template_Set_t changes so stale records are
+// rejected.
+
+#define CAL_EEPROM_ADDR   0
+#define CAL_MAGIC         0xE0C5
+#define CAL_VERSION       8
+
+// Bytes the record holds between its header and its CRC. The templates are
+// only saved when the template strategy is built in, a record written by
+// the other kind of build is rejected by its length.
+
+#if DIRECTION_DETECT_TEMPLATE
+#define CAL_PAYLOAD       (sizeof(Direction_Cal_t) + sizeof(Template_Set_t))
+#else
+#define CAL_PAYLOAD       (sizeof(Direction_Cal_t))
+#endif
+
+// EEPROM address of a part of the record
+
+#define CAL_ADDR(part)  (CAL_EEPROM_ADDR + offsetof(Calibrate_Record_t, part))
+
+// Saved calibration record. It is only used for its layout, the record is
+// read and written a part at a time so it is never all on the stack.
+
+typedef struct Calibrate_Header_s
+{
+  uint16_t         suwMagic;
+  uint16_t         suwVersion;
+  uint16_t         suwLength;
+} Calibrate_Header_t;
+
+typedef struct Calibrate_Record_s
+{
+  Calibrate_Header_t ssHeader;
+  Direction_Cal_t  ssCal;
+#if DIRECTION_DETECT_TEMPLATE
+  Template_Set_t   ssTemplates;
+#endif
+  uint16_t         suwCrc;
+} Calibrate_Record_t;
+
 // ***** Local Variables ******************************************************
 
 // The calibration state of the application.
@@ -41,8 +93,13 @@ static Cal_State_t Calibrate__meCalState;
 
 // ***** Local Funtions *******************************************************
 
+static uint16_t Calibrate__Crc16(int zwAddr, unsigned int zuwLen);
+
 static void Cmd__Ok(String znArg);
 static void Cmd__ReCal(String znArg);
+static void Cmd__Save(String znArg);
+static void Cmd__Load(String znArg);
+static void Cmd__Forget(String znArg);
 
 // ***** Function Definitions *************************************************
 
@@ -67,6 +124,9 @@ void Calibration_Initialize()
   
   Command_AddCmd("ok", Cmd__Ok);
   Command_AddCmd("recal", Cmd__ReCal);
+  Command_AddCmd("save", Cmd__Save);
+  Command_AddCmd("load", Cmd__Load);
+  Command_AddCmd("forget", Cmd__Forget);
 }
 
 /******************************************************************************
@@ -104,6 +164,201 @@ boolean Calibration_CheckState()
   return Calibrate__meCalState == CALIBRATION_OK;
 }
 
+/******************************************************************************
+*
+*    /name       Calibration_SetState
+*
+*    /purpose    Sets the Calibration state. Used by modules that can reach
+*                a usable calibration without the calibration commands.
+*
+*    /param[in]  zeState    The new calibration state
+*
+*    /ret        void
+*
+******************************************************************************/
+void Calibration_SetState(Cal_State_t zeState)
+{
+  
+  // Set the Calibration State
+  
+  Calibrate__meCalState = zeState;
+}
+
+/******************************************************************************
+*
+*    /name       Calibration_Load
+*
+*    /purpose    Reads the calibration record from EEPROM. If the record is
+*                valid, it is loaded into the Direction and Template modules
+*                and the calibration state is set to OK.
+*
+*    /ret        boolean    true if a valid record was loaded, false otherwise
+*
+******************************************************************************/
+boolean Calibration_Load()
+{
+  Calibrate_Header_t xsHeader;
+  uint16_t xuwCrc;
+  
+  // Read the header
+  
+  EEPROM.get(CAL_ADDR(ssHeader), xsHeader);
+  
+  // Check the header. Anything that does not match exactly was either
+  // never written or was written by a different firmware.
+  
+  if ((xsHeader.suwMagic != CAL_MAGIC) ||
+      (xsHeader.suwVersion != CAL_VERSION) ||
+      (xsHeader.suwLength != CAL_PAYLOAD))
+  {
+    return false;
+  }
+  
+  // Check the CRC, which covers everything up to the CRC itself
+  
+  EEPROM.get(CAL_ADDR(suwCrc), xuwCrc);
+  
+  if (xuwCrc != 
+      Calibrate__Crc16(CAL_EEPROM_ADDR, offsetof(Calibrate_Record_t, suwCrc)))
+  {
+    return false;
+  }
+  
+  // Record is good, load it a part at a time and skip straight to OK
+  
+  {
+    Direction_Cal_t xsCal;
+    
+    EEPROM.get(CAL_ADDR(ssCal), xsCal);
+    Direction_SetCalibration(&xsCal);
+  }
+  
+#if DIRECTION_DETECT_TEMPLATE
+  {
+    Template_Set_t xsTemplates;
+    
+    EEPROM.get(CAL_ADDR(ssTemplates), xsTemplates);
+    Template_SetSet(&xsTemplates);
+  }
+#endif
+  
+  Calibrate__meCalState = CALIBRATION_OK;
+  
+  return true;
+}
+
+/******************************************************************************
+*
+*    /name       Calibration_Save
+*
+*    /purpose    Writes the current calibration to EEPROM. Only a completed
+*                calibration is saved.
+*
+*    /ret        boolean    true if the record was written, false otherwise
+*
+******************************************************************************/
+boolean Calibration_Save()
+{
+  Calibrate_Header_t xsHeader;
+  
+  // Don't save a partial calibration
+  
+  if (Calibrate__meCalState != CALIBRATION_OK)
+  {
+    return false;
+  }
+  
+  // Write the record a part at a time. EEPROM.put only writes bytes that
+  // changed.
+  
+  xsHeader.suwMagic = CAL_MAGIC;
+  xsHeader.suwVersion = CAL_VERSION;
+  xsHeader.suwLength = CAL_PAYLOAD;
+  
+  EEPROM.put(CAL_ADDR(ssHeader), xsHeader);
+  
+  {
+    Direction_Cal_t xsCal;
+    
+    Direction_GetCalibration(&xsCal);
+    EEPROM.put(CAL_ADDR(ssCal), xsCal);
+  }
+  
+#if DIRECTION_DETECT_TEMPLATE
+  {
+    Template_Set_t xsTemplates;
+    
+    Template_GetSet(&xsTemplates);
+    EEPROM.put(CAL_ADDR(ssTemplates), xsTemplates);
+  }
+#endif
+  
+  // Then the CRC of what was written
+  
+  EEPROM.put(CAL_ADDR(suwCrc), 
+             Calibrate__Crc16(CAL_EEPROM_ADDR, 
+                              offsetof(Calibrate_Record_t, suwCrc)));
+  
+  return true;
+}
+
+/******************************************************************************
+*
+*    /name       Calibration_Forget
+*
+*    /purpose    Invalidates the saved calibration record. Only the magic
+*                number is cleared to save EEPROM wear.
+*
+*    /ret        void
+*
+******************************************************************************/
+void Calibration_Forget()
+{
+  uint16_t xuwMagic = 0xFFFF;
+  
+  // Overwrite the magic number with the erased value
+  
+  EEPROM.put(CAL_ADDR(ssHeader.suwMagic), xuwMagic);
+}
+
+/******************************************************************************
+*
+*    /name       Calibrate__Crc16
+*
+*    /purpose    Computes a CRC-16/CCITT over the given EEPROM bytes.
+*
+*    /param[in]  zwAddr      EEPROM address of the data to check
+*    /param[in]  zuwLen      Number of bytes
+*
+*    /ret        uint16_t    The CRC
+*
+******************************************************************************/
+static uint16_t Calibrate__Crc16(int zwAddr, unsigned int zuwLen)
+{
+  uint16_t xuwCrc = 0xFFFF;
+  
+  // Bitwise, this is only run at startup and on command
+  
+  for (unsigned int i=0; i<zuwLen; i++)
+  {
+    xuwCrc ^= (uint16_t)EEPROM.read(zwAddr + i) << 8;
+    
+    for (int j=0; j<8; j++)
+    {
+      if (xuwCrc & 0x8000)
+      {
+        xuwCrc = (xuwCrc << 1) ^ 0x1021;
+      }
+      else
+      {
+        xuwCrc <<= 1;
+      }
+    }
+  }
+  
+  return xuwCrc;
+}
+
 
 // ***** Command Definitions **************************************************
 
@@ -140,3 +395,56 @@ static void Cmd__ReCal(String znArg)
   
   Calibrate__meCalState = CALIBRATION_RECAL;
 }
+
+/******************************************************************************
+*
+*    /name       Cmd__Save
+*
+*    /purpose    Save the current calibration to EEPROM
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Save(String znArg)
+{
+  
+  // Save and report the result
+  
+  Command_Reply(Calibration_Save());
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Load
+*
+*    /purpose    Load the saved calibration from EEPROM
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Load(String znArg)
+{
+  
+  // Load and report the result
+  
+  Command_Reply(Calibration_Load());
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Forget
+*
+*    /purpose    Erase the saved calibration
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Forget(String znArg)
+{
+  
+  // Invalidate the record, the current calibration is left alone
+  
+  Calibration_Forget();
+  
+  Command_Reply(true);
+}
@@ -29,9 +29,19 @@ typedef enum Cal_State_e
 
 void Calibration_Initialize ();
 
+// Persistence functions
+
+boolean Calibration_Load();
+boolean Calibration_Save();
+void Calibration_Forget();
+
 // Get Functions
 
 Cal_State_t Calibration_GetState();
 boolean Calibration_CheckState();
 
+// Set Functions
+
+void Calibration_SetState(Cal_State_t zeState);
+
 #endif    // !defined _CALIBRATION_H
@@ -12,7 +12,42 @@
 *             arguments. This will allow dynamic addition of funtionality as 
 *             needed across the development process.
 *
+*             Received characters are moved from the serial driver's receive
+*             buffer (filled by its interrupt) into a fixed line buffer. 
+*             Completed lines are queued and executed one at a time from the
+*             main loop through Command_Process, so a burst of commands does
+*             not hold up sampling. Lines that overflow the line buffer, or
+*             that complete while the queue is full, are dropped with a 
+*             failure reply carrying their tag. Characters are only
+*             echoed in interactive mode (the "echo" command).
+*
+*             Command replies go through Command_Reply. In sequenced mode
+*             (the "seq" command) each reply carries the next value of a
+*             sequence number shared with the direction events and gaze
+*             frames, and echoes the tag of the request. A request is 
+*             tagged by starting it with "#<tag> ", e.g. "#17 set vel_k 5"
+*             -> "1 2041 #17". Commands that only print, such as "get" or
+*             "list", are closed by a "1" reply, so every command ends with
+*             exactly one sequenced status line.
+*
+*             Several commands can be sent on one line separated by ';'.
+*             They run in order and share one reply. Parameter writes 
+*             ("set") at the start of the line are rolled back if one of 
+*             them fails, see Command__ExecuteLine. Commands read their 
+*             arguments with the Command_Arg functions.
+*
+*             The baud rate can be raised at runtime. "baud <rate>" is 
+*             acknowledged at the old rate, then the port switches. The host
+*             must switch too and send "baudok" at the new rate within the
+*             confirm time, which is acknowledged at the new rate. Otherwise
+*             the port falls back to the old rate.
+*
+*             The "ping <nonce>" command replies "pong <nonce> <micros> 
+*             <seq>" so the host can measure the link latency and the
+*             offset between the clocks.
+*
 *    /log     2/23/15  gcg - Initial release.
+*             10/19/26  agt - Added line queue, batches, frames, baud.
 *
 ******************************************************************************/
 
@@ -25,17 +60,31 @@
 // Local Modules
 
 #include "Command.h"
+#include "Param.h"
 
 // ***** Local Definitions ****************************************************
 
-// DEBUG - Tags for quick changes during development
-
-#define ECHO  true
-
 // Max number of commands
 
 #define MAX_NUM_CMDS     64
-#define CMD_BUFFER_SIZE  200
+
+// Line buffer size, including the terminator, and number of completed
+// lines that can wait for execution
+
+#define CMD_LINE_SIZE    128
+#define CMD_QUEUE_SIZE   2
+
+// Time the host has to confirm a new baud rate, in ms
+
+#define BAUD_CONFIRM_MS  2000
+
+// Binary frame sync byte
+
+#define FRAME_SYNC       0xA5
+
+// The command a batch can roll back, when it comes before any other
+
+#define CMD_BATCH_CMD    "set "
 
 // ***** Local Variables ******************************************************
 
@@ -47,19 +96,69 @@ static unsigned int Command__muhCmdCount;
 
 static Command_t Command__masCommands[MAX_NUM_CMDS];
 
-// Command buffer
+// Line being received, and whether it has overflowed
+
+static char Command__macLine[CMD_LINE_SIZE];
+static unsigned char Command__mucLineLen;
+static boolean Command__mbLineOverflow;
+
+// Completed lines waiting for execution
+
+static char Command__maacQueue[CMD_QUEUE_SIZE][CMD_LINE_SIZE];
+static unsigned char Command__mucQueueHead;
+static unsigned char Command__mucQueueCount;
+
+// Current baud rate, and the rate to fall back to while a new one waits
+// for confirmation (0 when nothing is pending)
+
+static long Command__mlBaud;
+static long Command__mlFallbackBaud;
+static unsigned long Command__mulBaudStart;
+
+// Interactive mode, echo received characters
+
+static boolean Command__mbEcho;
+
+// Sequenced replies - mode, shared sequence number and the tag of the
+// request being executed
+
+static boolean Command__mbSequenced;
+static unsigned int Command__muwSeq;
+static String Command__mnTag;
+
+// Whether the command being executed has sent its reply
+
+static boolean Command__mbReplied;
+
+// Batch in progress, replies are held and combined
+
+static boolean Command__mbBatch;
+static boolean Command__mbBatchOk;
 
-static String Command__mnCmdBuffer;
+// Checksum of the frame being sent
+
+static byte Command__mucFrameSum;
 
 // ***** Local Funtions *******************************************************
 
 static int Command__GetCmd(String znCmd);
+static void Command__ExecuteLine(String znLine);
 static void Command__Execute(String znInput);
+static boolean Command__Arg(const String &znArgs, int zwIndex, 
+                            String *zpnValue);
+static void Command__Receive();
+static void Command__Drop();
+static void Command__SetBaud(long zlBaud);
 
 
 // Commands
 
 static void Cmd__Test(String znArg);
+static void Cmd__Seq(String znArg);
+static void Cmd__Ping(String znArg);
+static void Cmd__Echo(String znArg);
+static void Cmd__Baud(String znArg);
+static void Cmd__BaudOk(String znArg);
 
 
 // ***** Function Definitions *************************************************
@@ -78,6 +177,11 @@ static void Cmd__Test(String znArg);
 *                           - 2400         - 38400
 *                           - 4800         - 57600
 *                           - 9600         - 115200
+*                           The "baud" command can raise it at runtime
+*                           to 250000, 500000 or 1000000 (or back to
+*                           115200). A new rate the host does not
+*                           confirm with "baudok" within BAUD_CONFIRM_MS
+*                           falls back to the old one.
 *
 *    /ret        void
 *
@@ -95,18 +199,61 @@ void Command_Initialize(long zwBaud)
     Command__masCommands[i] = (Command_t){"", NULL};      
   }
   
-  // Clear the buffer
+  // Clear the line buffer and queue
   
-  Command__mnCmdBuffer.reserve(CMD_BUFFER_SIZE);
-  Command__mnCmdBuffer = "";
+  Command__mucLineLen = 0;
+  Command__mbLineOverflow = false;
+  Command__mucQueueHead = 0;
+  Command__mucQueueCount = 0;
+  Command__mbEcho = false;
   
   // Add test commands
   
   Command_AddCmd("test", Cmd__Test);
   
+  // Add protocol commands
+  
+  Command__mbSequenced = false;
+  Command__muwSeq = 0;
+  Command__mnTag = "";
+  Command__mbBatch = false;
+  
+  Command_AddCmd("seq", Cmd__Seq);
+  Command_AddCmd("ping", Cmd__Ping);
+  Command_AddCmd("echo", Cmd__Echo);
+  Command_AddCmd("baud", Cmd__Baud);
+  Command_AddCmd("baudok", Cmd__BaudOk);
+  
   // Open Serial communications
   
-  Serial.begin(zwBaud);
+  Command__mlFallbackBaud = 0;
+  
+  Command__SetBaud(zwBaud);
+}
+
+/******************************************************************************
+*
+*    /name       Command__SetBaud
+*
+*    /purpose    (Re)opens the Serial port at the given baud rate. Anything
+*                waiting to be sent is sent first, anything partly received
+*                is dropped.
+*
+*    /param[in]  zlBaud    Baud rate to set
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Command__SetBaud(long zlBaud)
+{
+  
+  Serial.flush();
+  Serial.end();
+  Serial.begin(zlBaud);
+  
+  Command__mlBaud = zlBaud;
+  Command__mucLineLen = 0;
+  Command__mbLineOverflow = false;
 }
 
 /******************************************************************************
@@ -135,6 +282,169 @@ void Command_AddCmd(String znName, Command_Function_t zpvCallback)
   Command__muhCmdCount++;
 }
 
+/******************************************************************************
+*
+*    /name       Command_Reply
+*
+*    /purpose    Sends the status reply of a command: "1" on success, "0" on
+*                failure. In sequenced mode the next sequence number and the
+*                tag of the request, if any, follow the status. Inside a
+*                batch the status is held for the batch reply.
+*
+*    /param[in]  zbOk    Command status
+*
+*    /ret        void
+*
+******************************************************************************/
+void Command_Reply(boolean zbOk)
+{
+  
+  Command__mbReplied = true;
+  
+  // Inside a batch only the combined status is sent, at the end
+  
+  if (Command__mbBatch)
+  {
+    Command__mbBatchOk = Command__mbBatchOk && zbOk;
+    return;
+  }
+  
+  Serial.print(zbOk ? '1' : '0');
+  
+  if (Command__mbSequenced)
+  {
+    Serial.print(' ');
+    Serial.print(Command_NextSeq());
+    
+    if (Command__mnTag.length() > 0)
+    {
+      Serial.print(" #");
+      Serial.print(Command__mnTag);
+    }
+  }
+  
+  Serial.print("\r\n");
+}
+
+/******************************************************************************
+*
+*    /name       Command_NextSeq
+*
+*    /purpose    Returns the next sequence number. Replies and events share
+*                the one 16 bit sequence, so the host sees a single order
+*                and can spot anything lost.
+*
+*    /ret        unsigned int    Sequence number
+*
+******************************************************************************/
+unsigned int Command_NextSeq()
+{
+  
+  return ++Command__muwSeq;
+}
+
+/******************************************************************************
+*
+*    /name       Command_IsSequenced
+*
+*    /purpose    Returns whether sequenced mode is on, so modules that send
+*                unsolicited output can add the sequence number to it
+*
+*    /ret        boolean    true in sequenced mode
+*
+******************************************************************************/
+boolean Command_IsSequenced()
+{
+  
+  return Command__mbSequenced;
+}
+
+/******************************************************************************
+*
+*    /name       Command_SendFrame
+*
+*    /purpose    Sends a binary frame on the Serial port. Frames let modules
+*                stream compact data alongside the ASCII replies:
+*                  0xA5 <type> <length> <data ...> <checksum>
+*                The checksum is the 8 bit sum of type, length and data.
+*
+*    /param[in]  zucType     Frame type, an ASCII letter by convention
+*    /param[in]  zpucData    Frame data
+*    /param[in]  zucLen      Number of data bytes
+*
+*    /ret        void
+*
+******************************************************************************/
+void Command_SendFrame(byte zucType, const byte *zpucData, byte zucLen)
+{
+  
+  Command_BeginFrame(zucType, zucLen);
+  Command_FrameData(zpucData, zucLen);
+  Command_EndFrame();
+}
+
+/******************************************************************************
+*
+*    /name       Command_BeginFrame
+*
+*    /purpose    Starts a binary frame whose data is sent in pieces with
+*                Command_FrameData, so large frames need no buffer. The
+*                pieces must add up to the given length, then the frame is
+*                closed with Command_EndFrame.
+*
+*    /param[in]  zucType     Frame type, an ASCII letter by convention
+*    /param[in]  zucLen      Number of data bytes
+*
+*    /ret        void
+*
+******************************************************************************/
+void Command_BeginFrame(byte zucType, byte zucLen)
+{
+  
+  Command__mucFrameSum = zucType + zucLen;
+  
+  Serial.write((byte)FRAME_SYNC);
+  Serial.write(zucType);
+  Serial.write(zucLen);
+}
+
+/******************************************************************************
+*
+*    /name       Command_FrameData
+*
+*    /purpose    Sends the next piece of the data of an open frame.
+*
+*    /param[in]  zpucData    Frame data
+*    /param[in]  zucLen      Number of data bytes
+*
+*    /ret        void
+*
+******************************************************************************/
+void Command_FrameData(const byte *zpucData, byte zucLen)
+{
+  
+  for (int i=0; i<zucLen; i++)
+  {
+    Command__mucFrameSum += zpucData[i];
+  }
+  
+  Serial.write(zpucData, zucLen);
+}
+
+/******************************************************************************
+*
+*    /name       Command_EndFrame
+*
+*    /purpose    Closes an open frame with its checksum.
+*
+*    /ret        void
+*
+******************************************************************************/
+void Command_EndFrame()
+{
+  
+  Serial.write(Command__mucFrameSum);
+}
 
 /******************************************************************************
 *
@@ -170,15 +480,136 @@ static int Command__GetCmd (String znCmd)
   return xwIndex;
 }
 
+/******************************************************************************
+*
+*    /name       Command__ExecuteLine
+*
+*    /purpose    Executes a received line. A leading "#<tag>" is removed and
+*                kept for the reply. The rest is one command, or a batch of
+*                commands separated by ';'.
+*
+*                A batch gets a single reply: "1" if every command succeeded.
+*                It stops at the first failure. Parameter writes ("set") at
+*                the start of a batch can be rolled back: if one of them
+*                fails, every parameter they set is put back to its value
+*                before the batch and the reply is "0". The first other 
+*                command commits them, it and the rest of the batch are a
+*                final step that is not rolled back, e.g. 
+*                "set vel_k 5; set dwell 2; det vel; evt 1". A failure in 
+*                that step leaves the commands before it applied. The whole
+*                line runs before the main loop samples again, so detection
+*                never sees half of a batch.
+*
+*    /param[in]  znLine    The received line
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Command__ExecuteLine (String znLine)
+{
+  int xwStart = 0;
+  int xwEnd;
+  boolean xbRollback;
+  
+  // Split off the request tag
+  
+  Command__mnTag = "";
+  
+  if (znLine.startsWith("#"))
+  {
+    int xwSpace = znLine.indexOf(' ');
+    
+    if (xwSpace == -1)
+    {
+      xwSpace = znLine.length();
+    }
+    
+    Command__mnTag = znLine.substring(1, xwSpace);
+    znLine = znLine.substring(min(xwSpace + 1, (int)znLine.length()));
+  }
+  
+  // Single command
+  
+  if (znLine.indexOf(';') == -1)
+  {
+    Command__Execute(znLine);
+    Command__mnTag = "";
+    return;
+  }
+  
+  // Batch. Hold the replies and keep the parameters it sets, to roll back
+  // to.
+  
+  Param_Snapshot();
+  
+  Command__mbBatch = true;
+  Command__mbBatchOk = true;
+  xbRollback = true;
+  
+  while (Command__mbBatchOk && (xwStart <= (int)znLine.length()))
+  {
+    String xnCmd;
+    
+    xwEnd = znLine.indexOf(';', xwStart);
+    
+    if (xwEnd == -1)
+    {
+      xwEnd = znLine.length();
+    }
+    
+    xnCmd = znLine.substring(xwStart, xwEnd);
+    xnCmd.trim();
+    
+    // The first command that is not a parameter write ends the part that
+    // can be rolled back
+    
+    if (xbRollback && (xnCmd.length() > 0) && 
+        !xnCmd.startsWith(CMD_BATCH_CMD))
+    {
+      Param_Commit();
+      xbRollback = false;
+    }
+    
+    // Skip empty commands, e.g. after a trailing ';'
+    
+    if (xnCmd.length() > 0)
+    {
+      Command__Execute(xnCmd);
+    }
+    
+    xwStart = xwEnd + 1;
+  }
+  
+  Command__mbBatch = false;
+  
+  // Roll back a failed parameter write and send the one reply
+  
+  if (xbRollback)
+  {
+    if (Command__mbBatchOk)
+    {
+      Param_Commit();
+    }
+    else
+    {
+      Param_Restore();
+    }
+  }
+  
+  Command_Reply(Command__mbBatchOk);
+  
+  Command__mnTag = "";
+}
+
 /******************************************************************************
 *
 *    /name       Command__Execute
 *
 *    /purpose    Searches the command table for the given string, executes
-*                its associated callback.
+*                its associated callback. Everything after the first space
+*                is passed to the callback as its argument string.
 *
-*    /param[in]  znCmd    The given command
-*    /param[in]  znArg    The given Argument (if applicable)
+*    /param[in]  znInput    The given command and its arguments
 *
 *    /ret        void
 *
@@ -198,7 +629,7 @@ static void Command__Execute (String znInput)
   else
   {
     xnCmd = znInput.substring(0, znInput.indexOf(" "));
-    xnArgs = znInput.substring(znInput.lastIndexOf(" ") + 1);
+    xnArgs = znInput.substring(znInput.indexOf(" ") + 1);
   }
   
   // Try to find the given command
@@ -209,21 +640,291 @@ static void Command__Execute (String znInput)
   
   if (xhCmdIndex == -1)
   {
-    Serial.print("Invalid Command");
+    
+    // In sequenced mode or a batch the host is waiting on a reply
+    
+    if (Command__mbSequenced || Command__mbBatch)
+    {
+      Command_Reply(false);
+    }
+    else
+    {
+      Serial.print("Invalid Command");
+    }
   }
   else
   {
+    Command__mbReplied = false;
+    
     Command__masCommands[xhCmdIndex].spvCallback(xnArgs);
+    
+    // In sequenced mode commands that only print are closed with a 
+    // reply, so their output is sequenced too
+    
+    if (Command__mbSequenced && !Command__mbReplied)
+    {
+      Command_Reply(true);
+    }
   }
 }
 
+/******************************************************************************
+*
+*    /name       Command__Arg
+*
+*    /purpose    Finds an argument in an argument string. Arguments are
+*                separated by one or more spaces.
+*
+*    /param[in]  znArgs     The argument string
+*    /param[in]  zwIndex    Index of the argument, from 0
+*    /param[out] zpnValue   The argument
+*
+*    /ret        boolean    true if the argument exists
+*
+******************************************************************************/
+static boolean Command__Arg (const String &znArgs, int zwIndex, 
+                             String *zpnValue)
+{
+  int xwPos = 0;
+  int xwLen = znArgs.length();
+  
+  for (int i=0; ; i++)
+  {
+    int xwStart;
+    
+    // Skip spaces
+    
+    while ((xwPos < xwLen) && (znArgs.charAt(xwPos) == ' '))
+    {
+      xwPos++;
+    }
+    
+    if (xwPos >= xwLen)
+    {
+      return false;
+    }
+    
+    // Find the end of the argument
+    
+    xwStart = xwPos;
+    
+    while ((xwPos < xwLen) && (znArgs.charAt(xwPos) != ' '))
+    {
+      xwPos++;
+    }
+    
+    if (i == zwIndex)
+    {
+      *zpnValue = znArgs.substring(xwStart, xwPos);
+      return true;
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Command_ArgCount
+*
+*    /purpose    Counts the arguments in an argument string
+*
+*    /param[in]  znArgs    The argument string
+*
+*    /ret        int       Number of arguments
+*
+******************************************************************************/
+int Command_ArgCount (const String &znArgs)
+{
+  String xnArg;
+  int xwCount = 0;
+  
+  while (Command__Arg(znArgs, xwCount, &xnArg))
+  {
+    xwCount++;
+  }
+  
+  return xwCount;
+}
+
+/******************************************************************************
+*
+*    /name       Command_ArgString
+*
+*    /purpose    Reads an argument as a string
+*
+*    /param[in]  znArgs     The argument string
+*    /param[in]  zwIndex    Index of the argument, from 0
+*    /param[out] zpnValue   The argument
+*
+*    /ret        boolean    true if the argument exists
+*
+******************************************************************************/
+boolean Command_ArgString (const String &znArgs, int zwIndex, 
+                           String *zpnValue)
+{
+  
+  return Command__Arg(znArgs, zwIndex, zpnValue);
+}
+
+/******************************************************************************
+*
+*    /name       Command_ArgLong
+*
+*    /purpose    Reads an argument as a whole number. The argument must be
+*                an optional sign followed by digits only.
+*
+*    /param[in]  znArgs     The argument string
+*    /param[in]  zwIndex    Index of the argument, from 0
+*    /param[out] zplValue   The value
+*
+*    /ret        boolean    true if the argument exists and is valid
+*
+******************************************************************************/
+boolean Command_ArgLong (const String &znArgs, int zwIndex, long *zplValue)
+{
+  String xnArg;
+  unsigned int xuwPos = 0;
+  
+  if (!Command__Arg(znArgs, zwIndex, &xnArg))
+  {
+    return false;
+  }
+  
+  // Check the format
+  
+  if ((xnArg.charAt(0) == '-') || (xnArg.charAt(0) == '+'))
+  {
+    xuwPos++;
+  }
+  
+  if (xuwPos >= xnArg.length())
+  {
+    return false;
+  }
+  
+  for (; xuwPos < xnArg.length(); xuwPos++)
+  {
+    if (!isdigit(xnArg.charAt(xuwPos)))
+    {
+      return false;
+    }
+  }
+  
+  *zplValue = xnArg.toInt();
+  
+  return true;
+}
+
+/******************************************************************************
+*
+*    /name       Command_ArgFloat
+*
+*    /purpose    Reads an argument as a number. The argument must be an
+*                optional sign followed by digits with at most one decimal
+*                point.
+*
+*    /param[in]  znArgs     The argument string
+*    /param[in]  zwIndex    Index of the argument, from 0
+*    /param[out] zpfValue   The value
+*
+*    /ret        boolean    true if the argument exists and is valid
+*
+******************************************************************************/
+boolean Command_ArgFloat (const String &znArgs, int zwIndex, float *zpfValue)
+{
+  String xnArg;
+  unsigned int xuwPos = 0;
+  boolean xbPoint = false;
+  boolean xbDigit = false;
+  
+  if (!Command__Arg(znArgs, zwIndex, &xnArg))
+  {
+    return false;
+  }
+  
+  // Check the format
+  
+  if ((xnArg.charAt(0) == '-') || (xnArg.charAt(0) == '+'))
+  {
+    xuwPos++;
+  }
+  
+  for (; xuwPos < xnArg.length(); xuwPos++)
+  {
+    char xcChar = xnArg.charAt(xuwPos);
+    
+    if (isdigit(xcChar))
+    {
+      xbDigit = true;
+    }
+    else if ((xcChar == '.') && !xbPoint)
+    {
+      xbPoint = true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  
+  if (!xbDigit)
+  {
+    return false;
+  }
+  
+  *zpfValue = xnArg.toFloat();
+  
+  return true;
+}
+
+/******************************************************************************
+*
+*    /name       Command_Process
+*
+*    /purpose    Executes the oldest queued command line, if any. Meant to be
+*                called from the main loop whenever it has a free slot.
+*
+*    /ret        void
+*
+******************************************************************************/
+void Command_Process()
+{
+  String xnLine;
+  
+  // Fall back if a new baud rate was not confirmed in time
+  
+  if ((Command__mlFallbackBaud != 0) && 
+      ((millis() - Command__mulBaudStart) > BAUD_CONFIRM_MS))
+  {
+    Command__SetBaud(Command__mlFallbackBaud);
+    Command__mlFallbackBaud = 0;
+  }
+  
+  // Pick up anything received since the last call
+  
+  Command__Receive();
+  
+  if (Command__mucQueueCount == 0)
+  {
+    return;
+  }
+  
+  // Copy out and release the queue entry before executing, so the line
+  // can be replaced while the command runs
+  
+  xnLine = Command__maacQueue[Command__mucQueueHead];
+  
+  Command__mucQueueHead = (Command__mucQueueHead + 1) % CMD_QUEUE_SIZE;
+  Command__mucQueueCount--;
+  
+  Command__ExecuteLine(xnLine);
+}
+
 /******************************************************************************
 *
 *    /name       serialEvent
 *
 *    /purpose    Arduino internal funtion, occurs in between "loops" and
-*                whenever a new character is recieved. Echos the character,
-*                and executes the command if needed.
+*                whenever a new character is recieved.
 *
 *    /ret        void
 *
@@ -231,7 +932,24 @@ static void Command__Execute (String znInput)
 void serialEvent() 
 {
   
-  // Check for multiple characters
+  Command__Receive();
+}
+
+/******************************************************************************
+*
+*    /name       Command__Receive
+*
+*    /purpose    Moves the received characters into the line buffer and
+*                queues completed lines. Does not execute anything.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Command__Receive() 
+{
+  
+  // Check for multiple characters. Keep reading while the queue is full,
+  // the serial driver's buffer is small and would overflow silently.
   
   while (Serial.available()) {
    
@@ -239,29 +957,89 @@ void serialEvent()
     
     char xcInChar = (char)Serial.read();
     
-    // Add it to the buffer (if alpha-numeric)
+    // Print the the character (if in interactive mode)
     
-    if (!iscntrl(xcInChar))
+    if (Command__mbEcho)
     {
-      Command__mnCmdBuffer += xcInChar;
+      Serial.print(xcInChar);
     }
     
-    // Print the the character (if echo is enabled)
+    // If the incoming character is a newline, queue the line
     
-    if (ECHO)
+    if (xcInChar == '\n') 
     {
-      Serial.print(xcInChar);
+      if (Command__mbLineOverflow || 
+          (Command__mucQueueCount >= CMD_QUEUE_SIZE))
+      {
+        
+        // Too long or no room to queue it, drop it
+        
+        Command__Drop();
+      }
+      else
+      {
+        unsigned char xucTail = (Command__mucQueueHead + 
+                                 Command__mucQueueCount) % CMD_QUEUE_SIZE;
+        
+        Command__macLine[Command__mucLineLen] = '\0';
+        memcpy(Command__maacQueue[xucTail], Command__macLine, 
+               Command__mucLineLen + 1);
+        Command__mucQueueCount++;
+      }
+      
+      Command__mucLineLen = 0;
+      Command__mbLineOverflow = false;
     }
     
-    // If the incoming character is a newline, attempt
-    // to execute it
+    // Add it to the buffer (if not a control character), leaving room for
+    // the terminator
     
-    if (xcInChar == '\n') 
+    else if (!iscntrl(xcInChar))
+    {
+      if (Command__mucLineLen < (CMD_LINE_SIZE - 1))
+      {
+        Command__macLine[Command__mucLineLen++] = xcInChar;
+      }
+      else
+      {
+        Command__mbLineOverflow = true;
+      }
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Command__Drop
+*
+*    /purpose    Fails the line in the line buffer without executing it. The
+*                reply carries the line's tag, if it has one, since it can
+*                arrive before the replies to the lines queued ahead of it.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Command__Drop()
+{
+  unsigned char xucEnd = 1;
+  
+  // Pick up the tag, up to the first space
+  
+  if ((Command__mucLineLen > 0) && (Command__macLine[0] == '#'))
+  {
+    while ((xucEnd < Command__mucLineLen) && 
+           (Command__macLine[xucEnd] != ' '))
     {
-      Command__Execute(Command__mnCmdBuffer);
-      Command__mnCmdBuffer = "";
-    } 
+      xucEnd++;
+    }
+    
+    Command__macLine[xucEnd] = '\0';
+    Command__mnTag = &Command__macLine[1];
   }
+  
+  Command_Reply(false);
+  
+  Command__mnTag = "";
 }
 
 // Test Command
@@ -273,3 +1051,126 @@ static void Cmd__Test(String znArg)
  
   Serial.println("Hello, World!"); 
 }
+
+/******************************************************************************
+*
+*    /name       Cmd__Seq
+*
+*    /purpose    Turn sequenced replies on (1) or off (0). The reply to this
+*                command is already in the new mode.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Seq(String znArg)
+{
+  
+  Command__mbSequenced = (znArg.toInt() != 0);
+  
+  Command_Reply(true);
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Ping
+*
+*    /purpose    Reply with the host nonce, the device time and a sequence
+*                number: "pong <nonce> <micros> <seq>\r\n". The pong is the
+*                reply, no status line follows it.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Ping(String znArg)
+{
+  unsigned long xulNow = micros();
+  
+  Serial.print("pong ");
+  Serial.print(znArg);
+  Serial.print(' ');
+  Serial.print(xulNow);
+  Serial.print(' ');
+  Serial.println(Command_NextSeq());
+  
+  Command__mbReplied = true;
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Echo
+*
+*    /purpose    Turn interactive mode, echoing received characters, on (1)
+*                or off (0).
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Echo(String znArg)
+{
+  
+  Command__mbEcho = (znArg.toInt() != 0);
+  
+  Command_Reply(true);
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Baud
+*
+*    /purpose    Switch to a new baud rate: 115200, 250000, 500000 or 
+*                1000000. The reply is sent at the old rate. The new rate
+*                must be confirmed with "baudok" within the confirm time.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Baud(String znArg)
+{
+  long xlBaud;
+  
+  // Check the rate. Only one change at a time, and not inside a batch
+  // since the batch reply would go out at the new rate.
+  
+  if (!Command_ArgLong(znArg, 0, &xlBaud) || 
+      (Command__mlFallbackBaud != 0) || Command__mbBatch ||
+      ((xlBaud != 115200) && (xlBaud != 250000) &&
+       (xlBaud != 500000) && (xlBaud != 1000000)))
+  {
+    Command_Reply(false);
+    return;
+  }
+  
+  // Acknowledge, then switch and wait for the host
+  
+  Command_Reply(true);
+  
+  Command__mlFallbackBaud = Command__mlBaud;
+  Command__mulBaudStart = millis();
+  
+  Command__SetBaud(xlBaud);
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__BaudOk
+*
+*    /purpose    Confirm a new baud rate. Fails if no change is pending.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__BaudOk(String znArg)
+{
+  
+  if (Command__mlFallbackBaud == 0)
+  {
+    Command_Reply(false);
+    return;
+  }
+  
+  // Keep the new rate
+  
+  Command__mlFallbackBaud = 0;
+  
+  Command_Reply(true);
+}
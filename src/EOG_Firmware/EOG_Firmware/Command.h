@@ -32,4 +32,26 @@ typedef struct Command_s
 void Command_Initialize(long zwBaud);
 void Command_AddCmd(String znName, Command_Function_t zpvCallback);
 
+// Processing Functions
+
+void Command_Process();
+
+// Argument Functions
+
+int Command_ArgCount(const String &znArgs);
+boolean Command_ArgString(const String &znArgs, int zwIndex, 
+                          String *zpnValue);
+boolean Command_ArgLong(const String &znArgs, int zwIndex, long *zplValue);
+boolean Command_ArgFloat(const String &znArgs, int zwIndex, float *zpfValue);
+
+// Output Functions
+
+void Command_Reply(boolean zbOk);
+void Command_SendFrame(byte zucType, const byte *zpucData, byte zucLen);
+void Command_BeginFrame(byte zucType, byte zucLen);
+void Command_FrameData(const byte *zpucData, byte zucLen);
+void Command_EndFrame();
+unsigned int Command_NextSeq();
+boolean Command_IsSequenced();
+
 #endif    // !defined _COMMAND_H
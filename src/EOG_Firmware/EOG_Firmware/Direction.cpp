@@ -12,6 +12,7 @@
 *
 *    /log     2/23/15  gcg - Initial release.
 *             3/17/15  gcg - Added Calibration commands.
+*             10/19/26  agt - Added detectors, filtering and events.
 *
 ******************************************************************************/
 
@@ -24,40 +25,323 @@
 // Local Modules
 
 #include "Analog.h"
+#include "Artifact.h"
 #include "Command.h"
 #include "Direction.h"
+#include "Ema.h"
+#include "Calibrate.h"
+#include "Param.h"
+#include "Record.h"
+#include "Template.h"
 
 // ***** Local Definitions ****************************************************
 
-// DEBUG - For now, all detection thresholds are constant values, in Volts
+// Default detection thresholds, in Volts. Used to seed auto-calibration.
 
 #define DELTA_UP     0.0706f //0.068f
 #define DELTA_DOWN   0.0706f //0.075f
 #define DELTA_RIGHT  0.1f
 #define DELTA_LEFT   0.1f
 
-#define HORIZONTAL   ANALOG_CH5
-#define VERTICAL     ANALOG_CH4
+// Channel assignments. The defines are the defaults, the channels can be
+// changed at runtime.
+
+#define HORIZONTAL_DEFAULT   ANALOG_CH5
+#define VERTICAL_DEFAULT     ANALOG_CH4
+
+#define HORIZONTAL   ((Analog_Channel_t)Direction__mwHorizontal)
+#define VERTICAL     ((Analog_Channel_t)Direction__mwVertical)
 
 #define DEBUG        0
 
 #define THRESHOLD_SCALEDOWN   0.8f
 
+// Calibration capture settings. Each capture window is sampled at close to
+// the full conversion rate and reduced to a median. Captures with an
+// inter-quartile spread above the limit (in Volts) are rejected.
+
+#define CAPTURE_SETTLE_MS     5000
+#define CAPTURE_SAMPLES       256
+#define CAPTURE_INTERVAL_US   2000
+#define CAPTURE_MAX_SPREAD    0.02f
+
+// The derivative noise of a capture is measured between samples one update
+// period apart, up to CAPTURE_NOISE_LAG intervals. Longer periods scale it
+// by the ratio of the periods.
+
+#define CAPTURE_NOISE_LAG     32
+
+// Streaming estimate of the quartiles of a capture, with the P-squared
+// method of Jain and Chlamtac. Five markers track the minimum, the
+// quartiles and the maximum, so no samples are kept. Heights are in
+// counts, positions count from 0.
+
+#define QUANTILE_MARKERS      5
+
+typedef struct Direction_Quantile_s
+{
+  float          safHeight[QUANTILE_MARKERS];
+  int            sawPos[QUANTILE_MARKERS];
+  int            swCount;
+} Direction_Quantile_t;
+
+// Velocity detector settings. Velocities are in counts per sample, Q8 fixed
+// point, low-pass filtered with a 1/2^VELOCITY_SHIFT weight. The limit is
+// VELOCITY_K times the calibrated derivative noise, scaled to the update
+// period, but never below the minimum.
+
+#define VELOCITY_SHIFT        1
+#define VELOCITY_K            6.0f
+#define VELOCITY_MIN_LIMIT    (40L << 8)
+
+// Kalman filter settings. The process noise is the acceleration standard
+// deviation, as a fraction of the smallest saccade amplitude on the axis. The
+// measurement noise comes from the idle calibration, or the default (counts)
+// without one. Innovations beyond the gate (standard deviations) restart the
+// filter at the reading. With misses allowed, they are first held back as
+// spikes for that many samples, which delays every saccade as long.
+
+#define KF_ACCEL              0.25f
+#define KF_DEFAULT_SIGMA      4.0f
+#define KF_GATE               4.0f
+#define KF_MAX_MISSES         0
+#define KF_TUNE_ITERATIONS    64
+
+// Kalman filter for one axis. Position and velocity are Q8 counts (per 
+// sample), the steady state gains are Q15, at most 1.
+
+typedef struct Direction_Kalman_s
+{
+  signed long    slPos;
+  signed long    slVel;
+  signed long    slK1;
+  signed long    slK2;
+  signed long    slGate;
+  int            swMisses;
+} Direction_Kalman_t;
+
+// Diagonal detection. A detection whose weight vector is within half the 
+// sector (degrees) of 45 degrees is reported as a diagonal.
+
+#define DIAGONAL_SECTOR       30.0f
+
+// Event debouncing. A detection needs a weight of 1 plus the enter band,
+// and returns to idle below the threshold less the exit band (fractions of
+// the threshold). A change of state must hold for the dwell count of
+// samples before it is reported. After a return to idle, no new direction
+// is reported for the refractory count of samples.
+
+#define HYST_ENTER            0.0f
+#define HYST_EXIT             0.2f
+#define DWELL_SAMPLES         1
+#define REFRACTORY_SAMPLES    2
+
+// A weight past this is taken as a spike and ignored, unless the artifact
+// filter is on and already removes spikes from the readings
+
+#define WEIGHT_SPIKE          2.5f
+
+// Event formats. The plain format sends the direction string on every
+// update. The extended formats send only changes of state, with the weight,
+// the peak delta, the sample time and a sequence number.
+
+#define EVENT_PLAIN           0
+#define EVENT_ASCII           1
+#define EVENT_BINARY          2
+
+#define EVENT_FRAME_TYPE      'E'
+
+// Crosstalk compensation. The leak of a calibrated direction is the
+// deflection of the other axis per unit deflection of its own. Leaks larger
+// than the limit are taken as a bad capture and ignored. The unmixing matrix
+// is fixed point with XTALK_SHIFT fraction bits.
+
+#define XTALK_MAX_LEAK        0.5f
+#define XTALK_SHIFT           12
+
+// Candidate state meaning no change is pending
+
+#define DIRECTION_NO_CANDIDATE   DIRECTION_MAX
+
+// Detection strategy. Each is run on every sample once the channels are
+// updated, and moves the direction state with Direction__Request or
+// Direction__SetState. The reset, if any, is run when the channels restart,
+// which includes selecting the strategy. Strategies that track the peak of a
+// detection let the thresholds adapt to it.
+
+typedef struct Direction_Detector_s
+{
+  const char *   spcName;
+  void           (*spvReset)();
+  void           (*spvDetect)();
+  boolean        sbAdapt;
+} Direction_Detector_t;
+
+// Auto-calibration settings. Excursions of the running delta smaller than
+// the minimum peak (Volts) are treated as noise and let the rest level
+// follow drift. Each finished excursion updates a two-centre (noise and
+// saccade) k-means per direction at the given learning rate.
+
+#define AUTO_MIN_PEAK         0.01f
+#define AUTO_REST_RATE        0.01f
+#define AUTO_LEARN_RATE       0.0625f
+#define AUTO_MIN_SACCADES     8
+
+// Threshold adaptation settings. Each confirmed detection moves that
+// direction's threshold toward the scaled peak of the detection at the given
+// rate, but never further than the drift limit (a fraction) from the
+// calibrated value.
+
+#define ADAPT_RATE            0.05f
+#define ADAPT_LIMIT           0.4f
+
+// Auto-calibration excursion tracker for one axis
+
+typedef struct Direction_Excursion_s
+{
+  float       sfRest;
+  float       sfPeak;
+  boolean     sbArmed;
+} Direction_Excursion_t;
+
+// Auto-calibration clusters for one direction
+
+typedef struct Direction_Cluster_s
+{
+  float         sfLow;
+  float         sfHigh;
+  unsigned int  suwCount;
+} Direction_Cluster_t;
+
 // Serial Direction characters
 
 static String Direction__manSerialChars[DIRECTION_MAX];
 
 // ***** Local Variables ******************************************************
 
+// Tunable values, registered with the Param module. Initialized to the
+// defines above.
+
+static int Direction__mwHorizontal = HORIZONTAL_DEFAULT;
+static int Direction__mwVertical = VERTICAL_DEFAULT;
+
+static float Direction__mfScaleDown = THRESHOLD_SCALEDOWN;
+static float Direction__mfMaxSpread = CAPTURE_MAX_SPREAD;
+static float Direction__mfAdaptRate = ADAPT_RATE;
+static float Direction__mfAdaptLimit = ADAPT_LIMIT;
+static float Direction__mfVelocityK = VELOCITY_K;
+static int Direction__mwDetector = 0;
+static boolean Direction__mbKalman = false;
+static float Direction__mfKalmanAccel = KF_ACCEL;
+static float Direction__mfKalmanGate = KF_GATE;
+static int Direction__mwKalmanMisses = KF_MAX_MISSES;
+static boolean Direction__mbDiagonal = false;
+static float Direction__mfDiagonalSector = DIAGONAL_SECTOR;
+static float Direction__mfHystEnter = HYST_ENTER;
+static float Direction__mfHystExit = HYST_EXIT;
+static int Direction__mwDwell = DWELL_SAMPLES;
+static int Direction__mwRefractory = REFRACTORY_SAMPLES;
+
+static float Direction__mafDefault[DIRECTION_NUM_CARDINAL] = 
+                        {0.0f, DELTA_UP, DELTA_DOWN, DELTA_LEFT, DELTA_RIGHT};
+
 // Detection thresholds
 
-static float Direction__mafThreshold[DIRECTION_MAX];
+static float Direction__mafThreshold[DIRECTION_NUM_CARDINAL];
+
+// Calibrated thresholds - the reference that adaptation is bounded by and
+// rolls back to.
+
+static float Direction__mafCalThreshold[DIRECTION_NUM_CARDINAL];
+
+// Return to idle thresholds for each axis. An axis that is not part of the 
+// detected direction has a threshold of 0 and is not checked.
+
+static float Direction__mafExit[DIRECTION_NUM_AXES];
+
+// Vertical and horizontal components of each direction
+
+static const Direction_t Direction__maeVertical[DIRECTION_MAX] = 
+{
+  DIRECTION_NONE, DIRECTION_UP, DIRECTION_DOWN, DIRECTION_NONE, 
+  DIRECTION_NONE, DIRECTION_UP, DIRECTION_UP, DIRECTION_DOWN, DIRECTION_DOWN
+};
+
+static const Direction_t Direction__maeHorizontal[DIRECTION_MAX] = 
+{
+  DIRECTION_NONE, DIRECTION_NONE, DIRECTION_NONE, DIRECTION_LEFT, 
+  DIRECTION_RIGHT, DIRECTION_LEFT, DIRECTION_RIGHT, DIRECTION_LEFT, 
+  DIRECTION_RIGHT
+};
+
+// Threshold adaptation state. The peak is the largest delta seen on the
+// detected channel since the detection.
+
+static boolean Direction__mbAdapt;
+static float Direction__mfPeakDelta;
+
+// Velocity detector state. The noise is the mean absolute difference of
+// samples one noise period (ms) apart, measured during the idle calibration,
+// Q8 counts, and the scale takes it to the update period. The onset is the
+// movement last confirmed, held until both channels are back under their
+// limits, DIRECTION_NONE when there is none. The target is the state change
+// it asks for while it is held.
+
+static signed long Direction__mlUpDownNoise;
+static signed long Direction__mlLeftRightNoise;
+static int Direction__mwNoisePeriod;
+static float Direction__mfNoiseScale = 1.0f;
+static Direction_t Direction__meOnset;
+static Direction_t Direction__meVelocityTarget;
+
+// Update period, in ms
+
+static int Direction__mwPeriod;
+
+// The detection strategy running, an index into Direction__masDetectors.
+// Direction__mwDetector is the one asked for.
+
+static int Direction__mwActiveDetector = 0;
+
+// Template detector state - the class matched on the last sample, whether
+// that match has moved the direction state yet, so a match only counts
+// once, and whether the template window was updated on the last sample
+
+#if DIRECTION_DETECT_TEMPLATE
+static Template_Class_t Direction__meTemplateMatch = TEMPLATE_NONE;
+static boolean Direction__mbTemplateUsed;
+static boolean Direction__mbTemplateLive;
+#endif
+
+// Kalman filter state. The filters are retuned whenever the calibration or
+// the tuning values change.
+
+static Direction_Kalman_t Direction__masKalman[DIRECTION_NUM_AXES];
+static boolean Direction__mbKalmanStale;
+static float Direction__mfKalmanTunedAccel;
+static float Direction__mfKalmanTunedGate;
 
 // Resting Voltaages for both channels
 
 static float Direction__mfUpDownResting;
 static float Direction__mfLeftRightResting;
 
+// Calibrated spans - the full differential between each direction and the
+// resting voltage, before scaling down to a threshold.
+
+static float Direction__mafSpan[DIRECTION_NUM_CARDINAL];
+
+// Crosstalk compensation - the leak measured for each direction, and the
+// matrix that undoes it, [corrected axis][read axis], applied to each sample
+// around the resting counts
+
+static boolean Direction__mbCrosstalk = true;
+static float Direction__mafLeak[DIRECTION_NUM_CARDINAL];
+static signed long 
+   Direction__maalUnmix[DIRECTION_NUM_AXES][DIRECTION_NUM_AXES] = 
+                            {{1L << XTALK_SHIFT, 0}, {0, 1L << XTALK_SHIFT}};
+static signed long Direction__malRestCounts[DIRECTION_NUM_AXES];
+
 // Channel structures - store currently detected and previous voltage by 
 // channel.
 
@@ -69,17 +353,111 @@ static Direction_Channel_t Direction__msLeftRight;
 
 static Direction_t Direction__meState;
 
+// Debouncing state - the pending change of state and how many samples it
+// has held, and the samples left before a new direction may be reported
+
+static Direction_t Direction__meCandidate;
+static int Direction__mwCandidateCount;
+static boolean Direction__mbRequested;
+static int Direction__mwRefractoryCount;
+
+// Event reporting - the format, the weight of the latest detection and the
+// time of the latest sample (ms)
+
+static int Direction__mwEventFormat = EVENT_PLAIN;
+static float Direction__mfWeight;
+static unsigned long Direction__mulSampleTime;
+
+// Auto-calibration state
+
+static boolean Direction__mbAutoCal;
+static Direction_Excursion_t Direction__msUpDownExcursion;
+static Direction_Excursion_t Direction__msLeftRightExcursion;
+static Direction_Cluster_t Direction__masCluster[DIRECTION_NUM_CARDINAL];
+
 // ***** Local Funtions *******************************************************
 
 // Weight functions. A value greater than 1 indicaties a detection.
 
+#if DIRECTION_DETECT_AMPLITUDE
 static float Direction__WeightUpDown();
 static float Direction__WeightLeftRight();
+#endif
 
 // Update direction state. Saves of the delta required to drop back to
 // idle.
 
 static void Direction__SetState(Direction_t zeDir);
+static void Direction__Request(Direction_t zeDir);
+
+// Channel helpers
+
+static void Direction__ResetChannels();
+static void Direction__Unmix(signed long *zplUpDown, signed long *zplLeftRight);
+static void Direction__UpdateUnmix();
+static void Direction__UpdateVelocity(Direction_Channel_t *zpsChannel,
+                                      signed long zlCounts);
+static void Direction__UpdateNoiseScale();
+
+// Kalman filter
+
+static void Direction__KalmanRetune();
+static void Direction__KalmanTune(Direction_Kalman_t *zpsFilter, 
+                                  signed long zlNoise, float zfAmplitude);
+static float Direction__Amplitude(Direction_t zeDir);
+static signed long Direction__KalmanUpdate(Direction_Kalman_t *zpsFilter,
+                                           signed long zlCounts);
+static signed long Direction__KalmanGain(signed long zlGain,
+                                         signed long zlInnovation);
+
+// Detectors
+
+static void Direction__SelectDetector(int zwDetector);
+
+#if DIRECTION_DETECT_AMPLITUDE
+static void Direction__DetectAmplitude();
+static void Direction__Classify2D(float zfUpDownWeight, 
+                                  float zfLeftRightWeight);
+#endif
+
+#if DIRECTION_DETECT_VELOCITY
+static void Direction__DetectVelocity();
+#endif
+
+#if DIRECTION_DETECT_TEMPLATE
+static void Direction__ResetTemplate();
+static void Direction__DetectTemplate();
+#endif
+
+#if DIRECTION_DETECT_EMA
+static void Direction__ResetEma();
+static void Direction__DetectEma();
+#endif
+
+// Calibration helpers
+
+static boolean Direction__Capture(Analog_Channel_t zeChannel, 
+                                  float *zpfVoltage, signed long *zplNoise);
+static int Direction__NoiseLag();
+static void Direction__QuantileAdd(Direction_Quantile_t *zpsQuantile,
+                                   float zfValue);
+static void Direction__CalibrateThreshold(Direction_t zeDir, 
+                                          Analog_Channel_t zeChannel,
+                                          float zfResting,
+                                          Analog_Channel_t zeCross,
+                                          float zfCrossResting);
+
+// Auto-calibration
+
+static void Direction__AutoSeed();
+static void Direction__AutoTrack(Direction_Channel_t *zpsChannel,
+                                 Direction_Excursion_t *zpsExcursion,
+                                 Direction_t zePos, Direction_t zeNeg);
+static void Direction__AutoLearn(Direction_t zeDir, float zfPeak);
+
+// Threshold adaptation
+
+static void Direction__Adapt(Direction_t zeDir, float zfPeak);
 
 // Commands
 
@@ -89,6 +467,33 @@ static void Cmd__Down(String znArg);
 static void Cmd__Left(String znArg);
 static void Cmd__Right(String znArg);
 static void Cmd__Clear(String znArg);
+static void Cmd__Auto(String znArg);
+static void Cmd__Adapt(String znArg);
+static void Cmd__Rollback(String znArg);
+static void Cmd__Event(String znArg);
+static void Cmd__Leak(String znArg);
+static void Cmd__Detector(String znArg);
+
+// Detection strategies in the build, in the order of the detector param
+
+static const Direction_Detector_t Direction__masDetectors[] = 
+{
+#if DIRECTION_DETECT_AMPLITUDE
+  {"amp", NULL, Direction__DetectAmplitude, true},
+#endif
+#if DIRECTION_DETECT_VELOCITY
+  {"vel", NULL, Direction__DetectVelocity, false},
+#endif
+#if DIRECTION_DETECT_TEMPLATE
+  {"tpl", Direction__ResetTemplate, Direction__DetectTemplate, false},
+#endif
+#if DIRECTION_DETECT_EMA
+  {"ema", Direction__ResetEma, Direction__DetectEma, false},
+#endif
+};
+
+#define DIRECTION_NUM_DETECTORS   \
+  ((int)(sizeof(Direction__masDetectors) / sizeof(Direction_Detector_t)))
 
 // ***** Function Definitions *************************************************
 
@@ -121,21 +526,62 @@ void Direction_Initialize ()
   Direction__manSerialChars[DIRECTION_DOWN] = "d";
   Direction__manSerialChars[DIRECTION_LEFT] = "l";
   Direction__manSerialChars[DIRECTION_RIGHT] = "r";
+  Direction__manSerialChars[DIRECTION_UP_LEFT] = "ul";
+  Direction__manSerialChars[DIRECTION_UP_RIGHT] = "ur";
+  Direction__manSerialChars[DIRECTION_DOWN_LEFT] = "dl";
+  Direction__manSerialChars[DIRECTION_DOWN_RIGHT] = "dr";
   
   // The initial mode should always be looking straight ahead. Set both 
   // channels and direction state accordingly.
   
-  Analog_Update();
-  
-  Direction__msUpDown.sfCurrVoltage = Analog_ReadVolts(VERTICAL);
-  Direction__msUpDown.sfPrevVoltage = Analog_ReadVolts(VERTICAL);
-  Direction__msUpDown.sfDeltaVoltage = 0;
-  
-  Direction__msLeftRight.sfCurrVoltage = Analog_ReadVolts(HORIZONTAL);
-  Direction__msLeftRight.sfPrevVoltage = Analog_ReadVolts(HORIZONTAL);
-  Direction__msLeftRight.sfDeltaVoltage = 0;
-  
-  Direction__meState = DIRECTION_NONE;
+  Direction__ResetChannels();
+  
+  // Register tunable values
+  
+  Param_Add("ch_h", PARAM_INT, &Direction__mwHorizontal, 
+            0, ANALOG_NUM_CHANNELS - 1);
+  Param_Add("ch_v", PARAM_INT, &Direction__mwVertical, 
+            0, ANALOG_NUM_CHANNELS - 1);
+  Param_Add("scale", PARAM_FLOAT, &Direction__mfScaleDown, 0.1f, 1.0f);
+  Param_Add("spread", PARAM_FLOAT, &Direction__mfMaxSpread, 0.0f, 1.0f);
+  Param_Add("delta_u", PARAM_FLOAT, &Direction__mafDefault[DIRECTION_UP], 
+            0.0f, 5.0f);
+  Param_Add("delta_d", PARAM_FLOAT, &Direction__mafDefault[DIRECTION_DOWN], 
+            0.0f, 5.0f);
+  Param_Add("delta_l", PARAM_FLOAT, &Direction__mafDefault[DIRECTION_LEFT], 
+            0.0f, 5.0f);
+  Param_Add("delta_r", PARAM_FLOAT, &Direction__mafDefault[DIRECTION_RIGHT], 
+            0.0f, 5.0f);
+  Param_Add("adapt_rate", PARAM_FLOAT, &Direction__mfAdaptRate, 0.0f, 1.0f);
+  Param_Add("adapt_limit", PARAM_FLOAT, &Direction__mfAdaptLimit, 0.0f, 1.0f);
+  Param_Add("vel_k", PARAM_FLOAT, &Direction__mfVelocityK, 1.0f, 100.0f);
+  Param_Add("detector", PARAM_INT, &Direction__mwDetector, 
+            0, DIRECTION_NUM_DETECTORS - 1);
+  Param_Add("kf", PARAM_BOOL, &Direction__mbKalman, 0, 1);
+  Param_Add("kf_accel", PARAM_FLOAT, &Direction__mfKalmanAccel, 0.001f, 10.0f);
+  Param_Add("kf_gate", PARAM_FLOAT, &Direction__mfKalmanGate, 1.0f, 100.0f);
+  Param_Add("kf_misses", PARAM_INT, &Direction__mwKalmanMisses, 0, 100);
+  Param_Add("diag", PARAM_BOOL, &Direction__mbDiagonal, 0, 1);
+  Param_Add("diag_sector", PARAM_FLOAT, &Direction__mfDiagonalSector, 
+            0.0f, 90.0f);
+  Param_Add("hyst_in", PARAM_FLOAT, &Direction__mfHystEnter, 0.0f, 1.0f);
+  Param_Add("hyst_out", PARAM_FLOAT, &Direction__mfHystExit, 0.0f, 0.9f);
+  Param_Add("dwell", PARAM_INT, &Direction__mwDwell, 1, 50);
+  Param_Add("refractory", PARAM_INT, &Direction__mwRefractory, 0, 500);
+  Param_Add("xtalk", PARAM_BOOL, &Direction__mbCrosstalk, 0, 1);
+  
+  // Auto-calibration is off until requested
+  
+  Direction__mbAutoCal = false;
+  
+  // Track drift by default, the drift limits keep this safe
+  
+  Direction__mbAdapt = true;
+  Direction__mfPeakDelta = 0;
+  
+  // Tune the filters on first use
+  
+  Direction__mbKalmanStale = true;
   
   // Add Direction Commands
   
@@ -145,395 +591,2306 @@ void Direction_Initialize ()
   Command_AddCmd("l", Cmd__Left);
   Command_AddCmd("r", Cmd__Right);
   Command_AddCmd("clr", Cmd__Clear);
+  Command_AddCmd("auto", Cmd__Auto);
+  Command_AddCmd("adapt", Cmd__Adapt);
+  Command_AddCmd("rollback", Cmd__Rollback);
+  Command_AddCmd("evt", Cmd__Event);
+  Command_AddCmd("leak", Cmd__Leak);
+  Command_AddCmd("det", Cmd__Detector);
 }
 
 /******************************************************************************
 *
 *    /name       Direction_Update
 *
-*    /purpose    The direction update function behaves differently depending
-*                on the direction state. If no direction is detected, it
-*                checks both channels for a possible detection. In the event
-*                of a direction detection on BOTH channels, it weights the
-*                differentials and selects the "heaviest" detection.
-*
-*                If a direction is currently detected, the update funtion only
-*                cares about detecting a return to idle for that channel.
+*    /purpose    Reads the latest samples into the channel structures and
+*                runs the selected detector on them.
 *
 *    /ret        void
 *
 ******************************************************************************/
 void Direction_Update()
 {
+  signed long xlUpDown, xlLeftRight;
+  signed long xlRawUpDown, xlRawLeftRight;
   
   // First update the analog readings
   
   Analog_Update();
   
+  Direction__mulSampleTime = millis();
+  
+  xlRawUpDown = Analog_ReadCounts(VERTICAL);
+  xlRawLeftRight = Analog_ReadCounts(HORIZONTAL);
+  
+  // Keep the raw readings in the flight recorder
+  
+  Record_Sample(xlRawUpDown, xlRawLeftRight, Direction__mulSampleTime);
+  
+  // Remove spikes and saturated readings before anything sees them. A
+  // replaced reading is an anomaly for the recorder.
+  
+  xlUpDown = Artifact_Filter(VERTICAL, xlRawUpDown);
+  xlLeftRight = Artifact_Filter(HORIZONTAL, xlRawLeftRight);
+  
+  if ((xlUpDown != xlRawUpDown) || (xlLeftRight != xlRawLeftRight))
+  {
+    Record_Trigger(RECORD_ARTIFACT);
+  }
+  
+  // Separate the axes
+  
+  Direction__Unmix(&xlUpDown, &xlLeftRight);
+  
+  // Filter the readings, if enabled. The estimates replace the readings
+  // from here on.
+  
+  if (Direction__mbKalman)
+  {
+    
+    // Retune after any calibration or tuning change
+    
+    if (Direction__mbKalmanStale ||
+        (Direction__mfKalmanTunedAccel != Direction__mfKalmanAccel) ||
+        (Direction__mfKalmanTunedGate != Direction__mfKalmanGate))
+    {
+      Direction__KalmanRetune();
+    }
+    
+    xlUpDown = 
+      Direction__KalmanUpdate(&Direction__masKalman[DIRECTION_AXIS_UPDOWN],
+                              xlUpDown);
+    xlLeftRight = 
+      Direction__KalmanUpdate(&Direction__masKalman[DIRECTION_AXIS_LEFTRIGHT],
+                              xlLeftRight);
+  }
+  
   // Update channel structures
   
   Direction__msUpDown.sfPrevVoltage = Direction__msUpDown.sfCurrVoltage;
-  Direction__msUpDown.sfCurrVoltage = Analog_ReadVolts(VERTICAL);
+  Direction__msUpDown.sfCurrVoltage = Analog_CountsToVolts(xlUpDown);
   Direction__msUpDown.sfDeltaVoltage += (Direction__msUpDown.sfCurrVoltage - 
                                          Direction__msUpDown.sfPrevVoltage);
   
   Direction__msLeftRight.sfPrevVoltage = Direction__msLeftRight.sfCurrVoltage;
-  Direction__msLeftRight.sfCurrVoltage = Analog_ReadVolts(HORIZONTAL);
+  Direction__msLeftRight.sfCurrVoltage = Analog_CountsToVolts(xlLeftRight);
   Direction__msLeftRight.sfDeltaVoltage += 
   (Direction__msLeftRight.sfCurrVoltage - Direction__msLeftRight.sfPrevVoltage);    
   
-  // Behave according to current Direction state
+  // Update the filtered velocities, and the template window when the
+  // template detector or a recording uses it. A window that was not kept up
+  // to date starts again.
   
-  switch (Direction__meState)
+#if DIRECTION_DETECT_TEMPLATE
+  if ((Direction__masDetectors[Direction__mwActiveDetector].spvDetect == 
+       Direction__DetectTemplate) || Template_IsRecording())
   {
-    
-    // If no direction is detected, attempt to identify one
-    
-    case DIRECTION_NONE:
+    if (!Direction__mbTemplateLive)
     {
-       float xfUpDownWeight, xfLeftRightWeight;
-       
-       // Check UP-DOWN
-       
-       xfUpDownWeight = Direction__WeightUpDown();
-       
-       // Check LEFT-RIGHT
-       
-       xfLeftRightWeight = Direction__WeightLeftRight();
-       
-     #if DEBUG  
-         Serial.print("VERTICAL: ");
-         Serial.print(Direction__msUpDown.sfDeltaVoltage, 4);
-  
-         Serial.print("    HORIZONTAL: ");
-         Serial.print(Direction__msLeftRight.sfDeltaVoltage, 4);
-  
-         Serial.print("\r\n");  
-     #endif
-     
-       // Decide which, if any, direction to assign
-       
-       if ((abs(xfUpDownWeight) < 1.0) && 
-           (abs(xfLeftRightWeight) < 1.0))
-       {
-         
-         // No direction detected
-         
-         Direction__SetState(DIRECTION_NONE);
-         
-         break;
-       }
-       
-       else if (abs(xfUpDownWeight) > abs(xfLeftRightWeight))
-       {
-         
-         // UP-DOWN detected. A negative weight is a DOWN,
-         // a positive weight is an UP.
-         if (xfUpDownWeight < 0.0)
-         {
-           Direction__SetState(DIRECTION_DOWN);
-         }
-         else
-         {
-           Direction__SetState(DIRECTION_UP);
-         }
-       }
-       
-       else
-       {
-         
-         // LEFT-RIGHT detected. A negative weight is a LEFT,
-         // a positive weight is a RIGHT.
-         
-         if (xfLeftRightWeight < 0.0)
-         {
-           Direction__SetState(DIRECTION_LEFT);
-         }
-         else
-         {
-           Direction__SetState(DIRECTION_RIGHT);
-         }
-       }
-      
-       break; 
+      Template_Restart();
     }
     
-    // If UP was read, check for a drop back to idle.
-    // If DOWN was read, check for a rise back to idle.
+    Direction__mbTemplateLive = true;
     
-    case DIRECTION_UP:
-    case DIRECTION_DOWN:
-    {
-       float xfDelta;
-       
-       // Determine delta
-       
-       xfDelta = abs(Direction__msUpDown.sfDeltaVoltage);
-                     
-       #if DEBUG 
-         Serial.print("VERTICAL: ");
-         Serial.print(Direction__msUpDown.sfDeltaVoltage, 4);
-         
-         Serial.print("     THRESHOLD: ");
-         Serial.print(Direction__mafThreshold[DIRECTION_NONE], 4);
+    Template_Update(xlUpDown, xlLeftRight);
+  }
+  else
+  {
+    Direction__mbTemplateLive = false;
+  }
+#endif
   
-         Serial.print("\r\n");  
-       #endif
-                     
-       // Check against threshold
-       
-       if (xfDelta < Direction__mafThreshold[DIRECTION_NONE])
-       {
-          
-         // Threshold exceeded
-         
-         Direction__SetState(DIRECTION_NONE);
-       }
-       
-       break; 
-    }
-    
-    // If LEFT was read, check for a rise back to idle.
-    // If RIGHT was read, check for a drop back to idle. 
-    
-    case DIRECTION_LEFT:
-    case DIRECTION_RIGHT:
-    {
-       float xfDelta;
-       
-       // Determine delta
-       
-       xfDelta = abs(Direction__msLeftRight.sfDeltaVoltage);
-                     
-       #if DEBUG  
-         Serial.print("HORIZONTAL: ");
-         Serial.print(Direction__msLeftRight.sfDeltaVoltage, 4);
-         
-         Serial.print("     THRESHOLD: ");
-         Serial.print(Direction__mafThreshold[DIRECTION_NONE], 4);
+  Direction__UpdateVelocity(&Direction__msUpDown, xlUpDown);
+  Direction__UpdateVelocity(&Direction__msLeftRight, xlLeftRight);
   
-         Serial.print("\r\n");  
-       #endif
-                     
-       // Check against threshold
-       
-       if (xfDelta < Direction__mafThreshold[DIRECTION_NONE])
-       {
-          
-         // Threshold exceeded
-         
-         
-         Direction__SetState(DIRECTION_NONE);
-       }
-       
-       break; 
-    }
+  // Learn the thresholds from normal use, if enabled
+  
+  if (Direction__mbAutoCal)
+  {
+    Direction__AutoTrack(&Direction__msUpDown, &Direction__msUpDownExcursion,
+                         DIRECTION_UP, DIRECTION_DOWN);
+    Direction__AutoTrack(&Direction__msLeftRight, 
+                         &Direction__msLeftRightExcursion,
+                         DIRECTION_RIGHT, DIRECTION_LEFT);
+  }
+  
+  // Count down the refractory period
+  
+  if (Direction__mwRefractoryCount > 0)
+  {
+    Direction__mwRefractoryCount--;
+  }
+  
+  // Run the selected detector, restarting from idle if it was just changed
+  
+  if (Direction__mwDetector != Direction__mwActiveDetector)
+  {
+    Direction__SelectDetector(Direction__mwDetector);
+  }
+  
+  Direction__mbRequested = false;
+  
+  Direction__masDetectors[Direction__mwActiveDetector].spvDetect();
+  
+  // A pending change has to be seen on consecutive samples
+  
+  if (!Direction__mbRequested)
+  {
+    Direction__meCandidate = DIRECTION_NO_CANDIDATE;
+    Direction__mwCandidateCount = 0;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Direction__ResetChannels
+*
+*    /purpose    Takes a fresh reading and restarts both channels from it,
+*                with no accumulated delta or velocity. The direction state
+*                goes back to idle.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__ResetChannels()
+{
+  signed long xlUpDown, xlLeftRight;
+  
+  // Take a fresh reading, with the axes separated as in Direction_Update
+  
+  Analog_Update();
+  
+  xlUpDown = Analog_ReadCounts(VERTICAL);
+  xlLeftRight = Analog_ReadCounts(HORIZONTAL);
+  
+  Direction__Unmix(&xlUpDown, &xlLeftRight);
+  
+  Direction__msUpDown.sfCurrVoltage = Analog_CountsToVolts(xlUpDown);
+  Direction__msUpDown.sfPrevVoltage = Direction__msUpDown.sfCurrVoltage;
+  Direction__msUpDown.sfDeltaVoltage = 0;
+  Direction__msUpDown.slCurrCounts = xlUpDown;
+  Direction__msUpDown.slVelocity = 0;
+  
+  Direction__msLeftRight.sfCurrVoltage = Analog_CountsToVolts(xlLeftRight);
+  Direction__msLeftRight.sfPrevVoltage = Direction__msLeftRight.sfCurrVoltage;
+  Direction__msLeftRight.sfDeltaVoltage = 0;
+  Direction__msLeftRight.slCurrCounts = xlLeftRight;
+  Direction__msLeftRight.slVelocity = 0;
+  
+  // Restart the filters at the reading
+  
+  Direction__masKalman[DIRECTION_AXIS_UPDOWN].slPos = 
+                            Direction__msUpDown.slCurrCounts << 8;
+  Direction__masKalman[DIRECTION_AXIS_UPDOWN].slVel = 0;
+  Direction__masKalman[DIRECTION_AXIS_UPDOWN].swMisses = 0;
+  
+  Direction__masKalman[DIRECTION_AXIS_LEFTRIGHT].slPos = 
+                            Direction__msLeftRight.slCurrCounts << 8;
+  Direction__masKalman[DIRECTION_AXIS_LEFTRIGHT].slVel = 0;
+  Direction__masKalman[DIRECTION_AXIS_LEFTRIGHT].swMisses = 0;
+  
+  Direction__meState = DIRECTION_NONE;
+  Direction__meOnset = DIRECTION_NONE;
+  Direction__meCandidate = DIRECTION_NO_CANDIDATE;
+  Direction__mwCandidateCount = 0;
+  Direction__mwRefractoryCount = 0;
+  
+  // Restart the detector
+  
+  if (Direction__masDetectors[Direction__mwActiveDetector].spvReset != NULL)
+  {
+    Direction__masDetectors[Direction__mwActiveDetector].spvReset();
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Direction__SelectDetector
+*
+*    /purpose    Switches to a detection strategy. The channels restart, so
+*                the new strategy starts from idle with fresh readings.
+*
+*    /param[in]  zwDetector    Index into Direction__masDetectors
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__SelectDetector(int zwDetector)
+{
+  Direction__mwDetector = zwDetector;
+  Direction__mwActiveDetector = zwDetector;
+  
+  Direction__ResetChannels();
+}
+
+/******************************************************************************
+*
+*    /name       Direction__Unmix
+*
+*    /purpose    Removes the crosstalk between the axes from a pair of 
+*                readings. The deviations from rest are multiplied by the
+*                unmixing matrix, so the resting level is left as read.
+*
+*    /param[io]  zplUpDown       Vertical reading, counts
+*    /param[io]  zplLeftRight    Horizontal reading, counts
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__Unmix(signed long *zplUpDown, signed long *zplLeftRight)
+{
+  signed long xlUpDown, xlLeftRight;
+  
+  if (!Direction__mbCrosstalk)
+  {
+    return;
+  }
+  
+  xlUpDown = *zplUpDown - Direction__malRestCounts[DIRECTION_AXIS_UPDOWN];
+  xlLeftRight = 
+           *zplLeftRight - Direction__malRestCounts[DIRECTION_AXIS_LEFTRIGHT];
+  
+  // Deviations are within 16 bits and the matrix entries within 2, so the
+  // products fit in a long
+  
+  *zplUpDown = Direction__malRestCounts[DIRECTION_AXIS_UPDOWN] + 
+    ((Direction__maalUnmix[DIRECTION_AXIS_UPDOWN][DIRECTION_AXIS_UPDOWN] * 
+      xlUpDown +
+      Direction__maalUnmix[DIRECTION_AXIS_UPDOWN][DIRECTION_AXIS_LEFTRIGHT] * 
+      xlLeftRight) >> XTALK_SHIFT);
+  
+  *zplLeftRight = Direction__malRestCounts[DIRECTION_AXIS_LEFTRIGHT] + 
+    ((Direction__maalUnmix[DIRECTION_AXIS_LEFTRIGHT][DIRECTION_AXIS_UPDOWN] * 
+      xlUpDown +
+      Direction__maalUnmix[DIRECTION_AXIS_LEFTRIGHT][DIRECTION_AXIS_LEFTRIGHT] *
+      xlLeftRight) >> XTALK_SHIFT);
+}
+
+/******************************************************************************
+*
+*    /name       Direction__UpdateUnmix
+*
+*    /purpose    Rebuilds the unmixing matrix from the measured leaks and the
+*                resting voltages. Each axis leaks into the other by the mean
+*                of its two directions' leaks, giving the mixing matrix
+*                [1 Kv; Kh 1] (Kv the leak of horizontal looks into the
+*                vertical axis), whose inverse is
+*                [1 -Kv; -Kh 1] / (1 - Kv Kh).
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__UpdateUnmix()
+{
+  float xfIntoVertical = 
+    (Direction__mafLeak[DIRECTION_LEFT] + Direction__mafLeak[DIRECTION_RIGHT]);
+  float xfIntoHorizontal = 
+    (Direction__mafLeak[DIRECTION_UP] + Direction__mafLeak[DIRECTION_DOWN]);
+  float xfScale;
+  
+  // Average over the directions that were measured
+  
+  if ((Direction__mafLeak[DIRECTION_LEFT] != 0) && 
+      (Direction__mafLeak[DIRECTION_RIGHT] != 0))
+  {
+    xfIntoVertical /= 2.0f;
+  }
+  
+  if ((Direction__mafLeak[DIRECTION_UP] != 0) && 
+      (Direction__mafLeak[DIRECTION_DOWN] != 0))
+  {
+    xfIntoHorizontal /= 2.0f;
+  }
+  
+  // Invert. The leaks are limited, so the determinant is at least 0.75.
+  
+  xfScale = (float)(1L << XTALK_SHIFT) / 
+            (1.0f - xfIntoVertical * xfIntoHorizontal);
+  
+  Direction__maalUnmix[DIRECTION_AXIS_UPDOWN][DIRECTION_AXIS_UPDOWN] = 
+                                                         (signed long)xfScale;
+  Direction__maalUnmix[DIRECTION_AXIS_UPDOWN][DIRECTION_AXIS_LEFTRIGHT] = 
+                                      (signed long)(-xfIntoVertical * xfScale);
+  Direction__maalUnmix[DIRECTION_AXIS_LEFTRIGHT][DIRECTION_AXIS_UPDOWN] = 
+                                    (signed long)(-xfIntoHorizontal * xfScale);
+  Direction__maalUnmix[DIRECTION_AXIS_LEFTRIGHT][DIRECTION_AXIS_LEFTRIGHT] = 
+                                                         (signed long)xfScale;
+  
+  // The matrix works around the resting levels
+  
+  Direction__malRestCounts[DIRECTION_AXIS_UPDOWN] = 
+         (signed long)(Direction__mfUpDownResting / Analog_CountsToVolts(1));
+  Direction__malRestCounts[DIRECTION_AXIS_LEFTRIGHT] = 
+         (signed long)(Direction__mfLeftRightResting / Analog_CountsToVolts(1));
+}
+
+/******************************************************************************
+*
+*    /name       Direction__UpdateVelocity
+*
+*    /purpose    Updates the filtered velocity of a channel from its latest
+*                count reading. Fixed point, no division.
+*
+*    /param[io]  zpsChannel    Channel to update
+*    /param[in]  zlCounts      Latest reading, in counts
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__UpdateVelocity(Direction_Channel_t *zpsChannel,
+                                      signed long zlCounts)
+{
+  signed long xlDerivative;
+  
+  // Sample-to-sample derivative, Q8
+  
+  xlDerivative = (zlCounts - zpsChannel->slCurrCounts) << 8;
+  zpsChannel->slCurrCounts = zlCounts;
+  
+  // Single pole low-pass
+  
+  zpsChannel->slVelocity += 
+                  (xlDerivative - zpsChannel->slVelocity) >> VELOCITY_SHIFT;
+}
+
+/******************************************************************************
+*
+*    /name       Direction__UpdateNoiseScale
+*
+*    /purpose    Works out the scale from the period the derivative noise
+*                was measured over to the update period
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__UpdateNoiseScale()
+{
+  if ((Direction__mwNoisePeriod > 0) && (Direction__mwPeriod > 0))
+  {
+    Direction__mfNoiseScale = (float)Direction__mwPeriod / 
+                              Direction__mwNoisePeriod;
+  }
+  else
+  {
+    Direction__mfNoiseScale = 1.0f;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Direction__KalmanRetune
+*
+*    /purpose    Tunes both filters from the current calibration and tuning
+*                values.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__KalmanRetune()
+{
+  
+  // Each axis is tuned for the smaller of its two saccades
+  
+  Direction__KalmanTune(&Direction__masKalman[DIRECTION_AXIS_UPDOWN],
+                        Direction__mlUpDownNoise,
+                        min(Direction__Amplitude(DIRECTION_UP),
+                            Direction__Amplitude(DIRECTION_DOWN)));
+  
+  Direction__KalmanTune(&Direction__masKalman[DIRECTION_AXIS_LEFTRIGHT],
+                        Direction__mlLeftRightNoise,
+                        min(Direction__Amplitude(DIRECTION_LEFT),
+                            Direction__Amplitude(DIRECTION_RIGHT)));
+  
+  // Remember what they were tuned with
+  
+  Direction__mbKalmanStale = false;
+  Direction__mfKalmanTunedAccel = Direction__mfKalmanAccel;
+  Direction__mfKalmanTunedGate = Direction__mfKalmanGate;
+}
+
+/******************************************************************************
+*
+*    /name       Direction__Amplitude
+*
+*    /purpose    Returns the saccade amplitude a direction's threshold was
+*                scaled down from. Uncalibrated directions use the default
+*                threshold.
+*
+*    /param[in]  zeDir    Direction
+*
+*    /ret        float    Saccade amplitude, in Volts
+*
+******************************************************************************/
+static float Direction__Amplitude(Direction_t zeDir)
+{
+  float xfThreshold = Direction__mafThreshold[zeDir];
+  
+  // Fall back to the default
+  
+  if (xfThreshold == 0)
+  {
+    xfThreshold = Direction__mafDefault[zeDir];
+  }
+  
+  return xfThreshold / Direction__mfScaleDown;
+}
+
+/******************************************************************************
+*
+*    /name       Direction__KalmanTune
+*
+*    /purpose    Computes the steady state gains and innovation gate of a
+*                constant velocity Kalman filter. The Riccati equation is 
+*                iterated in floating point here so the per-sample update 
+*                is fixed point only.
+*
+*                The measurement noise comes from the calibrated derivative
+*                noise. For white noise, the mean absolute difference of
+*                successive samples is 2/sqrt(pi) = 1.128 standard 
+*                deviations. The process noise is a white acceleration
+*                scaled from the saccade amplitude.
+*
+*    /param[io]  zpsFilter      Filter to tune
+*    /param[in]  zlNoise        Calibrated derivative noise, Q8 counts. 
+*                               0 if not calibrated.
+*    /param[in]  zfAmplitude    Smallest saccade amplitude, in Volts
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__KalmanTune(Direction_Kalman_t *zpsFilter, 
+                                  signed long zlNoise, float zfAmplitude)
+{
+  float xfSigma, xfR, xfQ, xfS = 0.0f;
+  float xfK1 = 1.0f, xfK2 = 0.0f;
+  float xfP00, xfP01, xfP11;
+  
+  // Measurement noise, counts squared
+  
+  if (zlNoise > 0)
+  {
+    xfSigma = ((float)zlNoise / 256.0f) / 1.128f;
+  }
+  else
+  {
+    xfSigma = KF_DEFAULT_SIGMA;
+  }
+  
+  xfR = xfSigma * xfSigma;
+  
+  // Process noise, counts squared per sample to the fourth
+  
+  xfQ = Direction__mfKalmanAccel * zfAmplitude / Analog_CountsToVolts(1);
+  xfQ = xfQ * xfQ;
+  
+  // Iterate the covariance to steady state
+  
+  xfP00 = xfR;
+  xfP01 = 0.0f;
+  xfP11 = xfR;
+  
+  for (int i=0; i<KF_TUNE_ITERATIONS; i++)
+  {
+    float xfA00, xfA01, xfA11;
+    
+    // Predict, F = [1 1; 0 1]
+    
+    xfA00 = xfP00 + 2.0f * xfP01 + xfP11 + xfQ * 0.25f;
+    xfA01 = xfP01 + xfP11 + xfQ * 0.5f;
+    xfA11 = xfP11 + xfQ;
+    
+    // Update, H = [1 0]
+    
+    xfS = xfA00 + xfR;
+    xfK1 = xfA00 / xfS;
+    xfK2 = xfA01 / xfS;
+    
+    xfP00 = (1.0f - xfK1) * xfA00;
+    xfP01 = (1.0f - xfK1) * xfA01;
+    xfP11 = xfA11 - xfK2 * xfA01;
+  }
+  
+  // Save off the fixed point gains and gate
+  
+  zpsFilter->slK1 = (signed long)(constrain(xfK1, 0.0f, 1.0f) * 32768.0f);
+  zpsFilter->slK2 = (signed long)(constrain(xfK2, 0.0f, 1.0f) * 32768.0f);
+  zpsFilter->slGate = 
+           (signed long)(Direction__mfKalmanGate * sqrt(xfS) * 256.0f);
+}
+
+/******************************************************************************
+*
+*    /name       Direction__KalmanUpdate
+*
+*    /purpose    Runs one predict/update step of a filter. Innovations
+*                outside of the gate are skipped as spikes, unless there are
+*                more of them in a row than allowed. Then the reading is 
+*                taken as a real step and the filter restarts from it.
+*
+*    /param[io]  zpsFilter    Filter to update
+*    /param[in]  zlCounts     Latest reading, in counts
+*
+*    /ret        signed long  Position estimate, in counts
+*
+******************************************************************************/
+static signed long Direction__KalmanUpdate(Direction_Kalman_t *zpsFilter,
+                                           signed long zlCounts)
+{
+  signed long xlInnovation;
+  
+  // Predict
+  
+  zpsFilter->slPos += zpsFilter->slVel;
+  
+  // Innovation, Q8
+  
+  xlInnovation = (zlCounts << 8) - zpsFilter->slPos;
+  
+  // Gate spikes
+  
+  if (abs(xlInnovation) > zpsFilter->slGate)
+  {
+    zpsFilter->swMisses++;
+    
+    if (zpsFilter->swMisses <= Direction__mwKalmanMisses)
+    {
+      return zpsFilter->slPos >> 8;
+    }
+    
+    // Persistent, restart at the reading
+    
+    zpsFilter->slPos = zlCounts << 8;
+    zpsFilter->slVel = 0;
+    zpsFilter->swMisses = 0;
+    
+    return zlCounts;
+  }
+  
+  zpsFilter->swMisses = 0;
+  
+  // Update
+  
+  zpsFilter->slPos += Direction__KalmanGain(zpsFilter->slK1, xlInnovation);
+  zpsFilter->slVel += Direction__KalmanGain(zpsFilter->slK2, xlInnovation);
+  
+  return zpsFilter->slPos >> 8;
+}
+
+/******************************************************************************
+*
+*    /name       Direction__KalmanGain
+*
+*    /purpose    Applies a Q15 gain to an innovation in 32 bits. Innovations
+*                under 256 counts keep the full gain, larger ones use it
+*                rounded to Q8 so the product still fits.
+*
+*    /param[in]  zlGain          Gain, Q15, at most 1
+*    /param[in]  zlInnovation    Innovation, Q8 counts
+*
+*    /ret        signed long     Correction, Q8 counts
+*
+******************************************************************************/
+static signed long Direction__KalmanGain(signed long zlGain,
+                                         signed long zlInnovation)
+{
+  if ((zlInnovation < 0x10000L) && (zlInnovation > -0x10000L))
+  {
+    return (zlGain * zlInnovation) >> 15;
+  }
+  
+  return ((zlGain + 64) >> 7) * (zlInnovation >> 8);
+}
+
+#if DIRECTION_DETECT_AMPLITUDE
+/******************************************************************************
+*
+*    /name       Direction__DetectAmplitude
+*
+*    /purpose    Amplitude detector. Behaves differently depending on the
+*                direction state. If no direction is detected, it checks both
+*                channels for a possible detection. In the event of a
+*                direction detection on BOTH channels, it weights the
+*                differentials and selects the "heaviest" detection.
+*
+*                If a direction is currently detected, it only cares about
+*                detecting a return to idle for that channel.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__DetectAmplitude()
+{
+  
+  // Behave according to current Direction state
+  
+  switch (Direction__meState)
+  {
+    
+    // If no direction is detected, attempt to identify one
+    
+    case DIRECTION_NONE:
+    {
+       float xfUpDownWeight, xfLeftRightWeight;
+       float xfEnter = 1.0f + Direction__mfHystEnter;
+       
+       // Check UP-DOWN
+       
+       xfUpDownWeight = Direction__WeightUpDown();
+       
+       // Check LEFT-RIGHT
+       
+       xfLeftRightWeight = Direction__WeightLeftRight();
+       
+     #if DEBUG  
+         Serial.print("VERTICAL: ");
+         Serial.print(Direction__msUpDown.sfDeltaVoltage, 4);
+  
+         Serial.print("    HORIZONTAL: ");
+         Serial.print(Direction__msLeftRight.sfDeltaVoltage, 4);
+  
+         Serial.print("\r\n");  
+     #endif
+     
+       // Keep the weight for the event report
+       
+       if (Direction__mbDiagonal)
+       {
+         Direction__mfWeight = sqrt(xfUpDownWeight * xfUpDownWeight +
+                                    xfLeftRightWeight * xfLeftRightWeight);
+       }
+       else
+       {
+         Direction__mfWeight = max(abs(xfUpDownWeight), 
+                                   abs(xfLeftRightWeight));
+       }
+       
+       // With diagonals enabled, classify the weights as a 2D vector
+       
+       if (Direction__mbDiagonal)
+       {
+         Direction__Classify2D(xfUpDownWeight / xfEnter, 
+                               xfLeftRightWeight / xfEnter);
+         
+         break;
+       }
+       
+       // Decide which, if any, direction to assign
+       
+       if ((abs(xfUpDownWeight) < xfEnter) && 
+           (abs(xfLeftRightWeight) < xfEnter))
+       {
+         
+         // No direction detected
+         
+         Direction__Request(DIRECTION_NONE);
+         
+         break;
+       }
+       
+       else if (abs(xfUpDownWeight) > abs(xfLeftRightWeight))
+       {
+         
+         // UP-DOWN detected. A negative weight is a DOWN,
+         // a positive weight is an UP.
+         if (xfUpDownWeight < 0.0)
+         {
+           Direction__Request(DIRECTION_DOWN);
+         }
+         else
+         {
+           Direction__Request(DIRECTION_UP);
+         }
+       }
+       
+       else
+       {
+         
+         // LEFT-RIGHT detected. A negative weight is a LEFT,
+         // a positive weight is a RIGHT.
+         
+         if (xfLeftRightWeight < 0.0)
+         {
+           Direction__Request(DIRECTION_LEFT);
+         }
+         else
+         {
+           Direction__Request(DIRECTION_RIGHT);
+         }
+       }
+      
+       break; 
+    }
+    
+    // If UP was read, check for a drop back to idle.
+    // If DOWN was read, check for a rise back to idle.
+    
+    case DIRECTION_UP:
+    case DIRECTION_DOWN:
+    {
+       float xfDelta;
+       
+       // Determine delta
+       
+       xfDelta = abs(Direction__msUpDown.sfDeltaVoltage);
+       
+       // Track the peak of the detection
+       
+       if (xfDelta > Direction__mfPeakDelta)
+       {
+         Direction__mfPeakDelta = xfDelta;
+       }
+                     
+       #if DEBUG 
+         Serial.print("VERTICAL: ");
+         Serial.print(Direction__msUpDown.sfDeltaVoltage, 4);
+         
+         Serial.print("     THRESHOLD: ");
+         Serial.print(Direction__mafExit[DIRECTION_AXIS_UPDOWN], 4);
+  
+         Serial.print("\r\n");  
+       #endif
+                     
+       // Check against threshold
+       
+       if (xfDelta < Direction__mafExit[DIRECTION_AXIS_UPDOWN])
+       {
+          
+         // Threshold exceeded
+         
+         Direction__Request(DIRECTION_NONE);
+       }
+       
+       break; 
+    }
+    
+    // If LEFT was read, check for a rise back to idle.
+    // If RIGHT was read, check for a drop back to idle. 
+    
+    case DIRECTION_LEFT:
+    case DIRECTION_RIGHT:
+    {
+       float xfDelta;
+       
+       // Determine delta
+       
+       xfDelta = abs(Direction__msLeftRight.sfDeltaVoltage);
+       
+       // Track the peak of the detection
+       
+       if (xfDelta > Direction__mfPeakDelta)
+       {
+         Direction__mfPeakDelta = xfDelta;
+       }
+                     
+       #if DEBUG  
+         Serial.print("HORIZONTAL: ");
+         Serial.print(Direction__msLeftRight.sfDeltaVoltage, 4);
+         
+         Serial.print("     THRESHOLD: ");
+         Serial.print(Direction__mafExit[DIRECTION_AXIS_LEFTRIGHT], 4);
+  
+         Serial.print("\r\n");  
+       #endif
+                     
+       // Check against threshold
+       
+       if (xfDelta < Direction__mafExit[DIRECTION_AXIS_LEFTRIGHT])
+       {
+          
+         // Threshold exceeded
+         
+         
+         Direction__Request(DIRECTION_NONE);
+       }
+       
+       break; 
+    }
+    
+    // If a diagonal was read, both channels have to be back before
+    // returning to idle.
+    
+    case DIRECTION_UP_LEFT:
+    case DIRECTION_UP_RIGHT:
+    case DIRECTION_DOWN_LEFT:
+    case DIRECTION_DOWN_RIGHT:
+    {
+       
+       // Check both against their thresholds
+       
+       if ((abs(Direction__msUpDown.sfDeltaVoltage) < 
+            Direction__mafExit[DIRECTION_AXIS_UPDOWN]) &&
+           (abs(Direction__msLeftRight.sfDeltaVoltage) < 
+            Direction__mafExit[DIRECTION_AXIS_LEFTRIGHT]))
+       {
+         Direction__Request(DIRECTION_NONE);
+       }
+       
+       break;
+    }
+    
+    default:
+       break;
+  }
+  
+}
+
+/******************************************************************************
+*
+*    /name       Direction__Classify2D
+*
+*    /purpose    Classifies the two channel weights as one 2D vector. A
+*                vector of length 1 or more is a detection. Its angle picks
+*                the direction: within half of the diagonal sector of 45
+*                degrees it is a diagonal, otherwise the nearer axis.
+*
+*    /param[in]  zfUpDownWeight       Weight of the UP-DOWN channel
+*    /param[in]  zfLeftRightWeight    Weight of the LEFT-RIGHT channel
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__Classify2D(float zfUpDownWeight, 
+                                  float zfLeftRightWeight)
+{
+  float xfAngle;
+  boolean xbUp = (zfUpDownWeight >= 0.0f);
+  boolean xbRight = (zfLeftRightWeight >= 0.0f);
+  
+  // Check the length
+  
+  if ((zfUpDownWeight * zfUpDownWeight + 
+       zfLeftRightWeight * zfLeftRightWeight) < 1.0f)
+  {
+    Direction__Request(DIRECTION_NONE);
+    return;
+  }
+  
+  // Angle from the horizontal, 0 to 90 degrees
+  
+  xfAngle = atan2(abs(zfUpDownWeight), abs(zfLeftRightWeight)) * RAD_TO_DEG;
+  
+  // Pick the sector
+  
+  if (xfAngle > (45.0f + Direction__mfDiagonalSector / 2.0f))
+  {
+    Direction__Request(xbUp ? DIRECTION_UP : DIRECTION_DOWN);
+  }
+  else if (xfAngle < (45.0f - Direction__mfDiagonalSector / 2.0f))
+  {
+    Direction__Request(xbRight ? DIRECTION_RIGHT : DIRECTION_LEFT);
+  }
+  else if (xbUp)
+  {
+    Direction__Request(xbRight ? DIRECTION_UP_RIGHT : DIRECTION_UP_LEFT);
+  }
+  else
+  {
+    Direction__Request(xbRight ? DIRECTION_DOWN_RIGHT : DIRECTION_DOWN_LEFT);
+  }
+}
+#endif
+
+#if DIRECTION_DETECT_VELOCITY
+/******************************************************************************
+*
+*    /name       Direction__DetectVelocity
+*
+*    /purpose    Velocity detector. Works on the filtered sample-to-sample
+*                derivative of each channel instead of the accumulated delta.
+*                A movement is confirmed as soon as the velocity of either
+*                channel crosses its limit, in the direction of its sign.
+*                This catches a saccade part way through rather than at its
+*                plateau. The movement is held until both channels are back
+*                under their limits, so it is only counted once.
+*
+*                While a direction is detected, a movement in the opposite
+*                direction on the same channel returns to idle. Changes go 
+*                through Direction__Request, so the dwell counts the samples
+*                a movement stays over its limit.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__DetectVelocity()
+{
+  signed long xlUpDownLimit, xlLeftRightLimit;
+  signed long xlUpDown = abs(Direction__msUpDown.slVelocity);
+  signed long xlLeftRight = abs(Direction__msLeftRight.slVelocity);
+  
+  // Limits from the calibrated noise of each channel
+  
+  xlUpDownLimit = max((signed long)(Direction__mfVelocityK * 
+                                    Direction__mfNoiseScale *
+                                    Direction__mlUpDownNoise),
+                      (signed long)VELOCITY_MIN_LIMIT);
+  xlLeftRightLimit = max((signed long)(Direction__mfVelocityK * 
+                                       Direction__mfNoiseScale *
+                                       Direction__mlLeftRightNoise),
+                         (signed long)VELOCITY_MIN_LIMIT);
+  
+  // A movement was confirmed, keep asking for its change until it ends
+  
+  if (Direction__meOnset != DIRECTION_NONE)
+  {
+    if ((xlUpDown < xlUpDownLimit) && (xlLeftRight < xlLeftRightLimit))
+    {
+      Direction__meOnset = DIRECTION_NONE;
+      Direction__Request(Direction__meState);
+    }
+    else
+    {
+      Direction__Request(Direction__meVelocityTarget);
+    }
+    
+    return;
+  }
+  
+  // Pick the channel that is furthest over its limit. The weight is the
+  // velocity over the limit.
+  
+  if ((xlUpDown >= xlUpDownLimit) && 
+      (((float)xlUpDown / xlUpDownLimit) >= 
+       ((float)xlLeftRight / xlLeftRightLimit)))
+  {
+    Direction__meOnset = (Direction__msUpDown.slVelocity > 0) ? 
+                                         DIRECTION_UP : DIRECTION_DOWN;
+    Direction__mfWeight = (float)xlUpDown / xlUpDownLimit;
+  }
+  else if (xlLeftRight >= xlLeftRightLimit)
+  {
+    Direction__meOnset = (Direction__msLeftRight.slVelocity > 0) ? 
+                                         DIRECTION_RIGHT : DIRECTION_LEFT;
+    Direction__mfWeight = (float)xlLeftRight / xlLeftRightLimit;
+  }
+  else
+  {
+    
+    // No movement, stay where we are
+    
+    Direction__Request(Direction__meState);
+    return;
+  }
+  
+  // From idle, the movement is the new direction. Otherwise only the
+  // opposite movement on the same channel is a return to idle.
+  
+  Direction__meVelocityTarget = Direction__meState;
+  
+  switch (Direction__meState)
+  {
+    case DIRECTION_NONE:
+      Direction__meVelocityTarget = Direction__meOnset;
+      break;
+    
+    case DIRECTION_UP:
+      if (Direction__meOnset == DIRECTION_DOWN)
+      {
+        Direction__meVelocityTarget = DIRECTION_NONE;
+      }
+      break;
+      
+    case DIRECTION_DOWN:
+      if (Direction__meOnset == DIRECTION_UP)
+      {
+        Direction__meVelocityTarget = DIRECTION_NONE;
+      }
+      break;
+      
+    case DIRECTION_LEFT:
+      if (Direction__meOnset == DIRECTION_RIGHT)
+      {
+        Direction__meVelocityTarget = DIRECTION_NONE;
+      }
+      break;
+      
+    case DIRECTION_RIGHT:
+      if (Direction__meOnset == DIRECTION_LEFT)
+      {
+        Direction__meVelocityTarget = DIRECTION_NONE;
+      }
+      break;
+      
+    default:
+      break;
+  }
+  
+  Direction__Request(Direction__meVelocityTarget);
+}
+#endif
+
+#if DIRECTION_DETECT_TEMPLATE
+/******************************************************************************
+*
+*    /name       Direction__DetectTemplate
+*
+*    /purpose    Template detector. Reports the movement whose recorded shape
+*                the latest window matches, see the Template module. A match
+*                holds for as long as the movement is in the window, and is
+*                asked for on each of those samples, so the dwell applies,
+*                until it has moved the direction state. After that the same
+*                match is not counted again.
+*
+*                As with the velocity detector, while a direction is 
+*                detected a match of the opposite movement returns to idle.
+*                Blinks are matched only so they are never taken for a look.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__DetectTemplate()
+{
+  static const Direction_t xaeDirection[TEMPLATE_NUM_CLASSES + 1] = 
+  {
+    DIRECTION_UP, DIRECTION_DOWN, DIRECTION_LEFT, DIRECTION_RIGHT,
+    DIRECTION_NONE, DIRECTION_NONE
+  };
+  static const Direction_t xaeOpposite[DIRECTION_NUM_CARDINAL] = 
+  {
+    DIRECTION_NONE, DIRECTION_DOWN, DIRECTION_UP, DIRECTION_RIGHT, 
+    DIRECTION_LEFT
+  };
+  Template_Class_t xeClass;
+  Direction_t xeDir;
+  Direction_t xeTarget;
+  float xfWeight;
+  
+  // The movements made while a template is recorded are not reported
+  
+  if (Template_IsRecording())
+  {
+    Direction__meTemplateMatch = TEMPLATE_NONE;
+    
+    return;
+  }
+  
+  xeClass = Template_Match(&xfWeight);
+  
+  if (xfWeight < 1.0f)
+  {
+    xeClass = TEMPLATE_NONE;
+  }
+  
+  // A new match has not been used yet
+  
+  if (xeClass != Direction__meTemplateMatch)
+  {
+    Direction__meTemplateMatch = xeClass;
+    Direction__mbTemplateUsed = false;
+  }
+  
+  xeDir = xaeDirection[xeClass];
+  
+  if ((xeDir == DIRECTION_NONE) || Direction__mbTemplateUsed)
+  {
+    return;
+  }
+  
+  // From idle, the movement is the new direction. Otherwise only the 
+  // opposite movement is a return to idle.
+  
+  if (Direction__meState == DIRECTION_NONE)
+  {
+    Direction__mfWeight = xfWeight;
+    
+    xeTarget = xeDir;
+  }
+  else if ((Direction__meState < DIRECTION_NUM_CARDINAL) && 
+           (xeDir == xaeOpposite[Direction__meState]))
+  {
+    xeTarget = DIRECTION_NONE;
+  }
+  else
+  {
+    return;
+  }
+  
+  Direction__Request(xeTarget);
+  
+  if (Direction__meState == xeTarget)
+  {
+    Direction__mbTemplateUsed = true;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Direction__ResetTemplate
+*
+*    /purpose    Restarts the template detector with no match seen
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__ResetTemplate()
+{
+  Direction__meTemplateMatch = TEMPLATE_NONE;
+  Direction__mbTemplateUsed = false;
+}
+#endif
+
+#if DIRECTION_DETECT_EMA
+/******************************************************************************
+*
+*    /name       Direction__ResetEma
+*
+*    /purpose    Restarts the EMA detector's baselines at the channel
+*                readings
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__ResetEma()
+{
+  Ema_Reset(Direction__msUpDown.sfCurrVoltage, 
+            Direction__msLeftRight.sfCurrVoltage);
+}
+
+/******************************************************************************
+*
+*    /name       Direction__DetectEma
+*
+*    /purpose    EMA detector, see the Ema module. The movement it holds is
+*                asked for like a detection of the amplitude detector, so 
+*                dwell and refractory counts apply the same way.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__DetectEma()
+{
+  Direction_t xeDir;
+  float xfWeight;
+  
+  xeDir = Ema_Update(Direction__msUpDown.sfCurrVoltage, 
+                     Direction__msLeftRight.sfCurrVoltage, &xfWeight);
+  
+  // Keep the weight for the event report
+  
+  if (Direction__meState == DIRECTION_NONE)
+  {
+    Direction__mfWeight = xfWeight;
+  }
+  
+  Direction__Request(xeDir);
+}
+#endif
+
+#if DIRECTION_DETECT_AMPLITUDE
+/******************************************************************************
+*
+*    /name       Direction__WeightUpDown
+*
+*    /purpose    Returns a weight for the detection status of the channel. A
+*                value greater than 1 (positive or negative) indicates a
+*                detection. Negative weights correspond to DOWN and positive
+*                weights correspond to UP.
+*
+*    /ret        float    Current weighted detection status
+*
+******************************************************************************/
+static float Direction__WeightUpDown()
+{
+  float xfWeight = 0.0f;
+  
+  // If the current is greater than the previous, we are dealing with a
+  // possible up. Since it is irrelevant where we include the "equal" case,
+  // we'll put it here.
+  
+  if (Direction__msUpDown.sfDeltaVoltage  >= 0.0)
+  {
+    
+    // Find the differential
+    
+    xfWeight = Direction__msUpDown.sfDeltaVoltage;
+                   
+    // Convert to a "weight" which will be >1 if the detection is over
+    // the threshold.
+    
+    xfWeight = xfWeight / Direction__mafThreshold[DIRECTION_UP];  
+  }
+  
+  // If the current is less than the previous, we are dealing with a
+  // possible down.
+  
+  else
+  {
+    
+    // Find the differential
+    
+    xfWeight = Direction__msUpDown.sfDeltaVoltage;
+                   
+    // Convert to a "weight" which will be >1 if the detection is over
+    // the threshold.
+    
+    xfWeight = xfWeight / Direction__mafThreshold[DIRECTION_DOWN];
+  }
+  
+  // Ignore states
+  
+  if (!Artifact_IsEnabled() && (abs(xfWeight) > WEIGHT_SPIKE))
+  {
+    xfWeight = 0;
+  }
+  
+  // Return the result
+  
+  return xfWeight;
+}
+
+/******************************************************************************
+*
+*    /name       Direction__WeightLeftRight
+*
+*    /purpose    Returns a weight for the detection status of the channel. A
+*                value greater than 1 (positive or negative) indicates a
+*                detection. Negative weights correspond to LEFT and positive
+*                weights correspond to RIGHT.
+*
+*    /ret        float    Current weighted detection status
+*
+******************************************************************************/
+static float Direction__WeightLeftRight()
+{
+  float xfWeight = 0.0f;
+  
+  // If the current is greater than the previous, we are dealing with a
+  // possible RIGHT. Since it is irrelevant where we include the "equal" case,
+  // we'll put it here.
+  
+  if (Direction__msLeftRight.sfDeltaVoltage  >= 0.0)
+  {
+    
+    // Find the differential
+    
+    xfWeight = Direction__msLeftRight.sfDeltaVoltage;
+                   
+    // Convert to a "weight" which will be >1 if the detection is over
+    // the threshold.
+    
+    xfWeight = xfWeight / Direction__mafThreshold[DIRECTION_RIGHT];  
+  }
+  
+  // If the current is less than the previous, we are dealing with a
+  // possible LEFT.
+  
+  else
+  {
+    
+    // Find the differential
+    
+    xfWeight = Direction__msLeftRight.sfDeltaVoltage;
+                   
+    // Convert to a "weight" which will be >1 if the detection is over
+    // the threshold.
+    
+    xfWeight = xfWeight / Direction__mafThreshold[DIRECTION_LEFT]; 
+  }
+  
+  // Ignore spikes
+  
+  if (!Artifact_IsEnabled() && (abs(xfWeight) > WEIGHT_SPIKE))
+  {
+    xfWeight = 0;
+  }
+  
+  // Return the result
+  
+  return xfWeight;
+}
+#endif
+
+/******************************************************************************
+*
+*    /name       Direction__SetState
+*
+*    /purpose    Sets a the direction state. Updates the delta required to
+*                return to the idle state.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__SetState(Direction_t zeDir)
+{
+  boolean xbChanged;
+  
+  // Set the delta for each axis accordingly. Axes that are not part of
+  // the direction are cleared to 0.
+  
+  if (zeDir == DIRECTION_NONE)
+  {
+    
+    // A return to idle confirms the detection. Let its peak adjust the
+    // threshold for that direction.
+    
+    if ((Direction__meState != DIRECTION_NONE) && 
+        (Direction__meState < DIRECTION_NUM_CARDINAL))
+    {
+      Direction__Adapt(Direction__meState, Direction__mfPeakDelta);
+    }
+    
+    // Hold off the next detection
+    
+    if (Direction__meState != DIRECTION_NONE)
+    {
+      Direction__mwRefractoryCount = Direction__mwRefractory;
+    }
+    
+    Direction__mfWeight = 0.0f;
+   
+    // Clear entries to 0
+  
+    Direction__mafExit[DIRECTION_AXIS_UPDOWN] = 0;
+    Direction__mafExit[DIRECTION_AXIS_LEFTRIGHT] = 0;
+  }
+  else
+  {
+    Direction_t xeVertical = Direction__maeVertical[zeDir];
+    Direction_t xeHorizontal = Direction__maeHorizontal[zeDir];
+    
+    // Update to match current state. The thresholds themselves are
+    // adapted as the use time progresses and the voltage drifts.
+    
+    Direction__mafExit[DIRECTION_AXIS_UPDOWN] = 0;
+    Direction__mafExit[DIRECTION_AXIS_LEFTRIGHT] = 0;
+    
+    if (xeVertical != DIRECTION_NONE)
+    {
+      Direction__mafExit[DIRECTION_AXIS_UPDOWN] = 
+        Direction__mafThreshold[xeVertical] * (1.0f - Direction__mfHystExit);
+    }
+    
+    if (xeHorizontal != DIRECTION_NONE)
+    {
+      Direction__mafExit[DIRECTION_AXIS_LEFTRIGHT] = 
+        Direction__mafThreshold[xeHorizontal] * (1.0f - Direction__mfHystExit);
+    }
+    
+    // Start tracking the peak of this detection
+    
+    if (zeDir == DIRECTION_UP || zeDir == DIRECTION_DOWN)
+    {
+      Direction__mfPeakDelta = abs(Direction__msUpDown.sfDeltaVoltage);
+    }
+    else
+    {
+      Direction__mfPeakDelta = abs(Direction__msLeftRight.sfDeltaVoltage);
+    }
+  }
+  
+  // Finally update the state variable. The extended event formats only
+  // report changes.
+  
+  xbChanged = (zeDir != Direction__meState);
+  
+  Direction__meState = zeDir;
+  
+  if (xbChanged)
+  {
+    Record_State(zeDir, Direction__mulSampleTime);
+  }
+  
+  if (xbChanged || (Direction__mwEventFormat == EVENT_PLAIN))
+  {
+    Direction_BroadcastState();
+  }
+  
+  Direction__meCandidate = DIRECTION_NO_CANDIDATE;
+  Direction__mwCandidateCount = 0;
+}
+
+/******************************************************************************
+*
+*    /name       Direction__Request
+*
+*    /purpose    Asks for a change of the direction state from a detector.
+*                The change is made once the same direction has been asked
+*                for on the dwell count of consecutive samples.
+*                New directions are ignored during the refractory period.
+*                Staying idle is passed straight on, so idle keeps being
+*                broadcast.
+*
+*    /param[in]  zeDir     Direction the detector reads
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__Request(Direction_t zeDir)
+{
+  
+  Direction__mbRequested = true;
+  
+  // No change, nothing is pending
+  
+  if (zeDir == Direction__meState)
+  {
+    Direction__meCandidate = DIRECTION_NO_CANDIDATE;
+    Direction__mwCandidateCount = 0;
+    
+    if (zeDir == DIRECTION_NONE)
+    {
+      Direction__SetState(DIRECTION_NONE);
+    }
+    
+    return;
+  }
+  
+  // Still refractory, stay idle
+  
+  if ((Direction__meState == DIRECTION_NONE) && 
+      (Direction__mwRefractoryCount > 0))
+  {
+    Direction__SetState(DIRECTION_NONE);
+    return;
+  }
+  
+  // Count the samples the change has held
+  
+  if (zeDir != Direction__meCandidate)
+  {
+    Direction__meCandidate = zeDir;
+    Direction__mwCandidateCount = 0;
+  }
+  
+  Direction__mwCandidateCount++;
+  
+  if (Direction__mwCandidateCount >= Direction__mwDwell)
+  {
+    Direction__SetState(zeDir);
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Direction__Adapt
+*
+*    /purpose    Moves the threshold for the given direction toward the 
+*                scaled peak of a confirmed detection. The threshold is kept
+*                within the adaptation limit of its calibrated value. Learned
+*                thresholds are left to the auto-calibration, and only the
+*                amplitude detector tracks the peak.
+*
+*    /param[in]  zeDir     Direction that was detected
+*    /param[in]  zfPeak    Peak delta of the detection, in Volts
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__Adapt(Direction_t zeDir, float zfPeak)
+{
+  float xfCal, xfThreshold;
+  
+  // Check if adaptation applies
+  
+  xfCal = Direction__mafCalThreshold[zeDir];
+  
+  if (!Direction__mbAdapt || Direction__mbAutoCal || (xfCal == 0) ||
+      !Direction__masDetectors[Direction__mwActiveDetector].sbAdapt)
+  {
+    return;
+  }
+  
+  // Exponential update toward the scaled peak
+  
+  xfThreshold = Direction__mafThreshold[zeDir];
+  xfThreshold += (zfPeak * Direction__mfScaleDown - xfThreshold) * 
+                 Direction__mfAdaptRate;
+  
+  // Bound the drift
+  
+  Direction__mafThreshold[zeDir] = 
+                constrain(xfThreshold,
+                          xfCal * (1.0f - Direction__mfAdaptLimit),
+                          xfCal * (1.0f + Direction__mfAdaptLimit));
+  
+  #if DEBUG
+     Serial.print(Direction__manSerialChars[zeDir]);
+     Serial.print(" Threshold adapted: ");
+     Serial.print(Direction__mafThreshold[zeDir], 4);
+     
+     Serial.print("\r\n");
+  #endif
+}
+
+/******************************************************************************
+*
+*    /name       Direction__Capture
+*
+*    /purpose    Captures a calibration window on the given channel. The
+*                channel is sampled CAPTURE_SAMPLES times at a fixed interval
+*                and the median is returned. The capture is rejected if the
+*                inter-quartile spread is too large, meaning the eyes moved
+*                or the electrode contact is bad. The quartiles are estimated
+*                as the samples arrive, so no buffer is needed.
+*
+*    /param[in]  zeChannel    Channel to capture
+*    /param[out] zpfVoltage   Median voltage of the window
+*    /param[out] zplNoise     Mean absolute difference of samples one
+*                             noise lag apart, Q8 counts. May be NULL.
+*
+*    /ret        boolean      true if the capture is good, false otherwise
+*
+******************************************************************************/
+static boolean Direction__Capture(Analog_Channel_t zeChannel, 
+                                  float *zpfVoltage, signed long *zplNoise)
+{
+  Direction_Quantile_t xsQuantile;
+  int16_t xawLag[CAPTURE_NOISE_LAG];
+  int xwLag = Direction__NoiseLag();
+  int xwSlot = 0;
+  float xfSpread;
+  signed long xlNoise = 0;
+  
+  xsQuantile.swCount = 0;
+  
+  // Sample the window. A new conversion is started for every sample.
+  
+  for (int i=0; i<CAPTURE_SAMPLES; i++)
+  {
+    signed long xlCounts;
+    
+    Analog_Update();
+    
+    xlCounts = Analog_ReadCounts(zeChannel);
+    
+    // Derivative noise, from samples one lag apart
+    
+    if (i >= xwLag)
+    {
+      xlNoise += abs(xlCounts - xawLag[xwSlot]);
+    }
+    
+    xawLag[xwSlot] = (int16_t)xlCounts;
+    
+    if (++xwSlot >= xwLag)
+    {
+      xwSlot = 0;
+    }
+    
+    Direction__QuantileAdd(&xsQuantile, (float)xlCounts);
+    
+    delayMicroseconds(CAPTURE_INTERVAL_US);
+  }
+  
+  if (zplNoise != NULL)
+  {
+    *zplNoise = (signed long)(((float)xlNoise * 256.0f) / 
+                              (CAPTURE_SAMPLES - xwLag));
+  }
+  
+  // Median and inter-quartile spread
+  
+  *zpfVoltage = Analog_CountsToVolts(1) * xsQuantile.safHeight[2];
+  
+  xfSpread = Analog_CountsToVolts(1) * 
+             (xsQuantile.safHeight[3] - xsQuantile.safHeight[1]);
+  
+  #if DEBUG
+     Serial.print("CAPTURE: ");
+     Serial.print(*zpfVoltage, 4);
+     
+     Serial.print("    SPREAD: ");
+     Serial.print(xfSpread, 4);
+     
+     Serial.print("\r\n");
+  #endif
+  
+  // Reject noisy captures
+  
+  return xfSpread <= Direction__mfMaxSpread;
+}
+
+/******************************************************************************
+*
+*    /name       Direction__NoiseLag
+*
+*    /purpose    Number of capture intervals the derivative noise is measured
+*                over, one update period but no more than CAPTURE_NOISE_LAG
+*
+*    /ret        int    Lag, in capture intervals
+*
+******************************************************************************/
+static int Direction__NoiseLag()
+{
+  long xlLag = (Direction__mwPeriod * 1000L) / CAPTURE_INTERVAL_US;
+  
+  return (int)constrain(xlLag, 1L, (long)CAPTURE_NOISE_LAG);
+}
+
+/******************************************************************************
+*
+*    /name       Direction__QuantileAdd
+*
+*    /purpose    Adds a sample to a P-squared estimate of the quartiles. The
+*                first five samples start the markers off, sorted. After
+*                that the markers are moved toward their desired positions,
+*                at 0, 1/4, 1/2, 3/4 and 1 of the samples, with a parabolic
+*                step, or a linear one where the parabola would pass a
+*                neighbour. The estimate needs at least five samples.
+*
+*    /param[in]  zpsQuantile    Estimate
+*    /param[in]  zfValue        Sample, counts
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__QuantileAdd(Direction_Quantile_t *zpsQuantile,
+                                   float zfValue)
+{
+  float *xpfQ = zpsQuantile->safHeight;
+  int *xpwN = zpsQuantile->sawPos;
+  int xwCell;
+  
+  // Start off with the first samples, in order
+  
+  if (zpsQuantile->swCount < QUANTILE_MARKERS)
+  {
+    int j = zpsQuantile->swCount - 1;
+    
+    while ((j >= 0) && (xpfQ[j] > zfValue))
+    {
+      xpfQ[j + 1] = xpfQ[j];
+      j--;
+    }
+    
+    xpfQ[j + 1] = zfValue;
+    xpwN[zpsQuantile->swCount] = zpsQuantile->swCount;
+    zpsQuantile->swCount++;
+    
+    return;
+  }
+  
+  // Find the cell the sample falls in, stretching the ends to hold it
+  
+  if (zfValue < xpfQ[0])
+  {
+    xpfQ[0] = zfValue;
+    xwCell = 0;
+  }
+  else if (zfValue >= xpfQ[QUANTILE_MARKERS - 1])
+  {
+    xpfQ[QUANTILE_MARKERS - 1] = zfValue;
+    xwCell = QUANTILE_MARKERS - 2;
+  }
+  else
+  {
+    xwCell = 0;
+    
+    while (zfValue >= xpfQ[xwCell + 1])
+    {
+      xwCell++;
+    }
+  }
+  
+  // Markers above it move up one
+  
+  for (int i=xwCell + 1; i<QUANTILE_MARKERS; i++)
+  {
+    xpwN[i]++;
+  }
+  
+  zpsQuantile->swCount++;
+  
+  // Adjust the inner markers that are a position or more off
+  
+  for (int i=1; i<QUANTILE_MARKERS - 1; i++)
+  {
+    float xfDesired = (float)(zpsQuantile->swCount - 1) * i / 
+                      (QUANTILE_MARKERS - 1);
+    float xfOff = xfDesired - xpwN[i];
+    int d;
+    float xfStep;
+    
+    if ((xfOff >= 1.0f) && (xpwN[i + 1] - xpwN[i] > 1))
+    {
+      d = 1;
+    }
+    else if ((xfOff <= -1.0f) && (xpwN[i - 1] - xpwN[i] < -1))
+    {
+      d = -1;
+    }
+    else
+    {
+      continue;
+    }
+    
+    // Parabolic prediction
+    
+    xfStep = xpfQ[i] + (float)d / (xpwN[i + 1] - xpwN[i - 1]) *
+             ((xpwN[i] - xpwN[i - 1] + d) * (xpfQ[i + 1] - xpfQ[i]) /
+              (xpwN[i + 1] - xpwN[i]) +
+              (xpwN[i + 1] - xpwN[i] - d) * (xpfQ[i] - xpfQ[i - 1]) /
+              (xpwN[i] - xpwN[i - 1]));
+    
+    // Linear, if that would leave the marker out of order
+    
+    if ((xfStep <= xpfQ[i - 1]) || (xfStep >= xpfQ[i + 1]))
+    {
+      xfStep = xpfQ[i] + d * (xpfQ[i + d] - xpfQ[i]) / (xpwN[i + d] - xpwN[i]);
+    }
+    
+    xpfQ[i] = xfStep;
+    xpwN[i] += d;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Direction__CalibrateThreshold
+*
+*    /purpose    Waits for the eyes to settle, captures the given channel and
+*                sets the direction threshold from the differential to the
+*                resting voltage. The other axis is then captured to measure
+*                how much of the look leaks into it. Replies with the result.
+*
+*    /param[in]  zeDir            Direction to calibrate
+*    /param[in]  zeChannel        Channel the direction is read on
+*    /param[in]  zfResting        Resting voltage of that channel
+*    /param[in]  zeCross          Channel of the other axis
+*    /param[in]  zfCrossResting   Resting voltage of the other axis
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__CalibrateThreshold(Direction_t zeDir, 
+                                          Analog_Channel_t zeChannel,
+                                          float zfResting,
+                                          Analog_Channel_t zeCross,
+                                          float zfCrossResting)
+{
+   float xfVoltage, xfCross, xfLeak;
+   
+   // Delay so eyes are settled
+   
+   delay(CAPTURE_SETTLE_MS);
+   
+   // Capture the channel
+   
+   if (!Direction__Capture(zeChannel, &xfVoltage, NULL))
+   {
+     Serial.println("Bad reading! Unstable!");
+     
+     Command_Reply(false);
+     return;
+   }
+   
+   // Set the threshold to the positive differential between the current
+   // reading and the known idle reading and scale down by the scale factor.
+  
+   Direction__mafSpan[zeDir] = abs(xfVoltage - zfResting);
+   Direction__mafThreshold[zeDir] = 
+          Direction__mafSpan[zeDir] * Direction__mfScaleDown;
+          
+   // Check for bad threshold
+   
+   if (Direction__mafThreshold[zeDir] == 0)
+   {
+     Serial.println("Bad reading! 0V!");
+     
+     Command_Reply(false);
+     return;
+   }
+   
+   // This is the reference for any adaptation from here on
+   
+   Direction__mafCalThreshold[zeDir] = Direction__mafThreshold[zeDir];
+   Direction__mbKalmanStale = true;
+   
+   // Measure the leak into the other axis. The eyes are still held, a
+   // capture that is unstable or out of range leaves the direction without
+   // compensation rather than failing the calibration.
+   
+   Direction__mafLeak[zeDir] = 0.0f;
+   
+   if (Direction__Capture(zeCross, &xfCross, NULL))
+   {
+     xfLeak = (xfCross - zfCrossResting) / (xfVoltage - zfResting);
+     
+     if (abs(xfLeak) <= XTALK_MAX_LEAK)
+     {
+       Direction__mafLeak[zeDir] = xfLeak;
+     }
+   }
+   
+   Direction__UpdateUnmix();
+          
+   // DEBUG - Print the setting
+   
+   #if DEBUG
+         Serial.print(Direction__manSerialChars[zeDir]);
+         Serial.print(" Threshold set to: ");
+         Serial.print(Direction__mafThreshold[zeDir], 4);
+  
+         Serial.print("\r\n");  
+   #endif
+   
+   Command_Reply(true);
+}
+
+/******************************************************************************
+*
+*    /name       Direction__AutoSeed
+*
+*    /purpose    Seeds the auto-calibration clusters. Directions that have
+*                a threshold already start from it, anything else starts
+*                from the default thresholds.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Direction__AutoSeed()
+{
+  // Seed each direction. The saccade centre is the amplitude that the
+  // threshold was scaled down from.
+  
+  for (int i=DIRECTION_UP; i<DIRECTION_NUM_CARDINAL; i++)
+  {
+    if (Direction__mafThreshold[i] == 0)
+    {
+      Direction__mafThreshold[i] = Direction__mafDefault[i];
+    }
     
+    Direction__masCluster[i].sfLow = 0.0f;
+    Direction__masCluster[i].sfHigh = 
+                           Direction__mafThreshold[i] / Direction__mfScaleDown;
+    Direction__masCluster[i].suwCount = 0;
   }
   
+  // Restart the excursion trackers at the current delta
+  
+  Direction__msUpDownExcursion.sfRest = Direction__msUpDown.sfDeltaVoltage;
+  Direction__msUpDownExcursion.sfPeak = 0.0f;
+  Direction__msUpDownExcursion.sbArmed = true;
+  
+  Direction__msLeftRightExcursion.sfRest = 
+                                     Direction__msLeftRight.sfDeltaVoltage;
+  Direction__msLeftRightExcursion.sfPeak = 0.0f;
+  Direction__msLeftRightExcursion.sbArmed = true;
 }
 
 /******************************************************************************
 *
-*    /name       Direction__WeightUpDown
+*    /name       Direction__AutoTrack
 *
-*    /purpose    Returns a weight for the detection status of the channel. A
-*                value greater than 1 (positive or negative) indicates a
-*                detection. Negative weights correspond to DOWN and positive
-*                weights correspond to UP.
+*    /purpose    Follows the excursions of one channel's running delta away
+*                from its rest level. When an excursion is over, its peak is
+*                handed to the learner for the direction given by its sign.
 *
-*    /ret        float    Current weighted detection status
+*    /param[in]  zpsChannel      Channel to track
+*    /param[io]  zpsExcursion    Excursion state for that channel
+*    /param[in]  zePos           Direction of a positive excursion
+*    /param[in]  zeNeg           Direction of a negative excursion
+*
+*    /ret        void
 *
 ******************************************************************************/
-static float Direction__WeightUpDown()
+static void Direction__AutoTrack(Direction_Channel_t *zpsChannel,
+                                 Direction_Excursion_t *zpsExcursion,
+                                 Direction_t zePos, Direction_t zeNeg)
 {
-  float xfWeight = 0.0f;
+  float xfExcursion;
   
-  // If the current is greater than the previous, we are dealing with a
-  // possible up. Since it is irrelevant where we include the "equal" case,
-  // we'll put it here.
+  // Excursion from the rest level
   
-  if (Direction__msUpDown.sfDeltaVoltage  >= 0.0)
+  xfExcursion = zpsChannel->sfDeltaVoltage - zpsExcursion->sfRest;
+  
+  // Quiet - let the rest level follow any drift and re-arm
+  
+  if (abs(xfExcursion) < AUTO_MIN_PEAK)
   {
+    zpsExcursion->sfRest += xfExcursion * AUTO_REST_RATE;
+    zpsExcursion->sbArmed = true;
     
-    // Find the differential
-    
-    xfWeight = Direction__msUpDown.sfDeltaVoltage;
-                   
-    // Convert to a "weight" which will be >1 if the detection is over
-    // the threshold.
-    
-    xfWeight = xfWeight / Direction__mafThreshold[DIRECTION_UP];  
+    if (zpsExcursion->sfPeak == 0.0f)
+    {
+      return;
+    }
   }
   
-  // If the current is less than the previous, we are dealing with a
-  // possible down.
+  // Only one peak is taken per excursion. Wait for the return to rest.
   
-  else
+  if (!zpsExcursion->sbArmed)
   {
-    
-    // Find the differential
-    
-    xfWeight = Direction__msUpDown.sfDeltaVoltage;
-                   
-    // Convert to a "weight" which will be >1 if the detection is over
-    // the threshold.
-    
-    xfWeight = xfWeight / Direction__mafThreshold[DIRECTION_DOWN];
+    return;
   }
   
-  // Ignore states
+  // Keep following the excursion while it grows
   
-  if (abs(xfWeight) > 2.5)
+  if (abs(xfExcursion) > abs(zpsExcursion->sfPeak))
   {
-    xfWeight = 0;
+    zpsExcursion->sfPeak = xfExcursion;
+    return;
   }
   
-  // Return the result
+  // Once it has fallen back through half of its peak, the excursion is
+  // over. Learn from it and wait for the channel to settle.
   
-  return xfWeight;
+  if (abs(xfExcursion) < (abs(zpsExcursion->sfPeak) * 0.5f))
+  {
+    if (zpsExcursion->sfPeak >= 0.0f)
+    {
+      Direction__AutoLearn(zePos, zpsExcursion->sfPeak);
+    }
+    else
+    {
+      Direction__AutoLearn(zeNeg, -zpsExcursion->sfPeak);
+    }
+    
+    zpsExcursion->sfPeak = 0.0f;
+    zpsExcursion->sbArmed = false;
+  }
 }
 
 /******************************************************************************
 *
-*    /name       Direction__WeightLeftRight
+*    /name       Direction__AutoLearn
 *
-*    /purpose    Returns a weight for the detection status of the channel. A
-*                value greater than 1 (positive or negative) indicates a
-*                detection. Negative weights correspond to LEFT and positive
-*                weights correspond to RIGHT.
+*    /purpose    Adds an excursion peak to the direction's clusters. The
+*                nearer of the noise and saccade centres moves toward the
+*                peak. Once enough saccades have been seen the threshold is
+*                placed between the two centres.
 *
-*    /ret        float    Current weighted detection status
+*    /param[in]  zeDir     Direction of the excursion
+*    /param[in]  zfPeak    Peak magnitude, in Volts
+*
+*    /ret        void
 *
 ******************************************************************************/
-static float Direction__WeightLeftRight()
+static void Direction__AutoLearn(Direction_t zeDir, float zfPeak)
 {
-  float xfWeight = 0.0f;
+  Direction_Cluster_t *xpsCluster = &Direction__masCluster[zeDir];
   
-  // If the current is greater than the previous, we are dealing with a
-  // possible RIGHT. Since it is irrelevant where we include the "equal" case,
-  // we'll put it here.
+  // Update the nearer centre
   
-  if (Direction__msLeftRight.sfDeltaVoltage  >= 0.0)
+  if (abs(zfPeak - xpsCluster->sfLow) < abs(zfPeak - xpsCluster->sfHigh))
   {
-    
-    // Find the differential
-    
-    xfWeight = Direction__msLeftRight.sfDeltaVoltage;
-                   
-    // Convert to a "weight" which will be >1 if the detection is over
-    // the threshold.
-    
-    xfWeight = xfWeight / Direction__mafThreshold[DIRECTION_RIGHT];  
+    xpsCluster->sfLow += (zfPeak - xpsCluster->sfLow) * AUTO_LEARN_RATE;
   }
-  
-  // If the current is less than the previous, we are dealing with a
-  // possible LEFT.
-  
   else
   {
+    xpsCluster->sfHigh += (zfPeak - xpsCluster->sfHigh) * AUTO_LEARN_RATE;
     
-    // Find the differential
-    
-    xfWeight = Direction__msLeftRight.sfDeltaVoltage;
-                   
-    // Convert to a "weight" which will be >1 if the detection is over
-    // the threshold.
-    
-    xfWeight = xfWeight / Direction__mafThreshold[DIRECTION_LEFT]; 
+    if (xpsCluster->suwCount < AUTO_MIN_SACCADES)
+    {
+      xpsCluster->suwCount++;
+    }
   }
   
-  // Ignore spikes
+  // Don't move the threshold until there is enough evidence
   
-  if (abs(xfWeight) > 2.5)
+  if (xpsCluster->suwCount < AUTO_MIN_SACCADES)
   {
-    xfWeight = 0;
+    return;
   }
   
-  // Return the result
+  // Place the threshold between the centres, scaled the same way as a 
+  // calibrated threshold
   
-  return xfWeight;
+  Direction__mafThreshold[zeDir] = xpsCluster->sfLow + 
+            (xpsCluster->sfHigh - xpsCluster->sfLow) * Direction__mfScaleDown;
+  
+  #if DEBUG
+     Serial.print(Direction__manSerialChars[zeDir]);
+     Serial.print(" Threshold learned: ");
+     Serial.print(Direction__mafThreshold[zeDir], 4);
+     
+     Serial.print("\r\n");
+  #endif
 }
 
 /******************************************************************************
 *
-*    /name       Direction__SetState
+*    /name       Direction_GetState
 *
-*    /purpose    Sets a the direction state. Updates the delta required to
-*                return to the idle state.
+*    /purpose    Return the current state.
+*
+*    /ret        Direction_t    The current state
+*
+******************************************************************************/
+Direction_t Direction_GetState()
+{
+  
+  // Simply return the value of the state variable
+  
+  return Direction__meState;
+}
+
+/******************************************************************************
+*
+*    /name       Direction_BroadcastState
+*
+*    /purpose    Broadcasts the current state variable to the serial port.
+*                DIRECTION_NONE       = "i\r\n"
+*                DIRECTION_UP         = "u\r\n"
+*                DIRECTION_DOWN       = "d\r\n"
+*                DIRECTION_LEFT       = "l\r\n"
+*                DIRECTION_RIGHT      = "r\r\n"     
+*                DIRECTION_UP_LEFT    = "ul\r\n"
+*                DIRECTION_UP_RIGHT   = "ur\r\n"
+*                DIRECTION_DOWN_LEFT  = "dl\r\n"
+*                DIRECTION_DOWN_RIGHT = "dr\r\n"
+*
+*                In the extended ASCII format the string is followed by the
+*                weight, the peak delta (Volts), the sample time (ms) and
+*                the shared sequence number: "u 1.42 0.0812 123456 17\r\n".
+*
+*                In the binary format a frame of type 'E' is sent:
+*                  <direction, byte> <weight, int16 LE Q8> 
+*                  <peak delta, int16 LE counts> <time, uint32 LE ms>
+*                  <sequence, uint16 LE>
+*
+*                On a return to idle the weight is 0 and the peak is that
+*                of the detection that ended.
 *
 *    /ret        void
 *
 ******************************************************************************/
-static void Direction__SetState(Direction_t zeDir)
+void Direction_BroadcastState()
 {
+  byte xaucFrame[11];
+  long xlWeight, xlPeak;
+  unsigned int xuwSeq;
   
-  // Set the delta accordingly, stored in the DIRECTION_NONE entry of
-  // the Direction__mafThreshold array.
+  // Plain format, send the apropriate character, with the sequence number
+  // in sequenced mode. Using println for the automatic \r\n.
   
-  if (zeDir == DIRECTION_NONE)
+  if (Direction__mwEventFormat == EVENT_PLAIN)
   {
-   
-    // Clear entry to 0
+    if (Command_IsSequenced())
+    {
+      Serial.print(Direction__manSerialChars[Direction__meState]);
+      Serial.print(' ');
+      Serial.println(Command_NextSeq());
+    }
+    else
+    {
+      Serial.println(Direction__manSerialChars[Direction__meState]);
+    }
+    
+    return;
+  }
+  
+  xuwSeq = Command_NextSeq();
   
-    Direction__mafThreshold[DIRECTION_NONE] = 0;
+  if (Direction__mwEventFormat == EVENT_ASCII)
+  {
+    Serial.print(Direction__manSerialChars[Direction__meState]);
+    Serial.print(' ');
+    Serial.print(Direction__mfWeight, 2);
+    Serial.print(' ');
+    Serial.print(Direction__mfPeakDelta, 4);
+    Serial.print(' ');
+    Serial.print(Direction__mulSampleTime);
+    Serial.print(' ');
+    Serial.println(xuwSeq);
+    return;
   }
-  else
+  
+  // Binary frame, fixed point and saturated to 16 bits
+  
+  xlWeight = constrain((long)(Direction__mfWeight * 256.0f), 0L, 32767L);
+  xlPeak = constrain((long)(Direction__mfPeakDelta / Analog_CountsToVolts(1)),
+                     0L, 32767L);
+  
+  xaucFrame[0] = (byte)Direction__meState;
+  xaucFrame[1] = (byte)xlWeight;
+  xaucFrame[2] = (byte)(xlWeight >> 8);
+  xaucFrame[3] = (byte)xlPeak;
+  xaucFrame[4] = (byte)(xlPeak >> 8);
+  xaucFrame[5] = (byte)Direction__mulSampleTime;
+  xaucFrame[6] = (byte)(Direction__mulSampleTime >> 8);
+  xaucFrame[7] = (byte)(Direction__mulSampleTime >> 16);
+  xaucFrame[8] = (byte)(Direction__mulSampleTime >> 24);
+  xaucFrame[9] = (byte)xuwSeq;
+  xaucFrame[10] = (byte)(xuwSeq >> 8);
+  
+  Command_SendFrame(EVENT_FRAME_TYPE, xaucFrame, sizeof(xaucFrame));
+}
+
+/******************************************************************************
+*
+*    /name       Direction_GetEstimate
+*
+*    /purpose    Returns the current position and velocity estimate of an
+*                axis. These are the Kalman estimates when the filter is
+*                enabled, otherwise the latest reading and filtered velocity.
+*
+*    /param[in]  zeAxis         Axis to read
+*    /param[out] zpfVoltage     Position, in Volts
+*    /param[out] zpfVelocity    Velocity, in Volts per sample
+*
+*    /ret        void
+*
+******************************************************************************/
+void Direction_GetEstimate(Direction_Axis_t zeAxis, float *zpfVoltage,
+                           float *zpfVelocity)
+{
+  Direction_Channel_t *xpsChannel;
+  
+  // Filter estimates
+  
+  if (Direction__mbKalman)
   {
-    
-    // Update to match current state. This may be removed, but for now
-    // we set it again here as we may need to adjust the delta as
-    // the use time progresses and the voltage drifts.
-    
-    Direction__mafThreshold[DIRECTION_NONE] = 
-                              Direction__mafThreshold[zeDir];    
+    *zpfVoltage = 
+         Analog_CountsToVolts(Direction__masKalman[zeAxis].slPos) / 256.0f;
+    *zpfVelocity = 
+         Analog_CountsToVolts(Direction__masKalman[zeAxis].slVel) / 256.0f;
+    return;
   }
   
-  // Finally update the state variable
+  // Channel readings
   
-  Direction__meState = zeDir;
+  if (zeAxis == DIRECTION_AXIS_UPDOWN)
+  {
+    xpsChannel = &Direction__msUpDown;
+  }
+  else
+  {
+    xpsChannel = &Direction__msLeftRight;
+  }
   
-  Direction_BroadcastState();
+  *zpfVoltage = xpsChannel->sfCurrVoltage;
+  *zpfVelocity = Analog_CountsToVolts(xpsChannel->slVelocity) / 256.0f;
 }
 
 /******************************************************************************
 *
-*    /name       Direction_GetState
+*    /name       Direction_GetSpan
 *
-*    /purpose    Return the current state.
+*    /purpose    Gets the resting voltage of an axis and the calibrated spans
+*                either side of it, without copying the whole calibration.
 *
-*    /ret        Direction_t    The current state
+*    /param[in]  zeAxis        Axis to get
+*    /param[out] zpfResting    Resting voltage
+*    /param[out] zpfLow        Span below rest (down or left), in Volts
+*    /param[out] zpfHigh       Span above rest (up or right), in Volts
+*
+*    /ret        void
 *
 ******************************************************************************/
-Direction_t Direction_GetState()
+void Direction_GetSpan(Direction_Axis_t zeAxis, float *zpfResting,
+                       float *zpfLow, float *zpfHigh)
+{
+  if (zeAxis == DIRECTION_AXIS_UPDOWN)
+  {
+    *zpfResting = Direction__mfUpDownResting;
+    *zpfLow = Direction__mafSpan[DIRECTION_DOWN];
+    *zpfHigh = Direction__mafSpan[DIRECTION_UP];
+  }
+  else
+  {
+    *zpfResting = Direction__mfLeftRightResting;
+    *zpfLow = Direction__mafSpan[DIRECTION_LEFT];
+    *zpfHigh = Direction__mafSpan[DIRECTION_RIGHT];
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Direction_GetCalibration
+*
+*    /purpose    Copies the current resting voltages and detection thresholds
+*                into the given structure, with the calibrated thresholds
+*                the adaptation is bounded by.
+*
+*    /param[out] zpsCal    Calibration structure to fill
+*
+*    /ret        void
+*
+******************************************************************************/
+void Direction_GetCalibration(Direction_Cal_t *zpsCal)
+{
+
+  // Copy out the resting voltages
+
+  zpsCal->sfUpDownResting = Direction__mfUpDownResting;
+  zpsCal->sfLeftRightResting = Direction__mfLeftRightResting;
+  zpsCal->slUpDownNoise = Direction__mlUpDownNoise;
+  zpsCal->slLeftRightNoise = Direction__mlLeftRightNoise;
+  zpsCal->swNoisePeriod = Direction__mwNoisePeriod;
+
+  // Copy out the thresholds
+
+  for (int i=0; i<DIRECTION_NUM_CARDINAL; i++)
+  {
+    zpsCal->safThreshold[i] = Direction__mafThreshold[i];
+    zpsCal->safCalThreshold[i] = Direction__mafCalThreshold[i];
+    zpsCal->safSpan[i] = Direction__mafSpan[i];
+    zpsCal->safLeak[i] = Direction__mafLeak[i];
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Direction_SetCalibration
+*
+*    /purpose    Loads the resting voltages and detection thresholds from the
+*                given structure. The DIRECTION_NONE entry is the transient
+*                return-to-idle delta and is left alone.
+*
+*    /param[in]  zpsCal    Calibration structure to load
+*
+*    /ret        void
+*
+******************************************************************************/
+void Direction_SetCalibration(const Direction_Cal_t *zpsCal)
 {
+
+  // Load the resting voltages
+
+  Direction__mfUpDownResting = zpsCal->sfUpDownResting;
+  Direction__mfLeftRightResting = zpsCal->sfLeftRightResting;
+  Direction__mlUpDownNoise = zpsCal->slUpDownNoise;
+  Direction__mlLeftRightNoise = zpsCal->slLeftRightNoise;
+  Direction__mwNoisePeriod = zpsCal->swNoisePeriod;
+  Direction__UpdateNoiseScale();
+
+  // Load the thresholds, skipping the idle entry
+
+  for (int i=DIRECTION_UP; i<DIRECTION_NUM_CARDINAL; i++)
+  {
+    Direction__mafThreshold[i] = zpsCal->safThreshold[i];
+    Direction__mafCalThreshold[i] = zpsCal->safCalThreshold[i];
+    Direction__mafSpan[i] = zpsCal->safSpan[i];
+    Direction__mafLeak[i] = zpsCal->safLeak[i];
+  }
+  
+  // The filters are tuned and the axes separated from the calibration
   
-  // Simply return the value of the state variable
+  Direction__mbKalmanStale = true;
   
-  return Direction__meState;
+  Direction__UpdateUnmix();
 }
 
 /******************************************************************************
 *
-*    /name       Direction_BroadcastState
+*    /name       Direction_SetPeriod
 *
-*    /purpose    Broadcasts the current state variable to the serial port.
-*                DIRECTION_NONE  = "i\r\n"
-*                DIRECTION_UP    = "u\r\n"
-*                DIRECTION_DOWN  = "d\r\n"
-*                DIRECTION_LEFT  = "l\r\n"
-*                DIRECTION_RIGHT = "r\r\n"     
+*    /purpose    Sets the period Direction_Update is called at. Settings that
+*                depend on it are worked out again when it changes.
+*
+*    /param[in]  zwPeriod    Update period, in ms
 *
 *    /ret        void
 *
 ******************************************************************************/
-void Direction_BroadcastState()
+void Direction_SetPeriod(int zwPeriod)
 {
+  if (zwPeriod == Direction__mwPeriod)
+  {
+    return;
+  }
   
-  // Send the apropriate character. Using println for the automatic
-  // \r\n.
+  Direction__mwPeriod = zwPeriod;
   
-  Serial.println(Direction__manSerialChars[Direction__meState]);
+  Direction__UpdateNoiseScale();
+  
+#if DIRECTION_DETECT_TEMPLATE
+  Template_SetPeriod(zwPeriod);
+#endif
+  
+#if DIRECTION_DETECT_EMA
+  Ema_SetPeriod(zwPeriod);
+#endif
 }
 
 
@@ -551,29 +2908,36 @@ void Direction_BroadcastState()
 
 static void Cmd__Idle(String znArg)
 {
-   Direction__mfUpDownResting = 0.0;
-   Direction__mfLeftRightResting = 0.0;
+   float xfUpDown, xfLeftRight;
+   signed long xlUpDownNoise, xlLeftRightNoise;
    
    // Delay so eyes are settled
    
-   delay(5000);
-   
-   // First update the analog readings
-  
-   Analog_Update();
+   delay(CAPTURE_SETTLE_MS);
    
-   // Set the Idle voltages for both the Horizontal and Vertical Circuits
-   // Sample every half second for 3 seconds.
+   // Capture the Idle voltages for both the Horizontal and Vertical Circuits
    
-   for (int i=0; i<6; i++)
+   if (!Direction__Capture(VERTICAL, &xfUpDown, &xlUpDownNoise) ||
+       !Direction__Capture(HORIZONTAL, &xfLeftRight, &xlLeftRightNoise))
    {
-     Direction__mfUpDownResting += Analog_ReadVolts(VERTICAL);
-     Direction__mfLeftRightResting += Analog_ReadVolts(HORIZONTAL);
-    
-    delay(500);
-   } 
-   Direction__mfUpDownResting /= 6.0;
-   Direction__mfLeftRightResting /= 6.0;
+     Serial.println("Bad reading! Unstable!");
+     
+     Command_Reply(false);
+     return;
+   }
+   
+   Direction__mfUpDownResting = xfUpDown;
+   Direction__mfLeftRightResting = xfLeftRight;
+   Direction__mlUpDownNoise = xlUpDownNoise;
+   Direction__mlLeftRightNoise = xlLeftRightNoise;
+   Direction__mwNoisePeriod = (int)((Direction__NoiseLag() * 
+                                     (long)CAPTURE_INTERVAL_US) / 1000L);
+   Direction__UpdateNoiseScale();
+   Direction__mbKalmanStale = true;
+   
+   // The crosstalk compensation works around the resting levels
+   
+   Direction__UpdateUnmix();
    
    #if DEBUG
       Serial.print("VER IDLE Threshold set to: ");
@@ -585,7 +2949,7 @@ static void Cmd__Idle(String znArg)
       Serial.print("\r\n");  
    #endif
    
-   Serial.print("1\r\n");
+   Command_Reply(true);
 }
 
 /******************************************************************************
@@ -600,53 +2964,12 @@ static void Cmd__Idle(String znArg)
 
 static void Cmd__Up(String znArg)
 {
-   float xfVoltage = 0.0;
-   
-   // Delay so eyes are settled
-   
-   delay(5000);
-  
-   // First update the analog readings
-  
-   Analog_Update();
    
    // Read the current voltage, known UP due to application instructions
-   // Sample every half second for 3 seconds.
-   
-   for (int i=0; i<6; i++)
-   {
-     xfVoltage += Analog_ReadVolts(VERTICAL);
-    
-    delay(500);
-   } 
-   xfVoltage /= 6.0;
-   
-   // Set the threshold to the positive differential between the current
-   // reading and the known idle reading and scale down by the scale factor.
-  
-   Direction__mafThreshold[DIRECTION_UP] = 
-          abs(xfVoltage - Direction__mfUpDownResting) * THRESHOLD_SCALEDOWN;
-          
-   // Check for bad threshold
-   
-   if (Direction__mafThreshold[DIRECTION_UP] == 0)
-   {
-     Serial.println("Bad reading! 0V!");
-     
-     Serial.print("0\r\n");
-     return;
-   }
-          
-   // DEBUG - Print the setting
-   
-   #if DEBUG
-         Serial.print("UP Threshold set to: ");
-         Serial.print(Direction__mafThreshold[DIRECTION_UP], 4);
-  
-         Serial.print("\r\n");  
-   #endif
    
-   Serial.print("1\r\n");
+   Direction__CalibrateThreshold(DIRECTION_UP, VERTICAL, 
+                                 Direction__mfUpDownResting,
+                                 HORIZONTAL, Direction__mfLeftRightResting);
 }
 
 /******************************************************************************
@@ -661,54 +2984,12 @@ static void Cmd__Up(String znArg)
 
 static void Cmd__Down(String znArg)
 {
-   float xfVoltage = 0.0;
-  
-   // Delay so eyes are settled
-   
-   delay(5000);
-   
-   // First update the analog readings
-  
-   Analog_Update();
    
    // Read the current voltage, known DOWN due to application instructions
-   // Sample every half second for 3 seconds.
-   
-   for (int i=0; i<6; i++)
-   {
-     xfVoltage += Analog_ReadVolts(VERTICAL);
-    
-    delay(500);
-   } 
-   xfVoltage /= 6.0;
-   
-   
-   // Set the threshold to the positive differential between the current
-   // reading and the known idle reading and scale down by the scale factor.
-  
-   Direction__mafThreshold[DIRECTION_DOWN] = 
-          abs(xfVoltage - Direction__mfUpDownResting) * THRESHOLD_SCALEDOWN;
-          
-   // Check for bad threshold
    
-   if (Direction__mafThreshold[DIRECTION_DOWN] == 0)
-   {
-     Serial.println("Bad reading! 0V!");
-     
-     Serial.print("0\r\n");
-     return;
-   }
-          
-   // DEBUG - Print the setting
-   
-   #if DEBUG
-         Serial.print("DOWN Threshold set to: ");
-         Serial.print(Direction__mafThreshold[DIRECTION_DOWN], 4);
-  
-         Serial.print("\r\n");  
-   #endif
-   
-   Serial.print("1\r\n");
+   Direction__CalibrateThreshold(DIRECTION_DOWN, VERTICAL, 
+                                 Direction__mfUpDownResting,
+                                 HORIZONTAL, Direction__mfLeftRightResting);
 }
 
 /******************************************************************************
@@ -723,54 +3004,12 @@ static void Cmd__Down(String znArg)
 
 static void Cmd__Left(String znArg)
 {
-   float xfVoltage = 0.0;
-  
-   // Delay so eyes are settled
-   
-   delay(5000);
-  
-   // First update the analog readings
-  
-   Analog_Update();
-   
-   // Read the current voltage, known DOWN due to application instructions
-   // Sample every half second for 3 seconds.
-   
-   for (int i=0; i<6; i++)
-   {
-     xfVoltage += Analog_ReadVolts(HORIZONTAL);
-    
-    delay(500);
-   } 
-   xfVoltage /= 6.0;
-   
-   
-   // Set the threshold to the positive differential between the current
-   // reading and the known idle reading and scale down by the scale factor.
-  
-   Direction__mafThreshold[DIRECTION_LEFT] = 
-          abs(xfVoltage - Direction__mfLeftRightResting) * THRESHOLD_SCALEDOWN;
-          
-   // Check for bad threshold
-   
-   if (Direction__mafThreshold[DIRECTION_LEFT] == 0)
-   {
-     Serial.println("Bad reading! 0V!");
-     
-     Serial.print("0\r\n");
-     return;
-   }
-          
-   // DEBUG - Print the setting
    
-   #if DEBUG
-         Serial.print("LEFT Threshold set to: ");
-         Serial.print(Direction__mafThreshold[DIRECTION_LEFT], 4);
-  
-         Serial.print("\r\n");  
-   #endif
+   // Read the current voltage, known LEFT due to application instructions
    
-   Serial.print("1\r\n");
+   Direction__CalibrateThreshold(DIRECTION_LEFT, HORIZONTAL, 
+                                 Direction__mfLeftRightResting,
+                                 VERTICAL, Direction__mfUpDownResting);
 }
 
 /******************************************************************************
@@ -785,53 +3024,12 @@ static void Cmd__Left(String znArg)
 
 static void Cmd__Right(String znArg)
 {
-   float xfVoltage = 0.0;
-   
-   // Delay so eyes are settled
-   
-   delay(5000);
-  
-   // First update the analog readings
-  
-   Analog_Update();
-   
-   // Read the current voltage, known DOWN due to application instructions
-   // Sample every half second for 3 seconds.
-   
-   for (int i=0; i<6; i++)
-   {
-     xfVoltage += Analog_ReadVolts(HORIZONTAL);
-    
-    delay(500);
-   } 
-   xfVoltage /= 6.0;
-   
-   // Set the threshold to the positive differential between the current
-   // reading and the known idle reading and scale down by the scale factor.
-  
-   Direction__mafThreshold[DIRECTION_RIGHT] = 
-          abs(xfVoltage - Direction__mfLeftRightResting) * THRESHOLD_SCALEDOWN;
-          
-   // Check for bad threshold
-   
-   if (Direction__mafThreshold[DIRECTION_RIGHT] == 0)
-   {
-     Serial.println("Bad reading! 0V!");
-     
-     Serial.print("0\r\n");
-     return;
-   }
-          
-   // DEBUG - Print the setting
    
-   #if DEBUG
-         Serial.print("RIGHT Threshold set to: ");
-         Serial.print(Direction__mafThreshold[DIRECTION_RIGHT], 4);
-  
-         Serial.print("\r\n");  
-   #endif
+   // Read the current voltage, known RIGHT due to application instructions
    
-   Serial.print("1\r\n");
+   Direction__CalibrateThreshold(DIRECTION_RIGHT, HORIZONTAL, 
+                                 Direction__mfLeftRightResting,
+                                 VERTICAL, Direction__mfUpDownResting);
 }
 
 /******************************************************************************
@@ -853,16 +3051,208 @@ static void Cmd__Clear(String znArg)
   // The initial mode should always be looking straight ahead. Set both 
   // channels and direction state accordingly.
   
-  Analog_Update();
+  Direction__ResetChannels();
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Auto
+*
+*    /purpose    Enable ("1") or disable ("0") auto-calibration. Enabling 
+*                seeds any missing thresholds and lets detection run without
+*                the calibration sequence. Disabling keeps the thresholds
+*                learned so far.
+*
+*    /ret        void
+*
+******************************************************************************/
+
+static void Cmd__Auto(String znArg)
+{
+  if (znArg.toInt() != 0)
+  {
+    
+    // Start learning and mark the calibration as usable
+    
+    Direction__AutoSeed();
+    
+    Direction__mbAutoCal = true;
+    
+    Calibration_SetState(CALIBRATION_OK);
+  }
+  else
+  {
+    Direction__mbAutoCal = false;
+  }
   
-  Direction__msUpDown.sfCurrVoltage = Analog_ReadVolts(VERTICAL);
-  Direction__msUpDown.sfPrevVoltage = Analog_ReadVolts(VERTICAL);
-  Direction__msUpDown.sfDeltaVoltage = 0;
+  Command_Reply(true);
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Adapt
+*
+*    /purpose    Enable ("1") or disable ("0") threshold adaptation
+*
+*    /ret        void
+*
+******************************************************************************/
+
+static void Cmd__Adapt(String znArg)
+{
   
-  Direction__msLeftRight.sfCurrVoltage = Analog_ReadVolts(HORIZONTAL);
-  Direction__msLeftRight.sfPrevVoltage = Analog_ReadVolts(HORIZONTAL);
-  Direction__msLeftRight.sfDeltaVoltage = 0;
+  // Set the adaptation flag
   
-  Direction__meState = DIRECTION_NONE;
+  Direction__mbAdapt = (znArg.toInt() != 0);
+  
+  Command_Reply(true);
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Rollback
+*
+*    /purpose    Restore the calibrated thresholds, dropping any adaptation
+*
+*    /ret        void
+*
+******************************************************************************/
+
+static void Cmd__Rollback(String znArg)
+{
+  
+  // Copy back any calibrated thresholds
+  
+  for (int i=DIRECTION_UP; i<DIRECTION_NUM_CARDINAL; i++)
+  {
+    if (Direction__mafCalThreshold[i] != 0)
+    {
+      Direction__mafThreshold[i] = Direction__mafCalThreshold[i];
+    }
+  }
+  
+  Command_Reply(true);
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Event
+*
+*    /purpose    Select the event format: 0 plain, 1 extended ASCII, 
+*                2 binary frames. See Direction_BroadcastState.
+*
+*    /ret        void
+*
+******************************************************************************/
+
+static void Cmd__Event(String znArg)
+{
+  long xlFormat;
+  
+  // Check the format
+  
+  if (!Command_ArgLong(znArg, 0, &xlFormat) || 
+      (xlFormat < EVENT_PLAIN) || (xlFormat > EVENT_BINARY))
+  {
+    Command_Reply(false);
+    return;
+  }
+  
+  // Acknowledge in the old format
+  
+  Command_Reply(true);
+  
+  Direction__mwEventFormat = xlFormat;
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Leak
+*
+*    /purpose    Print the crosstalk measured at calibration, the leak of
+*                each direction ("u d l r") followed by the unmixing matrix
+*                row by row, scaled to 1.
+*
+*    /ret        void
+*
+******************************************************************************/
+
+static void Cmd__Leak(String znArg)
+{
+  
+  for (int i=DIRECTION_UP; i<DIRECTION_NUM_CARDINAL; i++)
+  {
+    Serial.print(Direction__mafLeak[i], 4);
+    Serial.print(' ');
+  }
+  
+  for (int i=0; i<DIRECTION_NUM_AXES; i++)
+  {
+    for (int j=0; j<DIRECTION_NUM_AXES; j++)
+    {
+      Serial.print((float)Direction__maalUnmix[i][j] / (1L << XTALK_SHIFT), 4);
+      
+      if ((i < DIRECTION_NUM_AXES - 1) || (j < DIRECTION_NUM_AXES - 1))
+      {
+        Serial.print(' ');
+      }
+    }
+  }
+  
+  Serial.println();
 }
 
+/******************************************************************************
+*
+*    /name       Cmd__Detector
+*
+*    /purpose    With a name, switch to that detection strategy. The switch
+*                restarts the channels, so detection starts again from idle.
+*                With no argument, print the strategies in the build, the
+*                running one marked with a '*'. The detector param selects
+*                the same strategies by their position in this list.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Detector(String znArg)
+{
+  
+  // Switch
+  
+  if (znArg.length() > 0)
+  {
+    for (int i=0; i<DIRECTION_NUM_DETECTORS; i++)
+    {
+      if (znArg == Direction__masDetectors[i].spcName)
+      {
+        Direction__SelectDetector(i);
+        
+        Command_Reply(true);
+        return;
+      }
+    }
+    
+    Command_Reply(false);
+    return;
+  }
+  
+  // List
+  
+  for (int i=0; i<DIRECTION_NUM_DETECTORS; i++)
+  {
+    if (i == Direction__mwActiveDetector)
+    {
+      Serial.print('*');
+    }
+    
+    Serial.print(Direction__masDetectors[i].spcName);
+    
+    if (i < DIRECTION_NUM_DETECTORS - 1)
+    {
+      Serial.print(' ');
+    }
+  }
+  
+  Serial.println();
+}
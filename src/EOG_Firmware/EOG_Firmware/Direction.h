@@ -13,6 +13,30 @@
 
 // ***** Definitions **********************************************************
 
+// Detection strategies in the build. Any of them can be left out to save
+// flash, e.g. with -DDIRECTION_DETECT_EMA=0, but at least one must be kept.
+
+#ifndef DIRECTION_DETECT_AMPLITUDE
+#define DIRECTION_DETECT_AMPLITUDE   1
+#endif
+
+#ifndef DIRECTION_DETECT_VELOCITY
+#define DIRECTION_DETECT_VELOCITY    1
+#endif
+
+#ifndef DIRECTION_DETECT_TEMPLATE
+#define DIRECTION_DETECT_TEMPLATE    1
+#endif
+
+#ifndef DIRECTION_DETECT_EMA
+#define DIRECTION_DETECT_EMA         1
+#endif
+
+#if !(DIRECTION_DETECT_AMPLITUDE || DIRECTION_DETECT_VELOCITY || \
+      DIRECTION_DETECT_TEMPLATE || DIRECTION_DETECT_EMA)
+#error "No detection strategy in the build"
+#endif
+
 // Different possible directions
 
 typedef enum Direction_e
@@ -23,19 +47,62 @@ typedef enum Direction_e
   DIRECTION_LEFT,
   DIRECTION_RIGHT,
   
+  // Diagonals, only detected when enabled
+  
+  DIRECTION_UP_LEFT,
+  DIRECTION_UP_RIGHT,
+  DIRECTION_DOWN_LEFT,
+  DIRECTION_DOWN_RIGHT,
+  
   DIRECTION_MAX
 } Direction_t;
 
+// Directions with their own threshold - idle and the four cardinal 
+// directions. Diagonals use the thresholds of their two components.
+
+#define DIRECTION_NUM_CARDINAL   (DIRECTION_RIGHT + 1)
+
+// Axes, one per channel
+
+typedef enum Direction_Axis_e
+{
+  DIRECTION_AXIS_UPDOWN,
+  DIRECTION_AXIS_LEFTRIGHT,
+  
+  DIRECTION_NUM_AXES
+} Direction_Axis_t;
+
 // The channel state - contains the current and previous voltage along with the
-// running delta.
+// running delta. The latest count reading and the filtered velocity (Q8 counts
+// per sample) are kept for the velocity detector.
 
 typedef struct Direction_Channel_s
 {
   float       sfCurrVoltage;
   float       sfPrevVoltage;
   float       sfDeltaVoltage;
+  signed long slCurrCounts;
+  signed long slVelocity;
 } Direction_Channel_t;
 
+// Calibration values - everything needed to restore a calibrated detection
+// state without running the calibration sequence again. The thresholds in
+// use and the calibrated ones adaptation is bounded by are kept apart, so
+// adapted drift never becomes the reference.
+
+typedef struct Direction_Cal_s
+{
+  float       sfUpDownResting;
+  float       sfLeftRightResting;
+  float       safThreshold[DIRECTION_NUM_CARDINAL];
+  float       safCalThreshold[DIRECTION_NUM_CARDINAL];
+  float       safSpan[DIRECTION_NUM_CARDINAL];
+  float       safLeak[DIRECTION_NUM_CARDINAL];
+  signed long slUpDownNoise;
+  signed long slLeftRightNoise;
+  int         swNoisePeriod;
+} Direction_Cal_t;
+
 // ***** Function Headers *****************************************************
 
 // Initialization functions
@@ -50,6 +117,16 @@ void Direction_Update();
 
 Direction_t Direction_GetState();
 void Direction_BroadcastState();
+void Direction_GetCalibration(Direction_Cal_t *zpsCal);
+void Direction_GetEstimate(Direction_Axis_t zeAxis, float *zpfVoltage,
+                           float *zpfVelocity);
+void Direction_GetSpan(Direction_Axis_t zeAxis, float *zpfResting,
+                       float *zpfLow, float *zpfHigh);
+
+// Set Functions
+
+void Direction_SetCalibration(const Direction_Cal_t *zpsCal);
+void Direction_SetPeriod(int zwPeriod);
 
 #endif    // !defined _DIRECTION_H
 
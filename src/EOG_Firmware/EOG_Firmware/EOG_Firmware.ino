@@ -14,13 +14,20 @@
 
 #include <Arduino.h>
 #include <SPI.h>
+#include <EEPROM.h>
 
 // Local Modules
 
 #include "Analog.h"
+#include "Artifact.h"
 #include "Command.h"
 #include "Direction.h"
+#include "Ema.h"
 #include "Calibrate.h"
+#include "Param.h"
+#include "Gaze.h"
+#include "Record.h"
+#include "Template.h"
 
 // ***** Local Definitions ****************************************************
 
@@ -31,6 +38,26 @@
 #define HORIZONTAL   ANALOG_CH5
 #define VERTICAL     ANALOG_CH4
 
+// Second ADC shield, in builds with ANALOG_MAX_DEVICES > 1. Its chip select,
+// busy and start lines are moved off the first shield's pins by jumper.
+
+#define ADC2_CHIP_SELECT   9
+#define ADC2_BUSY          2
+#define ADC2_START         6
+#define ADC2_RANGE         ANALOG_10_TO_10
+
+// Default period of the direction update, in ms. Event dwell and refractory
+// counts are in these periods.
+
+#define PERIOD_MS    100
+
+// ***** Local Variables ******************************************************
+
+// Update period and the time of the last update, in ms
+
+static int EOG__mwPeriod = PERIOD_MS;
+static unsigned long EOG__mulLastUpdate;
+
 // ***** Function Definitions *************************************************
 
 /******************************************************************************
@@ -51,6 +78,10 @@ void setup()
   
   Command_Initialize((long)BAUD_RATE);
   
+  // Initialize Param Module - must be before any module adds parameters
+  
+  Param_Initialize();
+  
   // Initialize the calibration module
   
   Calibration_Initialize();
@@ -59,9 +90,49 @@ void setup()
   
   Analog_Initialize(ADC_RANGE);
   
+#if ANALOG_MAX_DEVICES > 1
+  Analog_AddDevice(ADC2_CHIP_SELECT, ADC2_BUSY, ADC2_START, ADC2_RANGE);
+#endif
+  
+  // Initialize the artifact filter
+  
+  Artifact_Initialize();
+  
+  // Initialize the template classifier
+  
+#if DIRECTION_DETECT_TEMPLATE
+  Template_Initialize();
+#endif
+  
+  // Initialize the EMA detector
+  
+#if DIRECTION_DETECT_EMA
+  Ema_Initialize();
+#endif
+  
   // Initialize the direction module
   
   Direction_Initialize();
+  
+  // Initialize the gaze module
+  
+  Gaze_Initialize();
+  
+  // Initialize the flight recorder
+  
+  Record_Initialize();
+  
+  // Register the update period
+  
+  Param_Add("period", PARAM_INT, &EOG__mwPeriod, 2, 1000);
+  
+  Direction_SetPeriod(EOG__mwPeriod);
+  Gaze_SetPeriod(EOG__mwPeriod);
+  
+  // Restore the last saved calibration, if there is a valid one. This lets
+  // detection start immediately instead of waiting on the application.
+  
+  Calibration_Load();
 }
 
 /******************************************************************************
@@ -86,20 +157,37 @@ void loop()
   
   if (Calibration_CheckState())
   {
-    // Update Direction reading
-    
-    Direction_Update();
-    
-    // DEBUG: Long delay for now
+    unsigned long xulNow = millis();
     
-    delay(100);
-  }
-  else
-  {
+    // Update once per period without blocking, so commands are still
+    // handled in between. If updates fell behind, restart the schedule
+    // instead of bursting to catch up.
     
-    delay(10);
+    if ((xulNow - EOG__mulLastUpdate) >= (unsigned long)EOG__mwPeriod)
+    {
+      EOG__mulLastUpdate += EOG__mwPeriod;
+      
+      if ((xulNow - EOG__mulLastUpdate) >= (unsigned long)EOG__mwPeriod)
+      {
+        EOG__mulLastUpdate = xulNow;
+      }
+      
+      // Update Direction reading, at the period in effect
+      
+      Direction_SetPeriod(EOG__mwPeriod);
+      Direction_Update();
+      
+      // Stream the gaze position, if enabled
+      
+      Gaze_SetPeriod(EOG__mwPeriod);
+      Gaze_Update();
+    }
   }
   
+  // Run a queued command, if any
+  
+  Command_Process();
+  
 #else
 
   // Update direction reading
@@ -0,0 +1,480 @@
+/******************************************************************************
+*
+*    /file    Ema.cpp
+*
+*    /desc    The EMA module is the baseline and confirmation detector that
+*             used to be the separate eog_arduino sketch, reworked to run
+*             one step per sample on the readings of the Direction module.
+*
+*             Each axis keeps an exponential moving average of its resting
+*             level, which only follows readings within the tolerance of
+*             it. A reading outside the tolerance starts a confirmation: a
+*             second, faster average is started at the baseline and fed the
+*             following samples. If it crosses the tolerance within the
+*             confirmation count, the movement is confirmed, otherwise it
+*             was noise.
+*
+*             An upward movement is checked for a blink before it is
+*             reported, over the next EMA_BLINK_STEPS sketch steps. A blink
+*             goes several tolerances further up and is not reported.
+*
+*             The sketch's rates and counts are per pass of its loops, which
+*             stepped every 25 ms for the baseline, 50 ms to confirm and 15
+*             ms to confirm an upward movement and check it for a blink. The
+*             tunable values keep those units. They are turned into rates
+*             and counts per sample of the update period, so a rate r per
+*             step of s ms becomes 1 - (1 - r)^(period / s) and the averages
+*             follow the signal at the same speed in time whatever the
+*             period. This is worked out again when the period or a value
+*             changes.
+*
+*             A reported movement holds until its axis is back within the
+*             tolerance of the baseline. The sketch used a fixed delay for
+*             this, the Direction module's refractory count now applies
+*             after the return instead.
+*
+*             The horizontal axis is checked first, and only one movement
+*             is followed at a time, as in the sketch. Volts are positive
+*             up and right, as for the other detectors.
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+// Arduino Source
+
+#include <Arduino.h>
+
+// Local Modules
+
+#include "Direction.h"
+#include "Ema.h"
+#include "Param.h"
+
+// ***** Local Definitions ****************************************************
+
+// Default tuning, from the sketch. The rates are weights per step of the
+// sketch loop they were used in.
+
+#define EMA_ALPHA             0.02f     // Baseline
+#define EMA_BETA              0.3f      // Confirmation, and the blink check
+#define EMA_BLINK_ALPHA       0.08f     // Confirmation of an upward movement
+#define EMA_TOL_VERTICAL      0.5f      // Volts
+#define EMA_TOL_HORIZONTAL    1.0f      // Volts
+#define EMA_BLINK_SCALE       4         // Tolerances up that are a blink
+#define EMA_CONFIRM           20        // Steps to confirm in
+
+// Steps after startup that only train the baselines, and steps an upward
+// movement is checked for a blink
+
+#define EMA_WARMUP            100
+#define EMA_BLINK_STEPS       10
+
+// Step time of the sketch loops, in ms - the main loop, the confirmation
+// loop, and the upward confirmation and blink check loops
+
+#define EMA_STEP_BASE_MS      25
+#define EMA_STEP_CONFIRM_MS   50
+#define EMA_STEP_BLINK_MS     15
+
+// Detector phases
+
+typedef enum Ema_Phase_e
+{
+  EMA_IDLE,
+  EMA_CONFIRM_MOVE,
+  EMA_CHECK_BLINK,
+  EMA_HOLD,
+  EMA_HOLD_BLINK
+} Ema_Phase_t;
+
+// ***** Local Variables ******************************************************
+
+// Tunable values
+
+static float Ema__mfAlpha = EMA_ALPHA;
+static float Ema__mfBeta = EMA_BETA;
+static float Ema__mfBlinkAlpha = EMA_BLINK_ALPHA;
+static float Ema__mafTolerance[DIRECTION_NUM_AXES] =
+                                    {EMA_TOL_VERTICAL, EMA_TOL_HORIZONTAL};
+static int Ema__mwBlinkScale = EMA_BLINK_SCALE;
+static int Ema__mwConfirm = EMA_CONFIRM;
+
+// Update period, in ms, and the tuning worked out for it: rates per sample
+// and counts in samples. The tuned copies of the values tell when they
+// change.
+
+static int Ema__mwPeriod;
+static float Ema__mfSampleAlpha;
+static float Ema__mfSampleBeta;
+static float Ema__mfSampleUpAlpha;
+static float Ema__mfSampleBlinkBeta;
+static int Ema__mwSampleConfirm;
+static int Ema__mwSampleUpConfirm;
+static int Ema__mwSampleWarmup;
+static int Ema__mwSampleBlink;
+static float Ema__mfTunedAlpha;
+static float Ema__mfTunedBeta;
+static float Ema__mfTunedBlinkAlpha;
+static int Ema__mwTunedConfirm;
+
+// Resting level of each axis, Volts
+
+static float Ema__mafAverage[DIRECTION_NUM_AXES];
+
+// Movement being followed - the phase, the axis and its sign, the
+// confirmation average and the samples it has run for
+
+static Ema_Phase_t Ema__mePhase;
+static Direction_Axis_t Ema__meAxis;
+static float Ema__mfSign;
+static float Ema__mfTest;
+static int Ema__mwCount;
+
+// Samples of warm up left
+
+static int Ema__mwWarmup;
+
+// ***** Local Funtions *******************************************************
+
+static Direction_t Ema__Direction();
+static void Ema__Retune();
+static float Ema__Rate(float zfRate, int zwStepMs);
+static int Ema__Samples(int zwSteps, int zwStepMs);
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       Ema_Initialize
+*
+*    /purpose    Registers the tunable values
+*
+*    /ret        void
+*
+******************************************************************************/
+void Ema_Initialize ()
+{
+  Param_Add("ema_alpha", PARAM_FLOAT, &Ema__mfAlpha, 0.0f, 1.0f);
+  Param_Add("ema_beta", PARAM_FLOAT, &Ema__mfBeta, 0.0f, 1.0f);
+  Param_Add("ema_blink_a", PARAM_FLOAT, &Ema__mfBlinkAlpha, 0.0f, 1.0f);
+  Param_Add("ema_tol_v", PARAM_FLOAT,
+            &Ema__mafTolerance[DIRECTION_AXIS_UPDOWN], 0.0f, 10.0f);
+  Param_Add("ema_tol_h", PARAM_FLOAT,
+            &Ema__mafTolerance[DIRECTION_AXIS_LEFTRIGHT], 0.0f, 10.0f);
+  Param_Add("ema_blink_k", PARAM_INT, &Ema__mwBlinkScale, 1, 20);
+  Param_Add("ema_confirm", PARAM_INT, &Ema__mwConfirm, 1, 500);
+}
+
+/******************************************************************************
+*
+*    /name       Ema_Reset
+*
+*    /purpose    Restarts the baselines at the given reading, with no
+*                movement followed. The baselines train for EMA_WARMUP
+*                sketch steps before anything is detected.
+*
+*    /param[in]  zfUpDown       Vertical reading, Volts
+*    /param[in]  zfLeftRight    Horizontal reading, Volts
+*
+*    /ret        void
+*
+******************************************************************************/
+void Ema_Reset (float zfUpDown, float zfLeftRight)
+{
+  Ema__mafAverage[DIRECTION_AXIS_UPDOWN] = zfUpDown;
+  Ema__mafAverage[DIRECTION_AXIS_LEFTRIGHT] = zfLeftRight;
+  
+  Ema__mePhase = EMA_IDLE;
+  Ema__mwWarmup = Ema__mwSampleWarmup;
+}
+
+/******************************************************************************
+*
+*    /name       Ema_Update
+*
+*    /purpose    Runs one sample through the detector.
+*
+*    /param[in]  zfUpDown       Vertical reading, Volts
+*    /param[in]  zfLeftRight    Horizontal reading, Volts
+*    /param[out] zpfWeight      How far the confirmation average got past
+*                               the tolerance, in tolerances. 0 when idle.
+*
+*    /ret        Direction_t    The movement being held, DIRECTION_NONE if
+*                               there is none
+*
+******************************************************************************/
+Direction_t Ema_Update (float zfUpDown, float zfLeftRight, float *zpfWeight)
+{
+  float xafSample[DIRECTION_NUM_AXES] = {zfUpDown, zfLeftRight};
+  float xfSample, xfAverage, xfTolerance, xfRate;
+  int xwConfirm;
+  
+  *zpfWeight = 0.0f;
+  
+  // Work the tuning out again if a value was changed
+  
+  if ((Ema__mfTunedAlpha != Ema__mfAlpha) ||
+      (Ema__mfTunedBeta != Ema__mfBeta) ||
+      (Ema__mfTunedBlinkAlpha != Ema__mfBlinkAlpha) ||
+      (Ema__mwTunedConfirm != Ema__mwConfirm))
+  {
+    Ema__Retune();
+  }
+  
+  // Train the baselines only
+  
+  if (Ema__mwWarmup > 0)
+  {
+    Ema__mwWarmup--;
+  
+    for (int a=0; a < DIRECTION_NUM_AXES; a++)
+    {
+      Ema__mafAverage[a] += (xafSample[a] - Ema__mafAverage[a]) *
+                            Ema__mfSampleAlpha;
+    }
+  
+    return DIRECTION_NONE;
+  }
+  
+  // Idle, look for a reading outside the tolerance. The baseline follows
+  // the readings inside it.
+  
+  if (Ema__mePhase == EMA_IDLE)
+  {
+    const Direction_Axis_t xaeOrder[DIRECTION_NUM_AXES] =
+                        {DIRECTION_AXIS_LEFTRIGHT, DIRECTION_AXIS_UPDOWN};
+  
+    for (int i=0; i < DIRECTION_NUM_AXES; i++)
+    {
+      Direction_Axis_t xeAxis = xaeOrder[i];
+      float xfDelta = xafSample[xeAxis] - Ema__mafAverage[xeAxis];
+  
+      if (abs(xfDelta) > Ema__mafTolerance[xeAxis])
+      {
+        Ema__mePhase = EMA_CONFIRM_MOVE;
+        Ema__meAxis = xeAxis;
+        Ema__mfSign = (xfDelta > 0.0f) ? 1.0f : -1.0f;
+        Ema__mfTest = Ema__mafAverage[xeAxis];
+        Ema__mwCount = 0;
+  
+        return DIRECTION_NONE;
+      }
+  
+      Ema__mafAverage[xeAxis] += xfDelta * Ema__mfSampleAlpha;
+    }
+  
+    return DIRECTION_NONE;
+  }
+  
+  // Following a movement, only its axis matters
+  
+  xfSample = xafSample[Ema__meAxis];
+  xfAverage = Ema__mafAverage[Ema__meAxis];
+  xfTolerance = Ema__mafTolerance[Ema__meAxis];
+  
+  switch (Ema__mePhase)
+  {
+  
+    // Confirm the movement. Upward movements are followed with their own
+    // rate and count, from the shorter sketch loop, so the blink check has
+    // time to run.
+  
+    case EMA_CONFIRM_MOVE:
+    {
+      xfRate = Ema__mfSampleBeta;
+      xwConfirm = Ema__mwSampleConfirm;
+  
+      if (Ema__Direction() == DIRECTION_UP)
+      {
+        xfRate = Ema__mfSampleUpAlpha;
+        xwConfirm = Ema__mwSampleUpConfirm;
+      }
+  
+      Ema__mfTest += (xfSample - Ema__mfTest) * xfRate;
+      Ema__mwCount++;
+  
+      if ((Ema__mfTest - xfAverage) * Ema__mfSign > xfTolerance)
+      {
+  
+        // Confirmed. Check an upward movement for a blink first.
+  
+        if (Ema__Direction() == DIRECTION_UP)
+        {
+          Ema__mePhase = EMA_CHECK_BLINK;
+          Ema__mfTest = xfAverage + xfTolerance;
+          Ema__mwCount = 0;
+  
+          return DIRECTION_NONE;
+        }
+  
+        Ema__mePhase = EMA_HOLD;
+      }
+      else if (Ema__mwCount >= xwConfirm)
+      {
+  
+        // Never confirmed, it was noise
+  
+        Ema__mePhase = EMA_IDLE;
+  
+        return DIRECTION_NONE;
+      }
+  
+      break;
+    }
+  
+    // A blink goes much further up than a look
+  
+    case EMA_CHECK_BLINK:
+    {
+      Ema__mfTest += (xfSample - Ema__mfTest) * Ema__mfSampleBlinkBeta;
+      Ema__mwCount++;
+  
+      if (Ema__mfTest - xfAverage > Ema__mwBlinkScale * xfTolerance)
+      {
+        Ema__mePhase = EMA_HOLD_BLINK;
+      }
+      else if (Ema__mwCount >= Ema__mwSampleBlink)
+      {
+        Ema__mePhase = EMA_HOLD;
+      }
+  
+      break;
+    }
+  
+    default:
+      break;
+  }
+  
+  // A movement or blink holds until its axis is back within the tolerance
+  
+  if (((Ema__mePhase == EMA_HOLD) || (Ema__mePhase == EMA_HOLD_BLINK)) &&
+      (abs(xfSample - xfAverage) <= xfTolerance))
+  {
+    Ema__mePhase = EMA_IDLE;
+  }
+  
+  if (Ema__mePhase != EMA_HOLD)
+  {
+    return DIRECTION_NONE;
+  }
+  
+  *zpfWeight = (Ema__mfTest - xfAverage) * Ema__mfSign / xfTolerance;
+  
+  return Ema__Direction();
+}
+
+/******************************************************************************
+*
+*    /name       Ema__Direction
+*
+*    /purpose    Returns the direction of the movement being followed
+*
+*    /ret        Direction_t    Direction from the axis and sign
+*
+******************************************************************************/
+static Direction_t Ema__Direction()
+{
+  if (Ema__meAxis == DIRECTION_AXIS_UPDOWN)
+  {
+    return (Ema__mfSign > 0.0f) ? DIRECTION_UP : DIRECTION_DOWN;
+  }
+  
+  return (Ema__mfSign > 0.0f) ? DIRECTION_RIGHT : DIRECTION_LEFT;
+}
+
+/******************************************************************************
+*
+*    /name       Ema_SetPeriod
+*
+*    /purpose    Sets the period Ema_Update is called at, and works the
+*                tuning out for it
+*
+*    /param[in]  zwPeriod    Update period, in ms
+*
+*    /ret        void
+*
+******************************************************************************/
+void Ema_SetPeriod (int zwPeriod)
+{
+  Ema__mwPeriod = zwPeriod;
+  
+  Ema__Retune();
+}
+
+/******************************************************************************
+*
+*    /name       Ema__Retune
+*
+*    /purpose    Turns the tunable values, per sketch step, into rates per
+*                sample and counts in samples of the update period. A
+*                movement being followed keeps its count so far.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Ema__Retune()
+{
+  
+  if (Ema__mwPeriod <= 0)
+  {
+    return;
+  }
+  
+  Ema__mfSampleAlpha = Ema__Rate(Ema__mfAlpha, EMA_STEP_BASE_MS);
+  Ema__mfSampleBeta = Ema__Rate(Ema__mfBeta, EMA_STEP_CONFIRM_MS);
+  Ema__mfSampleUpAlpha = Ema__Rate(Ema__mfBlinkAlpha, EMA_STEP_BLINK_MS);
+  Ema__mfSampleBlinkBeta = Ema__Rate(Ema__mfBeta, EMA_STEP_BLINK_MS);
+  
+  Ema__mwSampleConfirm = Ema__Samples(Ema__mwConfirm, EMA_STEP_CONFIRM_MS);
+  Ema__mwSampleUpConfirm = Ema__Samples(Ema__mwConfirm, EMA_STEP_BLINK_MS);
+  Ema__mwSampleWarmup = Ema__Samples(EMA_WARMUP, EMA_STEP_BASE_MS);
+  Ema__mwSampleBlink = Ema__Samples(EMA_BLINK_STEPS, EMA_STEP_BLINK_MS);
+  
+  Ema__mfTunedAlpha = Ema__mfAlpha;
+  Ema__mfTunedBeta = Ema__mfBeta;
+  Ema__mfTunedBlinkAlpha = Ema__mfBlinkAlpha;
+  Ema__mwTunedConfirm = Ema__mwConfirm;
+}
+
+/******************************************************************************
+*
+*    /name       Ema__Rate
+*
+*    /purpose    Returns the rate per sample that moves an average as far in
+*                the same time as the given rate per sketch step
+*
+*    /param[in]  zfRate      Rate per step
+*    /param[in]  zwStepMs    Step time, in ms
+*
+*    /ret        float       Rate per sample, 1 - (1 - rate)^(period / step)
+*
+******************************************************************************/
+static float Ema__Rate(float zfRate, int zwStepMs)
+{
+  
+  return 1.0f - pow(1.0f - zfRate, (float)Ema__mwPeriod / zwStepMs);
+}
+
+/******************************************************************************
+*
+*    /name       Ema__Samples
+*
+*    /purpose    Returns the samples that take as long as the given count of
+*                sketch steps, at least one
+*
+*    /param[in]  zwSteps     Count of steps
+*    /param[in]  zwStepMs    Step time, in ms
+*
+*    /ret        int         Samples, rounded
+*
+******************************************************************************/
+static int Ema__Samples(int zwSteps, int zwStepMs)
+{
+  long xlSamples = ((long)zwSteps * zwStepMs + Ema__mwPeriod / 2) / 
+                   Ema__mwPeriod;
+  
+  return (xlSamples < 1) ? 1 : (int)xlSamples;
+}
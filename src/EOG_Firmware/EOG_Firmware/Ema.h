@@ -0,0 +1,29 @@
+/******************************************************************************
+*
+*    /file    Ema.h
+*
+*    /desc    Header file for Ema module. Include after Direction.h.
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+#ifndef _EMA_H
+#define _EMA_H
+
+// ***** Function Headers *****************************************************
+
+// Initialization functions
+
+void Ema_Initialize ();
+void Ema_Reset (float zfUpDown, float zfLeftRight);
+
+// Set Functions
+
+void Ema_SetPeriod (int zwPeriod);
+
+// Update Functions
+
+Direction_t Ema_Update (float zfUpDown, float zfLeftRight, float *zpfWeight);
+
+#endif    // !defined _EMA_H
@@ -0,0 +1,306 @@
+/******************************************************************************
+*
+*    /file    Gaze.cpp
+*
+*    /desc    The gaze module turns the calibrated horizontal and vertical
+*             voltages into a continuous, normalised 2D gaze position for
+*             proportional cursor control. It sits next to the discrete
+*             directions of the Direction module and uses its estimates and
+*             calibration.
+*
+*             Each axis is mapped piecewise linear from its resting voltage
+*             to the calibrated LEFT/RIGHT and DOWN/UP voltages, giving -1.0
+*             to 1.0. The resting point follows slow drift while the
+*             direction state is idle and the eyes are still.
+*
+*             When enabled, the position is streamed at a fixed rate as a 
+*             binary frame of type 'G'. Frames are sent from the update, so
+*             the rate is at most one frame per update period:
+*               <x, int16 LE> <y, int16 LE> [<seq, uint16 LE>]
+*             in Q15, positive x is RIGHT and positive y is UP. The
+*             sequence number is only sent in sequenced mode.
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+// Arduino Source
+
+#include <Arduino.h>
+
+// Local Modules
+
+#include "Command.h"
+#include "Direction.h"
+#include "Param.h"
+#include "Gaze.h"
+
+// ***** Local Definitions ****************************************************
+
+// Stream frame type
+
+#define GAZE_FRAME_TYPE   'G'
+
+// Fastest stream rate, in Hz
+
+#define GAZE_MAX_RATE     100
+
+// Drift correction. The resting point moves toward the current position at
+// this rate while idle and slower than the still limit (Volts per sample).
+
+#define GAZE_DRIFT_RATE   0.005f
+#define GAZE_STILL_LIMIT  0.002f
+
+// ***** Local Variables ******************************************************
+
+// Stream rate in Hz, 0 is off, and the update period it is sent from, in
+// ms
+
+static int Gaze__mwRate;
+static int Gaze__mwPeriod = 1000 / GAZE_MAX_RATE;
+
+// Time of the last frame, in ms
+
+static unsigned long Gaze__mulLastFrame;
+
+// Drift correction
+
+static float Gaze__mfDriftRate = GAZE_DRIFT_RATE;
+static float Gaze__mfUpDownDrift;
+static float Gaze__mfLeftRightDrift;
+
+// ***** Local Funtions *******************************************************
+
+static int16_t Gaze__Normalise(float zfOffset, float zfNegSpan, 
+                               float zfPosSpan);
+static int Gaze__MaxRate();
+
+// Commands
+
+static void Cmd__Gaze(String znArg);
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       Gaze_Initialize
+*
+*    /purpose    Initializes the gaze module. Streaming starts off.
+*
+*    /ret        void
+*
+******************************************************************************/
+void Gaze_Initialize ()
+{
+  
+  // Streaming is off until requested
+  
+  Gaze__mwRate = 0;
+  Gaze__mulLastFrame = 0;
+  
+  Gaze__mfUpDownDrift = 0.0f;
+  Gaze__mfLeftRightDrift = 0.0f;
+  
+  // Register tunable values and commands
+  
+  Param_Add("gaze_drift", PARAM_FLOAT, &Gaze__mfDriftRate, 0.0f, 1.0f);
+  
+  Command_AddCmd("gaze", Cmd__Gaze);
+}
+
+/******************************************************************************
+*
+*    /name       Gaze_Update
+*
+*    /purpose    Updates the drift correction and sends a frame when one is
+*                due. Meant to be called right after Direction_Update.
+*
+*    /ret        void
+*
+******************************************************************************/
+void Gaze_Update ()
+{
+  float xfUpDown, xfUpDownVel, xfLeftRight, xfLeftRightVel;
+  float xfUpDownRest, xfUpDownLow, xfUpDownHigh;
+  float xfLeftRightRest, xfLeftRightLow, xfLeftRightHigh;
+  float xfUpDownOffset, xfLeftRightOffset;
+  unsigned long xulInterval;
+  int16_t xawFrame[3];
+  
+  // Nothing to do if not streaming
+  
+  if (Gaze__mwRate == 0)
+  {
+    return;
+  }
+  
+  // Offsets from the resting point
+  
+  Direction_GetSpan(DIRECTION_AXIS_UPDOWN, &xfUpDownRest, &xfUpDownLow,
+                    &xfUpDownHigh);
+  Direction_GetSpan(DIRECTION_AXIS_LEFTRIGHT, &xfLeftRightRest, 
+                    &xfLeftRightLow, &xfLeftRightHigh);
+  
+  Direction_GetEstimate(DIRECTION_AXIS_UPDOWN, &xfUpDown, &xfUpDownVel);
+  Direction_GetEstimate(DIRECTION_AXIS_LEFTRIGHT, &xfLeftRight, 
+                        &xfLeftRightVel);
+  
+  xfUpDownOffset = xfUpDown - xfUpDownRest - Gaze__mfUpDownDrift;
+  xfLeftRightOffset = xfLeftRight - xfLeftRightRest - Gaze__mfLeftRightDrift;
+  
+  // Follow drift while looking straight ahead and still
+  
+  if ((Direction_GetState() == DIRECTION_NONE) &&
+      (abs(xfUpDownVel) < GAZE_STILL_LIMIT) &&
+      (abs(xfLeftRightVel) < GAZE_STILL_LIMIT))
+  {
+    Gaze__mfUpDownDrift += xfUpDownOffset * Gaze__mfDriftRate;
+    Gaze__mfLeftRightDrift += xfLeftRightOffset * Gaze__mfDriftRate;
+  }
+  
+  // Check if a frame is due. Keep to the schedule, so a rate that is not
+  // a whole number of periods is still met on average, unless it fell
+  // behind.
+  
+  xulInterval = 1000UL / Gaze__mwRate;
+  
+  if ((millis() - Gaze__mulLastFrame) < xulInterval)
+  {
+    return;
+  }
+  
+  Gaze__mulLastFrame += xulInterval;
+  
+  if ((millis() - Gaze__mulLastFrame) >= xulInterval)
+  {
+    Gaze__mulLastFrame = millis();
+  }
+  
+  // Normalise and send
+  
+  xawFrame[0] = Gaze__Normalise(xfLeftRightOffset, xfLeftRightLow,
+                                xfLeftRightHigh);
+  xawFrame[1] = Gaze__Normalise(xfUpDownOffset, xfUpDownLow, xfUpDownHigh);
+  
+  // The sequence number, in sequenced mode
+  
+  if (Command_IsSequenced())
+  {
+    xawFrame[2] = (int16_t)Command_NextSeq();
+    
+    Command_SendFrame(GAZE_FRAME_TYPE, (const byte *)xawFrame, 
+                      sizeof(xawFrame));
+  }
+  else
+  {
+    Command_SendFrame(GAZE_FRAME_TYPE, (const byte *)xawFrame, 
+                      2 * sizeof(xawFrame[0]));
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Gaze_SetPeriod
+*
+*    /purpose    Sets the period Gaze_Update is called at. A stream rate 
+*                faster than one frame per period is brought down to it.
+*
+*    /param[in]  zwPeriod    Update period, in ms
+*
+*    /ret        void
+*
+******************************************************************************/
+void Gaze_SetPeriod (int zwPeriod)
+{
+  
+  Gaze__mwPeriod = zwPeriod;
+  
+  Gaze__mwRate = min(Gaze__mwRate, Gaze__MaxRate());
+}
+
+/******************************************************************************
+*
+*    /name       Gaze__Normalise
+*
+*    /purpose    Maps an offset from rest onto -1.0 to 1.0 using the span of 
+*                the direction on that side.
+*
+*    /param[in]  zfOffset     Offset from the resting voltage
+*    /param[in]  zfNegSpan    Calibrated span for negative offsets
+*    /param[in]  zfPosSpan    Calibrated span for positive offsets
+*
+*    /ret        int16_t      Normalised position, Q15
+*
+******************************************************************************/
+static int16_t Gaze__Normalise(float zfOffset, float zfNegSpan, 
+                               float zfPosSpan)
+{
+  float xfSpan = (zfOffset < 0.0f) ? zfNegSpan : zfPosSpan;
+  
+  // Uncalibrated side
+  
+  if (xfSpan <= 0.0f)
+  {
+    return 0;
+  }
+  
+  return (int16_t)(constrain(zfOffset / xfSpan, -1.0f, 1.0f) * 32767.0f);
+}
+
+/******************************************************************************
+*
+*    /name       Gaze__MaxRate
+*
+*    /purpose    Returns the fastest stream rate, one frame per update period
+*                up to GAZE_MAX_RATE.
+*
+*    /ret        int    Rate, in Hz
+*
+******************************************************************************/
+static int Gaze__MaxRate()
+{
+  
+  return min(GAZE_MAX_RATE, 1000 / Gaze__mwPeriod);
+}
+
+
+// ***** Command Definitions **************************************************
+
+/******************************************************************************
+*
+*    /name       Cmd__Gaze
+*
+*    /purpose    Set the gaze stream rate in Hz, 0 to stop streaming. Rates
+*                above one frame per update period are refused.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Gaze(String znArg)
+{
+  long xlRate;
+  
+  // Check the rate
+  
+  if (!Command_ArgLong(znArg, 0, &xlRate) || 
+      (xlRate < 0) || (xlRate > Gaze__MaxRate()))
+  {
+    Command_Reply(false);
+    return;
+  }
+  
+  // Restart the drift correction and the schedule when starting
+  
+  if ((Gaze__mwRate == 0) && (xlRate > 0))
+  {
+    Gaze__mfUpDownDrift = 0.0f;
+    Gaze__mfLeftRightDrift = 0.0f;
+    Gaze__mulLastFrame = millis();
+  }
+  
+  Gaze__mwRate = xlRate;
+  
+  Command_Reply(true);
+}
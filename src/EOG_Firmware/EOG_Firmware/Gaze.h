@@ -0,0 +1,28 @@
+/******************************************************************************
+*
+*    /file    Gaze.h
+*
+*    /desc    Header file for Gaze module.
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+#ifndef _GAZE_H
+#define _GAZE_H
+
+// ***** Function Headers *****************************************************
+
+// Initialization functions
+
+void Gaze_Initialize ();
+
+// Update Funtions
+
+void Gaze_Update ();
+
+// Set Functions
+
+void Gaze_SetPeriod (int zwPeriod);
+
+#endif    // !defined _GAZE_H
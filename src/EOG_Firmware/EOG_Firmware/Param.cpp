@@ -0,0 +1,522 @@
+/******************************************************************************
+*
+*    /file    Param.cpp
+*
+*    /desc    The Param module keeps a table of the tunable values used by
+*             the other modules so they can be changed over the Serial port
+*             without rebuilding the firmware.
+*
+*             Each module registers its own parameters at init with a name,
+*             type, allowed range and a pointer to the variable itself. The
+*             module keeps using the variable as normal. Parameters are read
+*             and written with the get/set commands, listed with list and
+*             dumped in one binary blob with pdump.
+*
+*             While a snapshot is open, the old value of each parameter
+*             written is kept so it can be restored, so a batch of commands
+*             that fails part way leaves no parameter half set. Only the
+*             parameters the batch touches are kept, up to
+*             PARAM_UNDO_SIZE of them.
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+// Arduino Source
+
+#include <Arduino.h>
+
+// Local Modules
+
+#include "Command.h"
+#include "Param.h"
+
+// ***** Local Definitions ****************************************************
+
+// Max number of parameters. Sized to the ones the firmware registers with
+// every detector built in, each one costs RAM on the Uno.
+
+#define MAX_NUM_PARAMS   43
+
+// Binary dump frame type
+
+#define PARAM_DUMP_TYPE  'P'
+
+// Number of parameters one snapshot can restore
+
+#define PARAM_UNDO_SIZE  8
+
+// ***** Local Variables ******************************************************
+
+// Parameter Count
+
+static unsigned int Param__muwParamCount;
+
+// Parameter Table
+
+static Param_t Param__masParams[MAX_NUM_PARAMS];
+
+// Open snapshot - whether there is one, and the parameters written since
+// it was taken with their old values
+
+static boolean Param__mbSnapshot;
+static unsigned char Param__mucUndoCount;
+static unsigned char Param__maucUndoIndex[PARAM_UNDO_SIZE];
+static float Param__mafUndoValue[PARAM_UNDO_SIZE];
+
+// ***** Local Funtions *******************************************************
+
+static int Param__GetParam(String znName);
+static float Param__Read(const Param_t *zpsParam);
+static void Param__Write(const Param_t *zpsParam, float zfValue);
+static boolean Param__Keep(int zwIndex);
+
+// Commands
+
+static void Cmd__Get(String znArg);
+static void Cmd__Set(String znArg);
+static void Cmd__List(String znArg);
+static void Cmd__Dump(String znArg);
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       Param_Initialize
+*
+*    /purpose    Clears the parameter table and registers the parameter
+*                commands. Must be run before any module adds parameters.
+*
+*    /ret        void
+*
+******************************************************************************/
+void Param_Initialize()
+{
+  
+  // Clear the parameter table
+  
+  Param__muwParamCount = 0;
+  
+  // Add commands
+  
+  Command_AddCmd("get", Cmd__Get);
+  Command_AddCmd("set", Cmd__Set);
+  Command_AddCmd("list", Cmd__List);
+  Command_AddCmd("pdump", Cmd__Dump);
+}
+
+/******************************************************************************
+*
+*    /name       Param_Add
+*
+*    /purpose    Add the given parameter to the parameter table. Parameters
+*                past the end of the table are dropped.
+*
+*    /param[in]  zpcName     The name of the parameter
+*    /param[in]  zeType      The type of the variable
+*    /param[in]  zpvValue    Pointer to the variable
+*    /param[in]  zfMin       Smallest allowed value
+*    /param[in]  zfMax       Largest allowed value
+*
+*    /ret        void
+*
+******************************************************************************/
+void Param_Add(const char *zpcName, Param_Type_t zeType, void *zpvValue,
+               float zfMin, float zfMax)
+{
+  
+  // Check for room
+  
+  if (Param__muwParamCount >= MAX_NUM_PARAMS)
+  {
+    return;
+  }
+  
+  // Add the parameter, increment the index
+  
+  Param__masParams[Param__muwParamCount] = 
+                    (Param_t){zpcName, zeType, zpvValue, zfMin, zfMax};
+  
+  Param__muwParamCount++;
+}
+
+/******************************************************************************
+*
+*    /name       Param_Snapshot
+*
+*    /purpose    Opens a snapshot. From here the old value of every parameter
+*                written is kept, until Param_Commit or Param_Restore.
+*
+*    /ret        void
+*
+******************************************************************************/
+void Param_Snapshot()
+{
+  
+  Param__mbSnapshot = true;
+  Param__mucUndoCount = 0;
+}
+
+/******************************************************************************
+*
+*    /name       Param_Commit
+*
+*    /purpose    Closes the snapshot, keeping the values written since
+*
+*    /ret        void
+*
+******************************************************************************/
+void Param_Commit()
+{
+  
+  Param__mbSnapshot = false;
+}
+
+/******************************************************************************
+*
+*    /name       Param_Restore
+*
+*    /purpose    Puts every parameter written since the snapshot back to its
+*                old value and closes the snapshot
+*
+*    /ret        void
+*
+******************************************************************************/
+void Param_Restore()
+{
+  
+  for (unsigned char i=0; i<Param__mucUndoCount; i++)
+  {
+    Param__Write(&Param__masParams[Param__maucUndoIndex[i]], 
+                 Param__mafUndoValue[i]);
+  }
+  
+  Param__mbSnapshot = false;
+}
+
+/******************************************************************************
+*
+*    /name       Param__GetParam
+*
+*    /purpose    Searches the parameter table for the given name.
+*
+*    /param[in]  znName    The requested parameter
+*
+*    /ret        int       The index of the parameter, -1 if it was not
+*                          found in the table.
+*
+******************************************************************************/
+static int Param__GetParam(String znName)
+{
+  
+  // Search for the requested parameter
+  
+  for (unsigned int i=0; i<Param__muwParamCount; i++)
+  {
+    if (znName.equals(Param__masParams[i].spcName))
+    {
+      return i;
+    }
+  }
+  
+  return -1;
+}
+
+/******************************************************************************
+*
+*    /name       Param__Read
+*
+*    /purpose    Reads the parameter's variable as a float.
+*
+*    /param[in]  zpsParam    The parameter
+*
+*    /ret        float       The current value
+*
+******************************************************************************/
+static float Param__Read(const Param_t *zpsParam)
+{
+  
+  // Read according to type
+  
+  switch (zpsParam->seType)
+  {
+    case PARAM_FLOAT:
+      return *(float *)zpsParam->spvValue;
+      
+    case PARAM_INT:
+      return *(int *)zpsParam->spvValue;
+      
+    case PARAM_LONG:
+      return *(long *)zpsParam->spvValue;
+      
+    case PARAM_BOOL:
+      return *(boolean *)zpsParam->spvValue ? 1.0f : 0.0f;
+      
+    default:
+      return 0.0f;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Param__Write
+*
+*    /purpose    Writes a float value to the parameter's variable.
+*
+*    /param[in]  zpsParam    The parameter
+*    /param[in]  zfValue     The new value, already range checked
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Param__Write(const Param_t *zpsParam, float zfValue)
+{
+  
+  // Write according to type
+  
+  switch (zpsParam->seType)
+  {
+    case PARAM_FLOAT:
+      *(float *)zpsParam->spvValue = zfValue;
+      break;
+      
+    case PARAM_INT:
+      *(int *)zpsParam->spvValue = (int)zfValue;
+      break;
+      
+    case PARAM_LONG:
+      *(long *)zpsParam->spvValue = (long)zfValue;
+      break;
+      
+    case PARAM_BOOL:
+      *(boolean *)zpsParam->spvValue = (zfValue != 0.0f);
+      break;
+      
+    default:
+      break;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Param__Keep
+*
+*    /purpose    Keeps the value of a parameter about to be written, if a
+*                snapshot is open and it is not kept already.
+*
+*    /param[in]  zwIndex    Index of the parameter
+*
+*    /ret        boolean    false if the snapshot has no room for it
+*
+******************************************************************************/
+static boolean Param__Keep(int zwIndex)
+{
+  
+  if (!Param__mbSnapshot)
+  {
+    return true;
+  }
+  
+  // Kept already
+  
+  for (unsigned char i=0; i<Param__mucUndoCount; i++)
+  {
+    if (Param__maucUndoIndex[i] == zwIndex)
+    {
+      return true;
+    }
+  }
+  
+  if (Param__mucUndoCount >= PARAM_UNDO_SIZE)
+  {
+    return false;
+  }
+  
+  Param__maucUndoIndex[Param__mucUndoCount] = (unsigned char)zwIndex;
+  Param__mafUndoValue[Param__mucUndoCount] = 
+                                   Param__Read(&Param__masParams[zwIndex]);
+  Param__mucUndoCount++;
+  
+  return true;
+}
+
+
+// ***** Command Definitions **************************************************
+
+/******************************************************************************
+*
+*    /name       Cmd__Get
+*
+*    /purpose    Print the value of the named parameter
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Get(String znArg)
+{
+  int xwIndex;
+  
+  // Find the parameter
+  
+  xwIndex = Param__GetParam(znArg);
+  
+  if (xwIndex == -1)
+  {
+    Command_Reply(false);
+    return;
+  }
+  
+  // Print the value, floats with full precision
+  
+  if (Param__masParams[xwIndex].seType == PARAM_FLOAT)
+  {
+    Serial.println(Param__Read(&Param__masParams[xwIndex]), 6);
+  }
+  else
+  {
+    Serial.println((long)Param__Read(&Param__masParams[xwIndex]));
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Set
+*
+*    /purpose    Set one or more parameters. The argument is 
+*                "<name> <value> [<name> <value> ...]". Every value must be
+*                a number within its parameter's range, otherwise nothing is
+*                set. Inside a snapshot, the set also fails if the snapshot
+*                has no room to keep the old values.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Set(String znArg)
+{
+  int xwCount = Command_ArgCount(znArg);
+  
+  // Needs name and value pairs
+  
+  if ((xwCount == 0) || (xwCount % 2 != 0))
+  {
+    Command_Reply(false);
+    return;
+  }
+  
+  // Check every pair before writing any, then write them all
+  
+  for (int xwPass=0; xwPass<2; xwPass++)
+  {
+    for (int i=0; i<xwCount; i+=2)
+    {
+      String xnName;
+      float xfValue;
+      int xwIndex;
+      
+      Command_ArgString(znArg, i, &xnName);
+      xwIndex = Param__GetParam(xnName);
+      
+      if (xwPass == 0)
+      {
+        
+        // Check the parameter, value and range
+        
+        if ((xwIndex == -1) ||
+            !Command_ArgFloat(znArg, i + 1, &xfValue) ||
+            (xfValue < Param__masParams[xwIndex].sfMin) ||
+            (xfValue > Param__masParams[xwIndex].sfMax))
+        {
+          Command_Reply(false);
+          return;
+        }
+      }
+      else
+      {
+        
+        // Keep the old value, then write it. Writes made before a 
+        // failure here are undone by the restore.
+        
+        if (!Param__Keep(xwIndex))
+        {
+          Command_Reply(false);
+          return;
+        }
+        
+        Command_ArgFloat(znArg, i + 1, &xfValue);
+        Param__Write(&Param__masParams[xwIndex], xfValue);
+      }
+    }
+  }
+  
+  Command_Reply(true);
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__List
+*
+*    /purpose    Print every parameter as "<name> <type> <min> <max> <value>"
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__List(String znArg)
+{
+  
+  // Walk the table
+  
+  for (unsigned int i=0; i<Param__muwParamCount; i++)
+  {
+    Serial.print(Param__masParams[i].spcName);
+    Serial.print(' ');
+    Serial.print((int)Param__masParams[i].seType);
+    Serial.print(' ');
+    Serial.print(Param__masParams[i].sfMin, 4);
+    Serial.print(' ');
+    Serial.print(Param__masParams[i].sfMax, 4);
+    Serial.print(' ');
+    Serial.println(Param__Read(&Param__masParams[i]), 6);
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Dump
+*
+*    /purpose    Write every parameter value in one binary frame of type 'P':
+*                  <count> <type> <value> <type> <value> ...
+*                Values are 4 byte little endian floats, in table order as
+*                given by list.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Dump(String znArg)
+{
+  byte xucCount = Param__muwParamCount;
+  
+  // Sent an entry at a time, the whole blob does not fit on the stack
+  
+  Command_BeginFrame(PARAM_DUMP_TYPE, 1 + xucCount * (1 + sizeof(float)));
+  
+  // Count
+  
+  Command_FrameData(&xucCount, 1);
+  
+  // Entries
+  
+  for (unsigned int i=0; i<xucCount; i++)
+  {
+    byte xaucEntry[1 + sizeof(float)];
+    float xfValue = Param__Read(&Param__masParams[i]);
+    
+    xaucEntry[0] = Param__masParams[i].seType;
+    memcpy(&xaucEntry[1], &xfValue, sizeof(xfValue));
+    
+    Command_FrameData(xaucEntry, sizeof(xaucEntry));
+  }
+  
+  Command_EndFrame();
+}
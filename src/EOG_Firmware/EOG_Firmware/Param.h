@@ -0,0 +1,53 @@
+/******************************************************************************
+*
+*    /file    Param.h
+*
+*    /desc    Header file for Param module.
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+#ifndef _PARAM_H
+#define _PARAM_H
+
+// ***** Definitions **********************************************************
+
+// Supported parameter types
+
+typedef enum Param_Type_e
+{
+  PARAM_FLOAT,
+  PARAM_INT,
+  PARAM_LONG,
+  PARAM_BOOL,
+  
+  PARAM_MAX_TYPE
+} Param_Type_t;
+
+// Parameter Structure
+
+typedef struct Param_s
+{
+  const char *    spcName;
+  Param_Type_t    seType;
+  void *          spvValue;
+  float           sfMin;
+  float           sfMax;
+} Param_t;
+
+// ***** Function Headers *****************************************************
+
+// Initialization Functions
+
+void Param_Initialize();
+void Param_Add(const char *zpcName, Param_Type_t zeType, void *zpvValue,
+               float zfMin, float zfMax);
+
+// Snapshot Functions
+
+void Param_Snapshot();
+void Param_Commit();
+void Param_Restore();
+
+#endif    // !defined _PARAM_H
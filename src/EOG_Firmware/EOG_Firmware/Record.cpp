@@ -0,0 +1,583 @@
+/******************************************************************************
+*
+*    /file    Record.cpp
+*
+*    /desc    The Record module is a flight recorder for field reports. It
+*             keeps the last RECORD_SAMPLES readings of the direction
+*             update, every rec_decim'th one, and the last RECORD_EVENTS
+*             state changes with their times, both in circular buffers in
+*             RAM. Recording costs a copy per sample.
+*
+*             The readings are the raw counts, ahead of the artifact filter,
+*             so a recording replays through the simulator exactly as the
+*             board saw it.
+*
+*             The recorder freezes, keeping what it holds, on the mark
+*             command or on an anomaly enabled in rec_trig:
+*               - RECORD_TRIG_ARTIFACT, the artifact filter replaced a
+*                 reading
+*               - RECORD_TRIG_STUCK, a direction was held for rec_stuck
+*                 updates
+*             An anomaly freezes it rec_post samples later, so what
+*             followed is kept as well. recclr starts it again.
+*
+*             Samples are numbered as they are recorded, and each event
+*             keeps the number of the last sample recorded before it, the
+*             one that caused it without decimation, so a replay can place
+*             it exactly. Updates are not evenly spaced - a blocking command
+*             or a change of period moves them - so each sample keeps the
+*             ms since the one recorded before it, and only the time of the
+*             last sample is kept whole.
+*
+*             The dump command sends the recording as a blob, split over
+*             binary frames of type 'R': <chunk index> <up to RECORD_CHUNK
+*             bytes>, then replies. The blob is, little endian:
+*               <version, byte> <reason, byte> <decimation, byte>
+*               <events, byte> <samples, uint16>
+*               <number of the last sample, uint16>
+*               <time of the last sample, uint32 ms>
+*               samples, oldest first: <vertical, int16> <horizontal, int16>
+*                 <ms since the sample before, uint16, 65535 for that or
+*                 more, 0 if there was none>
+*               events, oldest first: <time, uint32 ms>
+*                 <number of its sample, uint16> <direction, byte>
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+// Arduino Source
+
+#include <Arduino.h>
+
+// Local Modules
+
+#include "Command.h"
+#include "Direction.h"
+#include "Param.h"
+#include "Record.h"
+
+// ***** Local Definitions ****************************************************
+
+#define RECORD_VERSION        2
+#define RECORD_FRAME_TYPE     'R'
+#define RECORD_CHUNK          32        // Blob bytes per frame
+#define RECORD_GAP_MAX        0xFFFF
+
+// Anomalies that can freeze the recorder, bits of rec_trig
+
+#define RECORD_TRIG_ARTIFACT  0x01
+#define RECORD_TRIG_STUCK     0x02
+
+// Defaults - a held direction is stuck after 10 s at the default period
+
+#define RECORD_TRIGGERS       RECORD_TRIG_STUCK
+#define RECORD_STUCK_HOLD     100
+#define RECORD_POST_SAMPLES   (RECORD_SAMPLES / 4)
+
+// A sample, and the ms since the one before it
+
+typedef struct Record_Sample_s
+{
+  int16_t        sawValue[DIRECTION_NUM_AXES];
+  uint16_t       suwGap;
+} Record_Sample_t;
+
+// A state change
+
+typedef struct Record_Event_s
+{
+  unsigned long  sulTime;
+  uint16_t       suwSample;
+  byte           sucDirection;
+} Record_Event_t;
+
+// Dump chunk being built - the chunk index, then its bytes. It only lives
+// on the stack of the dump command.
+
+typedef struct Record_Chunk_s
+{
+  byte           saucData[1 + RECORD_CHUNK];
+  byte           sucLen;
+} Record_Chunk_t;
+
+// ***** Local Variables ******************************************************
+
+// Tunable values
+
+static int Record__mwDecimate = 1;
+static int Record__mwTriggers = RECORD_TRIGGERS;
+static int Record__mwStuck = RECORD_STUCK_HOLD;
+static int Record__mwPost = RECORD_POST_SAMPLES;
+
+// Sample buffer, the next slot to write, the number held, the number of
+// the next sample and the time of the last one
+
+static Record_Sample_t Record__masSamples[RECORD_SAMPLES];
+static unsigned int Record__muwSampleHead;
+static unsigned int Record__muwSampleCount;
+static uint16_t Record__muwSampleNumber;
+static unsigned long Record__mulLastTime;
+
+// Event buffer, as for the samples
+
+static Record_Event_t Record__masEvents[RECORD_EVENTS];
+static unsigned int Record__muwEventHead;
+static unsigned int Record__muwEventCount;
+
+// Freeze state - why it froze or will, the samples left to record before
+// it does, and the updates until the next sample is kept
+
+static Record_Reason_t Record__meReason;
+static boolean Record__mbFrozen;
+static int Record__mwPostLeft;
+static int Record__mwDecimateLeft;
+
+// Reported direction and the updates it has been held for
+
+static Direction_t Record__meState;
+static unsigned long Record__mulHeld;
+
+// ***** Local Funtions *******************************************************
+
+static void Record__Put(Record_Chunk_t *zpsChunk, const byte *zpucData,
+                        unsigned int zuwLen);
+static void Record__PutWord(Record_Chunk_t *zpsChunk, uint16_t zuwValue);
+static void Record__PutLong(Record_Chunk_t *zpsChunk, uint32_t zulValue);
+static void Record__Flush(Record_Chunk_t *zpsChunk);
+
+static void Cmd__Mark(String znArg);
+static void Cmd__Dump(String znArg);
+static void Cmd__Rec(String znArg);
+static void Cmd__RecClear(String znArg);
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       Record_Initialize
+*
+*    /purpose    Starts the recorder empty. Registers the tunable values and
+*                commands.
+*
+*    /ret        void
+*
+******************************************************************************/
+void Record_Initialize ()
+{
+  Record_Restart();
+  
+  Param_Add("rec_decim", PARAM_INT, &Record__mwDecimate, 1, 100);
+  Param_Add("rec_trig", PARAM_INT, &Record__mwTriggers, 0,
+            RECORD_TRIG_ARTIFACT | RECORD_TRIG_STUCK);
+  Param_Add("rec_stuck", PARAM_INT, &Record__mwStuck, 0, 30000);
+  Param_Add("rec_post", PARAM_INT, &Record__mwPost, 0, RECORD_SAMPLES);
+  
+  Command_AddCmd("mark", Cmd__Mark);
+  Command_AddCmd("dump", Cmd__Dump);
+  Command_AddCmd("rec", Cmd__Rec);
+  Command_AddCmd("recclr", Cmd__RecClear);
+}
+
+/******************************************************************************
+*
+*    /name       Record_Restart
+*
+*    /purpose    Empties the recorder and starts it recording again
+*
+*    /ret        void
+*
+******************************************************************************/
+void Record_Restart ()
+{
+  Record__muwSampleHead = 0;
+  Record__muwSampleCount = 0;
+  Record__muwEventHead = 0;
+  Record__muwEventCount = 0;
+  
+  Record__meReason = RECORD_RUNNING;
+  Record__mbFrozen = false;
+  Record__mwDecimateLeft = 0;
+  
+  Record__mulHeld = 0;
+}
+
+/******************************************************************************
+*
+*    /name       Record_Sample
+*
+*    /purpose    Records the readings of one direction update, if it is one
+*                of the decimated ones. Checks for a stuck direction.
+*
+*    /param[in]  zlUpDown       Vertical reading, counts
+*    /param[in]  zlLeftRight    Horizontal reading, counts
+*    /param[in]  zulTime        Time of the readings, ms
+*
+*    /ret        void
+*
+******************************************************************************/
+void Record_Sample (signed long zlUpDown, signed long zlLeftRight,
+                    unsigned long zulTime)
+{
+  Record_Sample_t *xpsSlot;
+  unsigned long xulGap = 0;
+  
+  if (Record__mbFrozen)
+  {
+    return;
+  }
+  
+  // A direction held for too long
+  
+  if (Record__meState != DIRECTION_NONE)
+  {
+    Record__mulHeld++;
+  
+    if ((Record__mwStuck > 0) &&
+        (Record__mulHeld == (unsigned long)Record__mwStuck))
+    {
+      Record_Trigger(RECORD_STUCK);
+    }
+  }
+  
+  // Keep one update in rec_decim
+  
+  if (Record__mwDecimateLeft > 0)
+  {
+    Record__mwDecimateLeft--;
+    return;
+  }
+  
+  Record__mwDecimateLeft = Record__mwDecimate - 1;
+  
+  // Overwrite the oldest sample once full
+  
+  if (Record__muwSampleCount > 0)
+  {
+    xulGap = min(zulTime - Record__mulLastTime, (unsigned long)RECORD_GAP_MAX);
+  }
+  
+  xpsSlot = &Record__masSamples[Record__muwSampleHead];
+  xpsSlot->sawValue[DIRECTION_AXIS_UPDOWN] = (int16_t)zlUpDown;
+  xpsSlot->sawValue[DIRECTION_AXIS_LEFTRIGHT] = (int16_t)zlLeftRight;
+  xpsSlot->suwGap = (uint16_t)xulGap;
+  
+  Record__muwSampleHead = (Record__muwSampleHead + 1) % RECORD_SAMPLES;
+  
+  Record__muwSampleNumber++;
+  Record__mulLastTime = zulTime;
+  
+  if (Record__muwSampleCount < RECORD_SAMPLES)
+  {
+    Record__muwSampleCount++;
+  }
+  
+  // Freeze once an anomaly has had its following samples
+  
+  if ((Record__meReason != RECORD_RUNNING) && (--Record__mwPostLeft <= 0))
+  {
+    Record__mbFrozen = true;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Record_State
+*
+*    /purpose    Records a change of the reported direction
+*
+*    /param[in]  zeDir      New direction
+*    /param[in]  zulTime    Time of the sample that changed it, ms
+*
+*    /ret        void
+*
+******************************************************************************/
+void Record_State (Direction_t zeDir, unsigned long zulTime)
+{
+  Record_Event_t *xpsEvent;
+  
+  if (Record__mbFrozen)
+  {
+    return;
+  }
+  
+  Record__meState = zeDir;
+  Record__mulHeld = 0;
+  
+  // Overwrite the oldest event once full
+  
+  xpsEvent = &Record__masEvents[Record__muwEventHead];
+  xpsEvent->sulTime = zulTime;
+  xpsEvent->suwSample = Record__muwSampleNumber - 1;
+  xpsEvent->sucDirection = (byte)zeDir;
+  
+  Record__muwEventHead = (Record__muwEventHead + 1) % RECORD_EVENTS;
+  
+  if (Record__muwEventCount < RECORD_EVENTS)
+  {
+    Record__muwEventCount++;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Record_Trigger
+*
+*    /purpose    Reports an anomaly. If it is enabled in rec_trig and the
+*                recorder is running, it freezes rec_post samples later.
+*                A mark freezes it at once, whatever the triggers.
+*
+*    /param[in]  zeReason    The anomaly, or RECORD_MARK
+*
+*    /ret        void
+*
+******************************************************************************/
+void Record_Trigger (Record_Reason_t zeReason)
+{
+  int xwBit = 0;
+  
+  // Only the first reason counts
+  
+  if (Record__mbFrozen || (Record__meReason != RECORD_RUNNING))
+  {
+    return;
+  }
+  
+  if (zeReason == RECORD_MARK)
+  {
+    Record__meReason = RECORD_MARK;
+    Record__mbFrozen = true;
+    return;
+  }
+  
+  if (zeReason == RECORD_ARTIFACT)
+  {
+    xwBit = RECORD_TRIG_ARTIFACT;
+  }
+  else if (zeReason == RECORD_STUCK)
+  {
+    xwBit = RECORD_TRIG_STUCK;
+  }
+  
+  if (Record__mwTriggers & xwBit)
+  {
+    Record__meReason = zeReason;
+    Record__mwPostLeft = Record__mwPost;
+    Record__mbFrozen = (Record__mwPost == 0);
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Record__Put
+*
+*    /purpose    Adds bytes to the dump, sending a frame each time a chunk
+*                fills
+*
+*    /param[io]  zpsChunk    Chunk being built
+*    /param[in]  zpucData    Bytes
+*    /param[in]  zuwLen      Number of bytes
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Record__Put(Record_Chunk_t *zpsChunk, const byte *zpucData,
+                        unsigned int zuwLen)
+{
+  for (unsigned int i=0; i<zuwLen; i++)
+  {
+    zpsChunk->saucData[1 + zpsChunk->sucLen++] = zpucData[i];
+  
+    if (zpsChunk->sucLen == RECORD_CHUNK)
+    {
+      Record__Flush(zpsChunk);
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Record__PutWord
+*
+*    /purpose    Adds a 16 bit value to the dump, little endian
+*
+*    /param[io]  zpsChunk    Chunk being built
+*    /param[in]  zuwValue    Value
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Record__PutWord(Record_Chunk_t *zpsChunk, uint16_t zuwValue)
+{
+  byte xaucBytes[2] = {(byte)zuwValue, (byte)(zuwValue >> 8)};
+  
+  Record__Put(zpsChunk, xaucBytes, sizeof(xaucBytes));
+}
+
+/******************************************************************************
+*
+*    /name       Record__PutLong
+*
+*    /purpose    Adds a 32 bit value to the dump, little endian
+*
+*    /param[io]  zpsChunk    Chunk being built
+*    /param[in]  zulValue    Value
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Record__PutLong(Record_Chunk_t *zpsChunk, uint32_t zulValue)
+{
+  Record__PutWord(zpsChunk, (uint16_t)zulValue);
+  Record__PutWord(zpsChunk, (uint16_t)(zulValue >> 16));
+}
+
+/******************************************************************************
+*
+*    /name       Record__Flush
+*
+*    /purpose    Sends the chunk built so far, if any, as the next frame
+*
+*    /param[io]  zpsChunk    Chunk being built
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Record__Flush(Record_Chunk_t *zpsChunk)
+{
+  if (zpsChunk->sucLen == 0)
+  {
+    return;
+  }
+  
+  Command_SendFrame(RECORD_FRAME_TYPE, zpsChunk->saucData,
+                    1 + zpsChunk->sucLen);
+  
+  zpsChunk->saucData[0]++;
+  zpsChunk->sucLen = 0;
+}
+
+// ***** Command Definitions **************************************************
+
+/******************************************************************************
+*
+*    /name       Cmd__Mark
+*
+*    /purpose    Freezes the recorder, keeping what led up to now
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Mark(String znArg)
+{
+  Record_Trigger(RECORD_MARK);
+  
+  Command_Reply(true);
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Dump
+*
+*    /purpose    Sends the recording in 'R' frames, then replies. See the
+*                file header for the layout.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Dump(String znArg)
+{
+  Record_Chunk_t xsChunk;
+  unsigned int xuwFirst;
+  byte xaucHeader[4];
+  
+  xsChunk.saucData[0] = 0;
+  xsChunk.sucLen = 0;
+  
+  // Header
+  
+  xaucHeader[0] = RECORD_VERSION;
+  xaucHeader[1] = (byte)Record__meReason;
+  xaucHeader[2] = (byte)Record__mwDecimate;
+  xaucHeader[3] = (byte)Record__muwEventCount;
+  
+  Record__Put(&xsChunk, xaucHeader, sizeof(xaucHeader));
+  Record__PutWord(&xsChunk, Record__muwSampleCount);
+  Record__PutWord(&xsChunk, Record__muwSampleNumber - 1);
+  Record__PutLong(&xsChunk, Record__mulLastTime);
+  
+  // Samples, oldest first
+  
+  xuwFirst = (Record__muwSampleHead + RECORD_SAMPLES - Record__muwSampleCount)
+             % RECORD_SAMPLES;
+  
+  for (unsigned int i=0; i<Record__muwSampleCount; i++)
+  {
+    const Record_Sample_t *xpsSlot = 
+                        &Record__masSamples[(xuwFirst + i) % RECORD_SAMPLES];
+  
+    Record__PutWord(&xsChunk, 
+                    (uint16_t)xpsSlot->sawValue[DIRECTION_AXIS_UPDOWN]);
+    Record__PutWord(&xsChunk, 
+                    (uint16_t)xpsSlot->sawValue[DIRECTION_AXIS_LEFTRIGHT]);
+    Record__PutWord(&xsChunk, xpsSlot->suwGap);
+  }
+  
+  // Events, oldest first
+  
+  xuwFirst = (Record__muwEventHead + RECORD_EVENTS - Record__muwEventCount)
+             % RECORD_EVENTS;
+  
+  for (unsigned int i=0; i<Record__muwEventCount; i++)
+  {
+    const Record_Event_t *xpsEvent =
+                          &Record__masEvents[(xuwFirst + i) % RECORD_EVENTS];
+  
+    Record__PutLong(&xsChunk, xpsEvent->sulTime);
+    Record__PutWord(&xsChunk, xpsEvent->suwSample);
+    Record__Put(&xsChunk, &xpsEvent->sucDirection, 1);
+  }
+  
+  Record__Flush(&xsChunk);
+  
+  Command_Reply(true);
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__Rec
+*
+*    /purpose    Prints the recorder state:
+*                  <frozen> <reason> <samples> <events>
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Rec(String znArg)
+{
+  Serial.print(Record__mbFrozen ? 1 : 0);
+  Serial.print(' ');
+  Serial.print((int)Record__meReason);
+  Serial.print(' ');
+  Serial.print(Record__muwSampleCount);
+  Serial.print(' ');
+  Serial.println(Record__muwEventCount);
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__RecClear
+*
+*    /purpose    Empties the recorder and starts it again
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__RecClear(String znArg)
+{
+  Record_Restart();
+  
+  Command_Reply(true);
+}
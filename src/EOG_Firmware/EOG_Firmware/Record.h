@@ -0,0 +1,52 @@
+/******************************************************************************
+*
+*    /file    Record.h
+*
+*    /desc    Header file for Record module. Include after Direction.h.
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+#ifndef _RECORD_H
+#define _RECORD_H
+
+// ***** Definitions **********************************************************
+
+// Size of the recorder. Each sample costs 6 bytes and each event 7 bytes of
+// RAM, about 380 bytes in all at the defaults. Boards with more to spare
+// can keep more, e.g. with -DRECORD_SAMPLES=512.
+
+#ifndef RECORD_SAMPLES
+#define RECORD_SAMPLES    48
+#endif
+
+#ifndef RECORD_EVENTS
+#define RECORD_EVENTS     8
+#endif
+
+// Why the recorder stopped. RECORD_RUNNING while it has not.
+
+typedef enum Record_Reason_e
+{
+  RECORD_RUNNING,
+  RECORD_MARK,
+  RECORD_ARTIFACT,
+  RECORD_STUCK
+} Record_Reason_t;
+
+// ***** Function Headers *****************************************************
+
+// Initialization functions
+
+void Record_Initialize ();
+void Record_Restart ();
+
+// Update Functions
+
+void Record_Sample (signed long zlUpDown, signed long zlLeftRight,
+                    unsigned long zulTime);
+void Record_State (Direction_t zeDir, unsigned long zulTime);
+void Record_Trigger (Record_Reason_t zeReason);
+
+#endif    // !defined _RECORD_H
@@ -0,0 +1,727 @@
+/******************************************************************************
+*
+*    /file    Template.cpp
+*
+*    /desc    The template module classifies eye movements by shape. Each
+*             class (up, down, left, right, blink) has a template of both
+*             axes over a short window, recorded from the user. Every sample,
+*             the latest window is compared to each template by normalised
+*             cross-correlation (NCC), which ignores the offset and the size
+*             of the movement and only scores its shape.
+*
+*             Samples are kept in a circular window with running sums of the
+*             samples and their squares, so the window statistics cost O(1)
+*             per sample. Samples are held as offsets from a reference taken
+*             from the signal and limited to TEMPLATE_RANGE, so the sums and
+*             the window's part of the denominator stay in 32 bits. The
+*             correlation with each template is a 16 x 8 bit
+*             multiply-accumulate over the window. All of it is integer,
+*             only the final score of each template is a float. Nothing of
+*             it runs unless the template detector is selected or a template
+*             is being recorded.
+*
+*             For the window x and template t of length L, per axis,
+*               num = L * sum(x t) - sum(x) sum(t)
+*               den = (L * sum(x x) - sum(x)^2) (L * sum(t t) - sum(t)^2)
+*             summed over the axes, and NCC = num / sqrt(den).
+*
+*             A template is recorded by arming its class: over the next
+*             TEMPLATE_ARM_SAMPLES samples the window with the most movement
+*             before the first movement settles is kept, made zero mean and
+*             scaled to 8 bits. Each better window is built straight into the
+*             class's template, so no copy of it is kept.
+*
+*             A template spans TEMPLATE_LENGTH update periods, so the set
+*             records the period it was made at and is dropped when the
+*             period changes.
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+// Arduino Source
+
+#include <Arduino.h>
+
+// Local Modules
+
+#include "Analog.h"
+#include "Command.h"
+#include "Param.h"
+#include "Template.h"
+
+// ***** Local Definitions ****************************************************
+
+// Samples to look for the movement in, once a class is armed
+
+#define TEMPLATE_ARM_SAMPLES   (4 * TEMPLATE_LENGTH)
+
+// Correlation needed for a match
+
+#define TEMPLATE_NCC           0.85f
+
+// Fraction of the largest movement the window falls to once a recorded
+// movement has settled
+
+#define TEMPLATE_SETTLED       0.25f
+
+// Smallest standard deviation of a window worth matching, in counts. Below
+// it the window is noise and any shape would correlate.
+
+#define TEMPLATE_FLOOR         32
+
+// Largest offset of a window sample from its reference, in counts. With it
+// L times the sum of squares and the square of the sum both fit 32 bits
+// unsigned. A window spanning more than this is clipped.
+
+#define TEMPLATE_RANGE         4095L
+
+// Running window of both axes, in counts from the reference of each axis
+
+typedef struct Template_Window_s
+{
+  int16_t         saawSample[TEMPLATE_NUM_AXES][TEMPLATE_LENGTH];
+  int16_t         sawRef[TEMPLATE_NUM_AXES];
+  int32_t         salSum[TEMPLATE_NUM_AXES];
+  uint32_t        saulSumSq[TEMPLATE_NUM_AXES];
+  unsigned char   sucIndex;
+  unsigned char   sucFill;
+} Template_Window_t;
+
+// Per template constants, from the shape. Rounding leaves at most half a
+// count per sample in the sum.
+
+typedef struct Template_Norm_s
+{
+  int8_t          sacSum[TEMPLATE_NUM_AXES];
+  float           sfDen;
+} Template_Norm_t;
+
+// Class names, for the commands
+
+static const char Template__macNames[TEMPLATE_NUM_CLASSES] =
+                                                  {'u', 'd', 'l', 'r', 'b'};
+
+// ***** Local Variables ******************************************************
+
+// Tunable values
+
+static float Template__mfNcc = TEMPLATE_NCC;
+static int Template__mwFloor = TEMPLATE_FLOOR;
+
+// Update period in effect, in ms
+
+static int Template__mwPeriod;
+
+// Templates and their constants
+
+static Template_Set_t Template__msSet;
+static Template_Norm_t Template__masNorm[TEMPLATE_NUM_CLASSES];
+
+// Latest window
+
+static Template_Window_t Template__msWindow;
+
+// Recording state - the armed class, samples left to look in, whether the
+// movement has settled, and the movement of the best window so far
+
+static Template_Class_t Template__meArmed = TEMPLATE_NONE;
+static int Template__mwArmLeft;
+static boolean Template__mbArmSettled;
+static float Template__mfBestDen;
+
+// ***** Local Funtions *******************************************************
+
+static void Template__Rebase(int zwAxis, signed long zlRef);
+static float Template__WindowDen();
+static float Template__FloorDen();
+static void Template__Build(Template_Class_t zeClass);
+static void Template__Normalize(Template_Class_t zeClass);
+
+// Commands
+
+static void Cmd__Tpl(String znArg);
+static void Cmd__TplClear(String znArg);
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       Template_Initialize
+*
+*    /purpose    Starts with no templates and an empty window, and registers
+*                the tunable values and commands.
+*
+*    /ret        void
+*
+******************************************************************************/
+void Template_Initialize ()
+{
+  
+  // Start empty
+  
+  memset(&Template__msSet, 0, sizeof(Template__msSet));
+  memset(&Template__msWindow, 0, sizeof(Template__msWindow));
+  
+  Template__meArmed = TEMPLATE_NONE;
+  
+  // Register tunable values and commands
+  
+  Param_Add("tpl_ncc", PARAM_FLOAT, &Template__mfNcc, 0.5f, 1.0f);
+  Param_Add("tpl_floor", PARAM_INT, &Template__mwFloor, 0, 4096);
+  
+  Command_AddCmd("tpl", Cmd__Tpl);
+  Command_AddCmd("tplclr", Cmd__TplClear);
+}
+
+/******************************************************************************
+*
+*    /name       Template_Update
+*
+*    /purpose    Adds a sample of both axes to the window, and records the
+*                armed template, if any
+*
+*    /param[in]  zlUpDown       Vertical reading, counts
+*    /param[in]  zlLeftRight    Horizontal reading, counts
+*
+*    /ret        void
+*
+******************************************************************************/
+void Template_Update (signed long zlUpDown, signed long zlLeftRight)
+{
+  Template_Window_t *xpsWindow = &Template__msWindow;
+  signed long xalSample[TEMPLATE_NUM_AXES] = {zlUpDown, zlLeftRight};
+  
+  // Replace the oldest sample and its share of the sums. The first sample
+  // is the reference, and a sample out of range of the reference becomes
+  // the new one. The sum of squares is exact in unsigned arithmetic, the
+  // true value is always in range.
+  
+  for (int a=0; a < TEMPLATE_NUM_AXES; a++)
+  {
+    int16_t xwOld = xpsWindow->saawSample[a][xpsWindow->sucIndex];
+    signed long xlNew;
+  
+    if (xpsWindow->sucFill == 0)
+    {
+      xpsWindow->sawRef[a] = (int16_t)constrain(xalSample[a], 
+                                                ANALOG_COUNTS_MIN,
+                                                ANALOG_COUNTS_MAX);
+    }
+  
+    xlNew = xalSample[a] - xpsWindow->sawRef[a];
+  
+    if (abs(xlNew) > TEMPLATE_RANGE)
+    {
+      Template__Rebase(a, xalSample[a]);
+  
+      xlNew = 0;
+      xwOld = xpsWindow->saawSample[a][xpsWindow->sucIndex];
+    }
+  
+    xpsWindow->salSum[a] += xlNew - xwOld;
+    xpsWindow->saulSumSq[a] += (uint32_t)(xlNew * xlNew) - 
+                               (uint32_t)((int32_t)xwOld * xwOld);
+    xpsWindow->saawSample[a][xpsWindow->sucIndex] = (int16_t)xlNew;
+  }
+  
+  xpsWindow->sucIndex = (xpsWindow->sucIndex + 1) & (TEMPLATE_LENGTH - 1);
+  
+  if (xpsWindow->sucFill < TEMPLATE_LENGTH)
+  {
+    xpsWindow->sucFill++;
+    return;
+  }
+  
+  // Recording - keep the window with the most movement. Once the movement
+  // has settled stop looking, so the return to centre is not taken instead,
+  // but stay armed so the return is not reported either.
+  
+  if (Template__meArmed != TEMPLATE_NONE)
+  {
+    float xfDen = Template__WindowDen();
+  
+    if ((Template__mfBestDen >= Template__FloorDen()) &&
+        (xfDen < Template__mfBestDen * TEMPLATE_SETTLED))
+    {
+      Template__mbArmSettled = true;
+    }
+  
+    if (!Template__mbArmSettled && (xfDen > Template__mfBestDen))
+    {
+      Template__mfBestDen = xfDen;
+  
+      Template__Build(Template__meArmed);
+    }
+  
+    if (--Template__mwArmLeft <= 0)
+    {
+      Template__meArmed = TEMPLATE_NONE;
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Template_Restart
+*
+*    /purpose    Empties the window, for when it has not been kept up to date
+*                or the samples in it no longer belong together
+*
+*    /ret        void
+*
+******************************************************************************/
+void Template_Restart ()
+{
+  
+  memset(&Template__msWindow, 0, sizeof(Template__msWindow));
+}
+
+/******************************************************************************
+*
+*    /name       Template__Rebase
+*
+*    /purpose    Moves the reference of an axis to a new sample, shifting the
+*                window to it and working its sums out again. Samples left
+*                out of range are clipped.
+*
+*    /param[in]  zwAxis    Axis
+*    /param[in]  zlRef     New reference, counts
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Template__Rebase(int zwAxis, signed long zlRef)
+{
+  Template_Window_t *xpsWindow = &Template__msWindow;
+  int16_t xwRef = (int16_t)constrain(zlRef, ANALOG_COUNTS_MIN, 
+                                     ANALOG_COUNTS_MAX);
+  signed long xlShift = (signed long)xpsWindow->sawRef[zwAxis] - xwRef;
+  
+  xpsWindow->sawRef[zwAxis] = xwRef;
+  xpsWindow->salSum[zwAxis] = 0;
+  xpsWindow->saulSumSq[zwAxis] = 0;
+  
+  for (int i=0; i < TEMPLATE_LENGTH; i++)
+  {
+    int16_t *xpwSample = &xpsWindow->saawSample[zwAxis][i];
+  
+    *xpwSample = (int16_t)constrain(*xpwSample + xlShift, -TEMPLATE_RANGE, 
+                                    TEMPLATE_RANGE);
+  
+    xpsWindow->salSum[zwAxis] += *xpwSample;
+    xpsWindow->saulSumSq[zwAxis] += (uint32_t)((int32_t)*xpwSample * 
+                                               *xpwSample);
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Template__WindowDen
+*
+*    /purpose    Returns the window's part of the NCC denominator, L^2 times
+*                its variance summed over the axes. Each axis is exact in 32
+*                bits unsigned, see TEMPLATE_RANGE.
+*
+*    /ret        float    L * sum(x x) - sum(x)^2, summed over the axes
+*
+******************************************************************************/
+static float Template__WindowDen()
+{
+  float xfDen = 0.0f;
+  
+  for (int a=0; a < TEMPLATE_NUM_AXES; a++)
+  {
+    uint32_t xulSum = (uint32_t)abs(Template__msWindow.salSum[a]);
+  
+    xfDen += (float)(TEMPLATE_LENGTH * Template__msWindow.saulSumSq[a] -
+                     xulSum * xulSum);
+  }
+  
+  return xfDen;
+}
+
+/******************************************************************************
+*
+*    /name       Template__FloorDen
+*
+*    /purpose    Returns the window denominator of the tpl_floor standard
+*                deviation, below which a window is too still to match
+*
+*    /ret        float    L^2 * tpl_floor^2
+*
+******************************************************************************/
+static float Template__FloorDen()
+{
+  return (float)Template__mwFloor * Template__mwFloor *
+         TEMPLATE_LENGTH * TEMPLATE_LENGTH;
+}
+
+/******************************************************************************
+*
+*    /name       Template_Match
+*
+*    /purpose    Scores the latest window against every recorded template
+*                and returns the best. The weight is the correlation over
+*                the tpl_ncc threshold, so a weight of 1 or more is a match.
+*
+*    /param[out] zpfWeight         Weight of the best class, 0 if none
+*
+*    /ret        Template_Class_t  Best class, TEMPLATE_NONE if no template
+*                                  is recorded or the window is too still
+*
+******************************************************************************/
+Template_Class_t Template_Match (float *zpfWeight)
+{
+  Template_Window_t *xpsWindow = &Template__msWindow;
+  Template_Class_t xeBest = TEMPLATE_NONE;
+  float xfBest = 0.0f;
+  float xfDen;
+  
+  *zpfWeight = 0.0f;
+  
+  // Needs a full window with some movement in it
+  
+  xfDen = Template__WindowDen();
+  
+  if ((Template__msSet.sucRecorded == 0) ||
+      (xpsWindow->sucFill < TEMPLATE_LENGTH) ||
+      (xfDen < Template__FloorDen()))
+  {
+    return TEMPLATE_NONE;
+  }
+  
+  for (int c=0; c < TEMPLATE_NUM_CLASSES; c++)
+  {
+    float xfNcc;
+    float xfNum = 0.0f;
+  
+    if (!(Template__msSet.sucRecorded & (1 << c)))
+    {
+      continue;
+    }
+  
+    // Correlate each axis, the window starts at the oldest sample
+  
+    for (int a=0; a < TEMPLATE_NUM_AXES; a++)
+    {
+      const int8_t *xpcShape = Template__msSet.saacShape[c][a];
+      const int16_t *xpwSample = xpsWindow->saawSample[a];
+      unsigned char xucIndex = xpsWindow->sucIndex;
+      signed long xlCross = 0;
+  
+      for (int i=0; i < TEMPLATE_LENGTH; i++)
+      {
+        xlCross += (signed long)xpwSample[xucIndex] * xpcShape[i];
+        xucIndex = (xucIndex + 1) & (TEMPLATE_LENGTH - 1);
+      }
+  
+      xfNum += (float)(TEMPLATE_LENGTH * xlCross -
+                       xpsWindow->salSum[a] * Template__masNorm[c].sacSum[a]);
+    }
+  
+    xfNcc = xfNum / sqrt(xfDen * Template__masNorm[c].sfDen);
+  
+    if (xfNcc > xfBest)
+    {
+      xfBest = xfNcc;
+      xeBest = (Template_Class_t)c;
+    }
+  }
+  
+  *zpfWeight = xfBest / Template__mfNcc;
+  
+  return xeBest;
+}
+
+/******************************************************************************
+*
+*    /name       Template_Record
+*
+*    /purpose    Arms recording of a class. The template is built from the
+*                window with the most movement over the next
+*                TEMPLATE_ARM_SAMPLES samples.
+*
+*    /param[in]  zeClass    Class to record
+*
+*    /ret        void
+*
+******************************************************************************/
+void Template_Record (Template_Class_t zeClass)
+{
+  Template__msSet.sucRecorded &= ~(1 << zeClass);
+  
+  Template__meArmed = zeClass;
+  Template__mwArmLeft = TEMPLATE_ARM_SAMPLES;
+  Template__mbArmSettled = false;
+  Template__mfBestDen = 0.0f;
+}
+
+/******************************************************************************
+*
+*    /name       Template_IsRecording
+*
+*    /purpose    Returns whether a class is armed
+*
+*    /ret        boolean    true while recording
+*
+******************************************************************************/
+boolean Template_IsRecording ()
+{
+  return Template__meArmed != TEMPLATE_NONE;
+}
+
+/******************************************************************************
+*
+*    /name       Template__Build
+*
+*    /purpose    Makes the template of a class from the window, oldest sample
+*                first: removes the mean of each axis and scales both axes by
+*                the same factor to fit 8 bits, keeping their ratio. A window
+*                with no movement leaves the class unrecorded.
+*
+*    /param[in]  zeClass    Class to build
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Template__Build(Template_Class_t zeClass)
+{
+  Template_Window_t *xpsWindow = &Template__msWindow;
+  float xafMean[TEMPLATE_NUM_AXES];
+  float xfPeak = 0.0f;
+  
+  Template__msSet.sucRecorded &= ~(1 << zeClass);
+  
+  // Mean and largest deviation
+  
+  for (int a=0; a < TEMPLATE_NUM_AXES; a++)
+  {
+    xafMean[a] = (float)xpsWindow->salSum[a] / TEMPLATE_LENGTH;
+  
+    for (int i=0; i < TEMPLATE_LENGTH; i++)
+    {
+      xfPeak = max(xfPeak, abs(xpsWindow->saawSample[a][i] - xafMean[a]));
+    }
+  }
+  
+  if (xfPeak < 1.0f)
+  {
+    return;
+  }
+  
+  // Scale to +-127
+  
+  for (int a=0; a < TEMPLATE_NUM_AXES; a++)
+  {
+    unsigned char xucIndex = xpsWindow->sucIndex;
+  
+    for (int i=0; i < TEMPLATE_LENGTH; i++)
+    {
+      Template__msSet.saacShape[zeClass][a][i] = (int8_t)
+                  floor((xpsWindow->saawSample[a][xucIndex] - xafMean[a]) * 
+                        127.0f / xfPeak + 0.5f);
+  
+      xucIndex = (xucIndex + 1) & (TEMPLATE_LENGTH - 1);
+    }
+  }
+  
+  Template__msSet.sucRecorded |= (1 << zeClass);
+  Template__msSet.suwPeriod = Template__mwPeriod;
+  
+  Template__Normalize(zeClass);
+}
+
+/******************************************************************************
+*
+*    /name       Template__Normalize
+*
+*    /purpose    Computes the constants of a template used by every match.
+*                Rounding leaves the shape close to but not exactly zero
+*                mean, so its sum is kept.
+*
+*    /param[in]  zeClass    Class to compute
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Template__Normalize(Template_Class_t zeClass)
+{
+  Template_Norm_t *xpsNorm = &Template__masNorm[zeClass];
+  
+  xpsNorm->sfDen = 0.0f;
+  
+  for (int a=0; a < TEMPLATE_NUM_AXES; a++)
+  {
+    const int8_t *xpcShape = Template__msSet.saacShape[zeClass][a];
+    signed long xlSum = 0;
+    signed long xlSumSq = 0;
+  
+    for (int i=0; i < TEMPLATE_LENGTH; i++)
+    {
+      xlSum += xpcShape[i];
+      xlSumSq += (signed long)xpcShape[i] * xpcShape[i];
+    }
+  
+    xpsNorm->sacSum[a] = (int8_t)xlSum;
+    xpsNorm->sfDen += (float)(TEMPLATE_LENGTH * xlSumSq - xlSum * xlSum);
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Template_GetSet
+*
+*    /purpose    Copies out the recorded templates
+*
+*    /param[out] zpsSet    Templates
+*
+*    /ret        void
+*
+******************************************************************************/
+void Template_GetSet (Template_Set_t *zpsSet)
+{
+  *zpsSet = Template__msSet;
+}
+
+/******************************************************************************
+*
+*    /name       Template_SetSet
+*
+*    /purpose    Loads a set of templates, e.g. from a saved calibration.
+*                A set recorded at another update period is not used.
+*
+*    /param[in]  zpsSet    Templates
+*
+*    /ret        void
+*
+******************************************************************************/
+void Template_SetSet (const Template_Set_t *zpsSet)
+{
+  Template__msSet = *zpsSet;
+  
+  if (Template__msSet.suwPeriod != Template__mwPeriod)
+  {
+    Template__msSet.sucRecorded = 0;
+    Template__msSet.suwPeriod = Template__mwPeriod;
+  }
+  
+  for (int c=0; c < TEMPLATE_NUM_CLASSES; c++)
+  {
+    if (Template__msSet.sucRecorded & (1 << c))
+    {
+      Template__Normalize((Template_Class_t)c);
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Template_SetPeriod
+*
+*    /purpose    Sets the update period the window is sampled at. A template
+*                is a shape over a number of samples, so when the period
+*                changes the templates, any recording and the window are
+*                dropped.
+*
+*    /param[in]  zwPeriod    Update period, in ms
+*
+*    /ret        void
+*
+******************************************************************************/
+void Template_SetPeriod (int zwPeriod)
+{
+  if (zwPeriod == Template__mwPeriod)
+  {
+    return;
+  }
+  
+  Template__mwPeriod = zwPeriod;
+  
+  if (Template__msSet.suwPeriod != zwPeriod)
+  {
+    Template__msSet.sucRecorded = 0;
+    Template__msSet.suwPeriod = zwPeriod;
+  }
+  
+  Template__meArmed = TEMPLATE_NONE;
+  
+  Template_Restart();
+}
+
+
+// ***** Command Definitions **************************************************
+
+/******************************************************************************
+*
+*    /name       Cmd__Tpl
+*
+*    /purpose    With a class ("u", "d", "l", "r" or "b"), arm recording of
+*                its template; the movement is made within the next
+*                TEMPLATE_ARM_SAMPLES updates. With no argument, print the
+*                recorded classes and the current best match:
+*                "<classes> <best class> <weight>".
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__Tpl(String znArg)
+{
+  Template_Class_t xeBest;
+  float xfWeight;
+  
+  // Arm a class
+  
+  if (znArg.length() > 0)
+  {
+    for (int c=0; c < TEMPLATE_NUM_CLASSES; c++)
+    {
+      if ((znArg.length() == 1) && (znArg.charAt(0) == Template__macNames[c]))
+      {
+        Template_Record((Template_Class_t)c);
+  
+        Command_Reply(true);
+        return;
+      }
+    }
+  
+    Command_Reply(false);
+    return;
+  }
+  
+  // Report
+  
+  for (int c=0; c < TEMPLATE_NUM_CLASSES; c++)
+  {
+    if (Template__msSet.sucRecorded & (1 << c))
+    {
+      Serial.print(Template__macNames[c]);
+    }
+  }
+  
+  xeBest = Template_Match(&xfWeight);
+  
+  Serial.print(' ');
+  Serial.print((xeBest == TEMPLATE_NONE) ? '-' : Template__macNames[xeBest]);
+  Serial.print(' ');
+  Serial.println(xfWeight, 3);
+}
+
+/******************************************************************************
+*
+*    /name       Cmd__TplClear
+*
+*    /purpose    Forget every template
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Cmd__TplClear(String znArg)
+{
+  Template__msSet.sucRecorded = 0;
+  Template__meArmed = TEMPLATE_NONE;
+  
+  Command_Reply(true);
+}
@@ -0,0 +1,73 @@
+/******************************************************************************
+*
+*    /file    Template.h
+*
+*    /desc    Header file for Template module.
+*
+*    /log     10/19/26  agt - Initial release.
+*
+******************************************************************************/
+
+#ifndef _TEMPLATE_H
+#define _TEMPLATE_H
+
+// ***** Definitions **********************************************************
+
+// Window length, in samples of the update period. Must be a power of 2.
+
+#define TEMPLATE_LENGTH      16
+
+// Axes of a template, in the order of Direction_Axis_t
+
+#define TEMPLATE_NUM_AXES    2
+
+// Template classes. A blink is matched so it can be told from a look, it is
+// never reported as a direction.
+
+typedef enum Template_Class_e
+{
+  TEMPLATE_UP,
+  TEMPLATE_DOWN,
+  TEMPLATE_LEFT,
+  TEMPLATE_RIGHT,
+  TEMPLATE_BLINK,
+
+  TEMPLATE_NUM_CLASSES,
+  TEMPLATE_NONE = TEMPLATE_NUM_CLASSES
+} Template_Class_t;
+
+// The recorded templates - zero mean shapes scaled to +-127, a bit per
+// recorded class, and the update period they were recorded at, in ms. This
+// is what is saved with the calibration.
+
+typedef struct Template_Set_s
+{
+  int8_t    saacShape[TEMPLATE_NUM_CLASSES][TEMPLATE_NUM_AXES][TEMPLATE_LENGTH];
+  uint8_t   sucRecorded;
+  uint16_t  suwPeriod;
+} Template_Set_t;
+
+// ***** Function Headers *****************************************************
+
+// Initialization functions
+
+void Template_Initialize ();
+
+// Update Functions
+
+void Template_Update (signed long zlUpDown, signed long zlLeftRight);
+void Template_Restart ();
+void Template_Record (Template_Class_t zeClass);
+
+// Get Functions
+
+Template_Class_t Template_Match (float *zpfWeight);
+boolean Template_IsRecording ();
+void Template_GetSet (Template_Set_t *zpsSet);
+
+// Set Functions
+
+void Template_SetSet (const Template_Set_t *zpsSet);
+void Template_SetPeriod (int zwPeriod);
+
+#endif    // !defined _TEMPLATE_H
@@ -0,0 +1,392 @@
+/******************************************************************************
+*
+*    /file    eog_adc.cpp
+*
+*    /desc    Check and benchmark of the Analog module's frame decoder. A
+*             frame is the 16 bytes a shield sends per conversion, two per
+*             channel, high byte first, in two's complement.
+*
+*             Three checks are run, and any failure is printed and makes
+*             the exit status non zero:
+*               - golden frames, with the counts the shield documents for
+*                 them, through Analog_Decode
+*               - every 16 bit word against the branching decode of the
+*                 old eog_arduino sketch (parseRawBytes and fixSignBit)
+*               - the golden values end to end, through the simulated
+*                 shield, Analog_Update, Analog_ReadCounts and the sign of
+*                 Analog_ReadVolts
+*
+*             The benchmark decodes a buffer of random frames with both
+*             decoders and reports the time, and on x86 the TSC cycles,
+*             per frame.
+*
+*             Build (Linux, from src/host):
+*               g++ -O2 -std=gnu++11 -Isim -I../EOG_Firmware/EOG_Firmware \
+*                   -o eog_adc eog_adc.cpp sim/sim_hal.cpp \
+*                   ../EOG_Firmware/EOG_Firmware/Analog.cpp \
+*                   ../EOG_Firmware/EOG_Firmware/Command.cpp \
+*                   ../EOG_Firmware/EOG_Firmware/Param.cpp
+*
+*             Usage:
+*               eog_adc [-n frames] [-r repeats]
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "Arduino.h"
+#include "sim_hal.h"
+#include "Analog.h"
+
+// ***** Definitions **********************************************************
+
+#define ADC_FRAME_BYTES    (ANALOG_DEVICE_CHANNELS * 2)
+
+// A frame and the counts it holds
+
+typedef struct Golden_s
+{
+  uint8_t  saucFrame[ADC_FRAME_BYTES];
+  long     salCounts[ANALOG_DEVICE_CHANNELS];
+} Golden_t;
+
+// ***** Local Variables ******************************************************
+
+// Full scale, around zero, the sign bit alone and bytes that only differ
+// in the half of the word they are in
+
+static const Golden_t masGolden[] =
+{
+  {{0x00, 0x00, 0x00, 0x01, 0x7F, 0xFF, 0x80, 0x00,
+    0x80, 0x01, 0xFF, 0xFF, 0xFF, 0xFE, 0x40, 0x00},
+   {0, 1, 32767, -32768, -32767, -1, -2, 16384}},
+  {{0x00, 0xFF, 0xFF, 0x00, 0x01, 0x00, 0x00, 0x80,
+    0x12, 0x34, 0xED, 0xCC, 0xC0, 0x00, 0x7F, 0x00},
+   {255, -256, 256, 128, 4660, -4660, -16384, 32512}},
+  {{0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00,
+    0x7F, 0xFF, 0x7F, 0xFF, 0x7F, 0xFF, 0x7F, 0xFF},
+   {-32768, -32768, -32768, -32768, 32767, 32767, 32767, 32767}}
+};
+
+// Golden (vertical, horizontal) pairs replayed through the simulated
+// shield, one per ms
+
+static const int16_t mawTrace[] =
+{
+  0, 1,  -1, 32767,  -32768, 255,  -256, 128,  4660, -4660,  -2, 16384
+};
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       NowNs
+*
+*    /purpose    Monotonic time
+*
+*    /ret        uint64_t    ns
+*
+******************************************************************************/
+static uint64_t NowNs()
+{
+  struct timespec xsNow;
+
+  clock_gettime(CLOCK_MONOTONIC, &xsNow);
+
+  return (uint64_t)xsNow.tv_sec * 1000000000ULL + xsNow.tv_nsec;
+}
+
+/******************************************************************************
+*
+*    /name       Cycles
+*
+*    /purpose    CPU cycle counter, where there is one
+*
+*    /ret        uint64_t    TSC cycles, 0 if not available
+*
+******************************************************************************/
+static uint64_t Cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/******************************************************************************
+*
+*    /name       DecodeSketch
+*
+*    /purpose    The decode of the old eog_arduino sketch, which sign
+*                extends each channel with a branch. Kept as the reference.
+*
+*    /param[in]  zpucRaw      Frame
+*    /param[out] zplCounts    Counts of each channel
+*
+*    /ret        void
+*
+******************************************************************************/
+static void DecodeSketch(const unsigned char *zpucRaw, signed long *zplCounts)
+{
+  for (int i=0; i < ANALOG_DEVICE_CHANNELS; i++)
+  {
+    long xlReading = ((long)zpucRaw[2 * i] << 8) + zpucRaw[2 * i + 1];
+
+    if (xlReading & 0x8000)
+    {
+      xlReading |= ~0xFFFFL;
+    }
+
+    zplCounts[i] = xlReading;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       CheckGolden
+*
+*    /purpose    Decodes the golden frames
+*
+*    /ret        int    Number of wrong channels
+*
+******************************************************************************/
+static int CheckGolden()
+{
+  int xwErrors = 0;
+
+  for (size_t f=0; f < sizeof(masGolden) / sizeof(masGolden[0]); f++)
+  {
+    signed long xalCounts[ANALOG_DEVICE_CHANNELS];
+
+    Analog_Decode(masGolden[f].saucFrame, xalCounts);
+
+    for (int i=0; i < ANALOG_DEVICE_CHANNELS; i++)
+    {
+      if (xalCounts[i] != masGolden[f].salCounts[i])
+      {
+        printf("golden frame %zu ch%d: %ld, expected %ld\n",
+               f, i, xalCounts[i], masGolden[f].salCounts[i]);
+        xwErrors++;
+      }
+    }
+  }
+
+  return xwErrors;
+}
+
+/******************************************************************************
+*
+*    /name       CheckAllWords
+*
+*    /purpose    Decodes every 16 bit word on every channel with both
+*                decoders
+*
+*    /ret        int    Number of words that differ
+*
+******************************************************************************/
+static int CheckAllWords()
+{
+  int xwErrors = 0;
+
+  for (long w=0; w < 0x10000; w++)
+  {
+    unsigned char xaucFrame[ADC_FRAME_BYTES];
+    signed long xalNew[ANALOG_DEVICE_CHANNELS];
+    signed long xalOld[ANALOG_DEVICE_CHANNELS];
+
+    for (int i=0; i < ANALOG_DEVICE_CHANNELS; i++)
+    {
+      xaucFrame[2 * i] = (unsigned char)(w >> 8);
+      xaucFrame[2 * i + 1] = (unsigned char)w;
+    }
+
+    Analog_Decode(xaucFrame, xalNew);
+    DecodeSketch(xaucFrame, xalOld);
+
+    for (int i=0; i < ANALOG_DEVICE_CHANNELS; i++)
+    {
+      if ((xalNew[i] != xalOld[i]) && (xwErrors++ < 8))
+      {
+        printf("word 0x%04lX ch%d: %ld, sketch %ld\n",
+               w, i, xalNew[i], xalOld[i]);
+      }
+    }
+  }
+
+  return xwErrors;
+}
+
+/******************************************************************************
+*
+*    /name       CheckShield
+*
+*    /purpose    Reads the golden trace through the simulated shield and
+*                the firmware read functions
+*
+*    /ret        int    Number of wrong readings
+*
+******************************************************************************/
+static int CheckShield()
+{
+  const size_t xuSamples = sizeof(mawTrace) / sizeof(mawTrace[0]) / 2;
+  const Analog_Channel_t xaeChannel[2] = {ANALOG_CH4, ANALOG_CH5};
+  int xwErrors = 0;
+
+  SimHal_Attach(-1, mawTrace, xuSamples);
+  Analog_Initialize(ANALOG_5_TO_5);
+
+  for (size_t s=0; s < xuSamples; s++)
+  {
+    SimHal_SetMicros(1000ULL * (s + xuSamples));
+    Analog_Update();
+
+    for (int a=0; a < 2; a++)
+    {
+      long xlExpect = mawTrace[2 * s + a];
+      long xlCounts = Analog_ReadCounts(xaeChannel[a]);
+      float xfVolts = Analog_ReadVolts(xaeChannel[a]);
+
+      if ((xlCounts != xlExpect) || ((xfVolts < 0.0f) != (xlExpect < 0)))
+      {
+        printf("sample %zu ch%d: %ld (%.4f V), expected %ld\n",
+               s, (int)xaeChannel[a], xlCounts, xfVolts, xlExpect);
+        xwErrors++;
+      }
+    }
+  }
+
+  return xwErrors;
+}
+
+/******************************************************************************
+*
+*    /name       Bench
+*
+*    /purpose    Times a decoder over a buffer of frames
+*
+*    /param[in]  zpfDecode    Decoder
+*    /param[in]  zpcName      Name to report it by
+*    /param[in]  zaucFrames   Frames
+*    /param[in]  zwRepeats    Passes over the frames
+*
+*    /ret        long         Sum of the counts, so the work is kept
+*
+******************************************************************************/
+static long Bench(void (*zpfDecode)(const unsigned char *, signed long *),
+                  const char *zpcName,
+                  const std::vector<unsigned char> &zaucFrames,
+                  int zwRepeats)
+{
+  size_t xuFrames = zaucFrames.size() / ADC_FRAME_BYTES;
+  signed long xalCounts[ANALOG_DEVICE_CHANNELS];
+  long xlSum = 0;
+  uint64_t xullNs, xullCycles;
+
+  xullNs = NowNs();
+  xullCycles = Cycles();
+
+  for (int r=0; r < zwRepeats; r++)
+  {
+    for (size_t f=0; f < xuFrames; f++)
+    {
+      zpfDecode(&zaucFrames[f * ADC_FRAME_BYTES], xalCounts);
+      xlSum += xalCounts[f % ANALOG_DEVICE_CHANNELS];
+    }
+  }
+
+  xullCycles = Cycles() - xullCycles;
+  xullNs = NowNs() - xullNs;
+
+  printf("%-8s %8.2f ns/frame", zpcName,
+         (double)xullNs / ((double)xuFrames * zwRepeats));
+
+  if (xullCycles != 0)
+  {
+    printf(" %8.2f cycles/frame",
+           (double)xullCycles / ((double)xuFrames * zwRepeats));
+  }
+
+  printf("\n");
+
+  return xlSum;
+}
+
+/******************************************************************************
+*
+*    /name       main
+*
+*    /purpose    Runs the checks, then the benchmark
+*
+*    /ret        int    0 if every check passed
+*
+******************************************************************************/
+int main(int argc, char *argv[])
+{
+  long xlFrames = 4096;
+  int xwRepeats = 2000;
+  int xwErrors = 0;
+  int xwOpt;
+
+  while ((xwOpt = getopt(argc, argv, "n:r:")) != -1)
+  {
+    switch (xwOpt)
+    {
+      case 'n':
+        xlFrames = atol(optarg);
+        break;
+
+      case 'r':
+        xwRepeats = atoi(optarg);
+        break;
+
+      default:
+        fprintf(stderr, "usage: %s [-n frames] [-r repeats]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if ((xlFrames <= 0) || (xwRepeats <= 0))
+  {
+    fprintf(stderr, "frames and repeats must be positive\n");
+    return 2;
+  }
+
+  // Correctness
+
+  xwErrors += CheckGolden();
+  xwErrors += CheckAllWords();
+  xwErrors += CheckShield();
+
+  printf("checks: %s (%d errors)\n", xwErrors ? "FAIL" : "ok", xwErrors);
+
+  // Speed, over random frames so the sketch's branch is unpredictable
+
+  std::vector<unsigned char> xaucFrames(xlFrames * ADC_FRAME_BYTES);
+  long xlSum = 0;
+
+  srand(1);
+
+  for (size_t i=0; i < xaucFrames.size(); i++)
+  {
+    xaucFrames[i] = (unsigned char)rand();
+  }
+
+  xlSum += Bench(Analog_Decode, "decode", xaucFrames, xwRepeats);
+  xlSum += Bench(DecodeSketch, "sketch", xaucFrames, xwRepeats);
+
+  printf("checksum %ld\n", xlSum);
+
+  return xwErrors ? 1 : 0;
+}
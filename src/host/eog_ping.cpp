@@ -0,0 +1,624 @@
+/******************************************************************************
+*
+*    /file    eog_ping.cpp
+*
+*    /desc    Host tool that measures the serial link latency to the EOG
+*             firmware. It sends "ping <nonce>" commands, matches each
+*             "pong <nonce> <micros> <seq>" reply and reports:
+*               - the round trip time distribution
+*               - the offset and drift between the device and host clocks
+*               - the one-way (host -> device, device -> host) latency
+*                 distribution
+*
+*             The clock offset is fitted to the pings with the shortest
+*             round trips, where the link delay is most nearly symmetric.
+*
+*             If a second baud rate is given, the link is switched to it
+*             with the "baud"/"baudok" handshake before pinging.
+*
+*             Build (Linux / macOS):
+*               g++ -O2 -std=c++11 -o eog_ping eog_ping.cpp
+*
+*             Usage:
+*               eog_ping <device> [baud] [count] [interval ms] [new baud]
+*               eog_ping /dev/ttyACM0 115200 500 20 500000
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+
+// ***** Local Definitions ****************************************************
+
+#define DEFAULT_BAUD       115200
+#define DEFAULT_COUNT      200
+#define DEFAULT_INTERVAL   20
+#define REPLY_TIMEOUT_US   500000LL
+#define RESET_WAIT_US      2000000LL
+#define BAUD_SETTLE_US     50000LL
+#define BAUD_CONFIRM_US    2000000LL       // Device BAUD_CONFIRM_MS
+
+// Linux sets rates without a Bxxx flag, such as the 250000 an AVR at 16 MHz
+// divides exactly, with BOTHER through termios2. Its header clashes with
+// <termios.h>, so the kernel structure is declared here.
+
+#if defined(__linux__) && defined(TCGETS2)
+#define BAUD_OTHER         1
+
+#ifndef BOTHER
+#define BOTHER             0010000
+#endif
+
+struct termios2
+{
+  tcflag_t  c_iflag;
+  tcflag_t  c_oflag;
+  tcflag_t  c_cflag;
+  tcflag_t  c_lflag;
+  cc_t      c_line;
+  cc_t      c_cc[19];
+  speed_t   c_ispeed;
+  speed_t   c_ospeed;
+};
+#endif
+
+// Fraction of the pings, by round trip, used to fit the clock offset
+
+#define FIT_FRACTION       0.2
+
+// One matched ping, all times in microseconds
+
+typedef struct Ping_s
+{
+  long long  sllSent;
+  long long  sllRecv;
+  long long  sllDevice;
+} Ping_t;
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       Now
+*
+*    /purpose    Monotonic host time
+*
+*    /ret        long long    Time in microseconds
+*
+******************************************************************************/
+static long long Now()
+{
+  struct timespec xsTime;
+  
+  clock_gettime(CLOCK_MONOTONIC, &xsTime);
+  
+  return (long long)xsTime.tv_sec * 1000000LL + xsTime.tv_nsec / 1000;
+}
+
+/******************************************************************************
+*
+*    /name       BaudFlag
+*
+*    /purpose    Converts a baud rate to its termios flag
+*
+*    /param[in]  zlBaud    Baud rate
+*
+*    /ret        speed_t   termios flag, 0 if not supported
+*
+******************************************************************************/
+static speed_t BaudFlag(long zlBaud)
+{
+  switch (zlBaud)
+  {
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+#ifdef B230400
+    case 230400:  return B230400;
+#endif
+#if defined(B250000)
+    case 250000:  return B250000;
+#elif defined(BAUD_OTHER)
+    case 250000:  return BOTHER;
+#endif
+#ifdef B500000
+    case 500000:  return B500000;
+#endif
+#ifdef B1000000
+    case 1000000: return B1000000;
+#endif
+    default:      return 0;
+  }
+}
+
+/******************************************************************************
+*
+*    /name       SetSpeed
+*
+*    /purpose    Sets the baud rate of an open port
+*
+*    /param[in]  zwFd      File descriptor
+*    /param[in]  zlBaud    Baud rate
+*
+*    /ret        bool      true on success
+*
+******************************************************************************/
+static bool SetSpeed(int zwFd, long zlBaud)
+{
+  struct termios xsTio;
+  speed_t xuSpeed = BaudFlag(zlBaud);
+  
+  if (xuSpeed == 0)
+  {
+    fprintf(stderr, "unsupported baud rate %ld\n", zlBaud);
+    return false;
+  }
+  
+  tcdrain(zwFd);
+  
+#ifdef BAUD_OTHER
+  if (xuSpeed == BOTHER)
+  {
+    struct termios2 xsTio2;
+    
+    if (ioctl(zwFd, TCGETS2, &xsTio2) != 0)
+    {
+      return false;
+    }
+    
+    xsTio2.c_cflag = (xsTio2.c_cflag & ~CBAUD) | BOTHER;
+    xsTio2.c_ispeed = (speed_t)zlBaud;
+    xsTio2.c_ospeed = (speed_t)zlBaud;
+    
+    return ioctl(zwFd, TCSETS2, &xsTio2) == 0;
+  }
+#endif
+  
+  tcgetattr(zwFd, &xsTio);
+  cfsetispeed(&xsTio, xuSpeed);
+  cfsetospeed(&xsTio, xuSpeed);
+  
+  return tcsetattr(zwFd, TCSANOW, &xsTio) == 0;
+}
+
+/******************************************************************************
+*
+*    /name       OpenSerial
+*
+*    /purpose    Opens the device raw, 8N1, at the given baud rate
+*
+*    /param[in]  zpcDevice    Device path
+*    /param[in]  zlBaud       Baud rate
+*
+*    /ret        int          File descriptor, -1 on error
+*
+******************************************************************************/
+static int OpenSerial(const char *zpcDevice, long zlBaud)
+{
+  struct termios xsTio;
+  int xwFd;
+  
+  xwFd = open(zpcDevice, O_RDWR | O_NOCTTY);
+  
+  if (xwFd < 0)
+  {
+    fprintf(stderr, "%s: %s\n", zpcDevice, strerror(errno));
+    return -1;
+  }
+  
+  tcgetattr(xwFd, &xsTio);
+  cfmakeraw(&xsTio);
+  xsTio.c_cflag |= (CLOCAL | CREAD);
+  xsTio.c_cc[VMIN] = 0;
+  xsTio.c_cc[VTIME] = 0;
+  tcsetattr(xwFd, TCSANOW, &xsTio);
+  
+  if (!SetSpeed(xwFd, zlBaud))
+  {
+    close(xwFd);
+    return -1;
+  }
+  
+  return xwFd;
+}
+
+/******************************************************************************
+*
+*    /name       ReadLine
+*
+*    /purpose    Reads one line from the device, waiting until the deadline.
+*                Carriage returns are dropped.
+*
+*    /param[in]  zwFd          File descriptor
+*    /param[out] znLine        Line read, without the newline
+*    /param[in]  zllDeadline   Host time to give up at
+*
+*    /ret        bool          true if a full line was read
+*
+******************************************************************************/
+static bool ReadLine(int zwFd, std::string &znLine, long long zllDeadline)
+{
+  static std::string xnPending;
+  
+  for (;;)
+  {
+    size_t xuEnd = xnPending.find('\n');
+    
+    if (xuEnd != std::string::npos)
+    {
+      znLine = xnPending.substr(0, xuEnd);
+      xnPending.erase(0, xuEnd + 1);
+      znLine.erase(std::remove(znLine.begin(), znLine.end(), '\r'), 
+                   znLine.end());
+      return true;
+    }
+    
+    long long xllLeft = zllDeadline - Now();
+    
+    if (xllLeft <= 0)
+    {
+      return false;
+    }
+    
+    fd_set xsSet;
+    struct timeval xsWait;
+    char xacBuf[256];
+    
+    FD_ZERO(&xsSet);
+    FD_SET(zwFd, &xsSet);
+    xsWait.tv_sec = xllLeft / 1000000LL;
+    xsWait.tv_usec = xllLeft % 1000000LL;
+    
+    if (select(zwFd + 1, &xsSet, NULL, NULL, &xsWait) <= 0)
+    {
+      continue;
+    }
+    
+    ssize_t xlRead = read(zwFd, xacBuf, sizeof(xacBuf));
+    
+    if (xlRead > 0)
+    {
+      xnPending.append(xacBuf, xlRead);
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       WaitReply
+*
+*    /purpose    Waits for a status reply line ("1" or "0", optionally 
+*                followed by a sequence number and tag), skipping anything
+*                else
+*
+*    /param[in]  zwFd          File descriptor
+*    /param[in]  zllDeadline   Host time to give up at
+*
+*    /ret        bool          true if a "1" reply arrived in time
+*
+******************************************************************************/
+static bool WaitReply(int zwFd, long long zllDeadline)
+{
+  std::string xnLine;
+  
+  while (ReadLine(zwFd, xnLine, zllDeadline))
+  {
+    if ((xnLine == "1") || (xnLine.compare(0, 2, "1 ") == 0))
+    {
+      return true;
+    }
+    
+    if ((xnLine == "0") || (xnLine.compare(0, 2, "0 ") == 0))
+    {
+      return false;
+    }
+  }
+  
+  return false;
+}
+
+/******************************************************************************
+*
+*    /name       Negotiate
+*
+*    /purpose    Switches the link to a new baud rate. The device acknowledges
+*                "baud <rate>" at the old rate, both sides switch, and the
+*                host confirms with "baudok" at the new rate. If that is not
+*                acknowledged, the host waits out the device's confirm time,
+*                so the device is back at the old rate too, and goes back.
+*
+*    /param[in]  zwFd        File descriptor
+*    /param[in]  zlOld       Current baud rate
+*    /param[in]  zlNew       Baud rate to switch to
+*
+*    /ret        bool        true if the link runs at the new rate
+*
+******************************************************************************/
+static bool Negotiate(int zwFd, long zlOld, long zlNew)
+{
+  char xacCmd[32];
+  long long xllSwitch;
+  int xwLen;
+  
+  if (BaudFlag(zlNew) == 0)
+  {
+    fprintf(stderr, "unsupported baud rate %ld\n", zlNew);
+    return false;
+  }
+  
+  // Propose
+  
+  tcflush(zwFd, TCIFLUSH);
+  xwLen = snprintf(xacCmd, sizeof(xacCmd), "baud %ld\n", zlNew);
+  
+  if ((write(zwFd, xacCmd, xwLen) != xwLen) || 
+      !WaitReply(zwFd, Now() + REPLY_TIMEOUT_US))
+  {
+    fprintf(stderr, "device refused baud %ld\n", zlNew);
+    return false;
+  }
+  
+  // Switch and confirm
+  
+  xllSwitch = Now();
+  SetSpeed(zwFd, zlNew);
+  usleep(BAUD_SETTLE_US);
+  tcflush(zwFd, TCIFLUSH);
+  
+  if ((write(zwFd, "baudok\n", 7) == 7) && 
+      WaitReply(zwFd, Now() + REPLY_TIMEOUT_US))
+  {
+    return true;
+  }
+  
+  // No confirmation. The device falls back once its confirm time from the
+  // switch has passed, so wait for that before following it.
+  
+  fprintf(stderr, "baud %ld not confirmed, staying at %ld\n", zlNew, zlOld);
+  
+  while (Now() < xllSwitch + BAUD_CONFIRM_US + BAUD_SETTLE_US)
+  {
+    usleep(BAUD_SETTLE_US);
+  }
+  
+  SetSpeed(zwFd, zlOld);
+  usleep(BAUD_SETTLE_US);
+  tcflush(zwFd, TCIOFLUSH);
+  
+  return false;
+}
+
+/******************************************************************************
+*
+*    /name       Percentile
+*
+*    /purpose    Returns a percentile of a sorted list
+*
+*    /param[in]  zaValues    Sorted values
+*    /param[in]  zfP         Percentile, 0 to 100
+*
+*    /ret        double      Value at the percentile
+*
+******************************************************************************/
+static double Percentile(const std::vector<double> &zaValues, double zfP)
+{
+  size_t xuIndex = (size_t)(zfP / 100.0 * (zaValues.size() - 1) + 0.5);
+  
+  return zaValues[std::min(xuIndex, zaValues.size() - 1)];
+}
+
+/******************************************************************************
+*
+*    /name       Report
+*
+*    /purpose    Prints the distribution of a list of latencies
+*
+*    /param[in]  zpcName     Label
+*    /param[in]  zaValues    Values, in microseconds
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Report(const char *zpcName, std::vector<double> zaValues)
+{
+  std::sort(zaValues.begin(), zaValues.end());
+  
+  printf("%-10s min %8.0f  p50 %8.0f  p95 %8.0f  p99 %8.0f  max %8.0f us\n",
+         zpcName, zaValues.front(), Percentile(zaValues, 50),
+         Percentile(zaValues, 95), Percentile(zaValues, 99), 
+         zaValues.back());
+}
+
+/******************************************************************************
+*
+*    /name       main
+*
+*    /purpose    Runs the pings and prints the results
+*
+*    /ret        int    0 on success
+*
+******************************************************************************/
+int main(int argc, char **argv)
+{
+  long xlBaud = DEFAULT_BAUD;
+  int xwCount = DEFAULT_COUNT;
+  int xwInterval = DEFAULT_INTERVAL;
+  long xlNewBaud = 0;
+  std::vector<Ping_t> xasPings;
+  long long xllLastDevice = -1;
+  long long xllWrap = 0;
+  int xwFd;
+  
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s <device> [baud] [count] [interval ms] "
+            "[new baud]\n", argv[0]);
+    return 1;
+  }
+  
+  if (argc > 2) xlBaud = atol(argv[2]);
+  if (argc > 3) xwCount = atoi(argv[3]);
+  if (argc > 4) xwInterval = atoi(argv[4]);
+  if (argc > 5) xlNewBaud = atol(argv[5]);
+  
+  xwFd = OpenSerial(argv[1], xlBaud);
+  
+  if (xwFd < 0)
+  {
+    return 1;
+  }
+  
+  // Opening the port resets most boards, let it boot and drop the banner
+  
+  usleep(RESET_WAIT_US);
+  tcflush(xwFd, TCIOFLUSH);
+  
+  // Raise the baud rate, if asked
+  
+  if ((xlNewBaud != 0) && Negotiate(xwFd, xlBaud, xlNewBaud))
+  {
+    printf("link at %ld baud\n", xlNewBaud);
+  }
+  
+  // Ping
+  
+  for (int i=0; i < xwCount; i++)
+  {
+    char xacCmd[32];
+    std::string xnLine;
+    Ping_t xsPing;
+    int xwLen = snprintf(xacCmd, sizeof(xacCmd), "ping %d\n", i);
+    bool xbMatched = false;
+    
+    xsPing.sllSent = Now();
+    
+    if (write(xwFd, xacCmd, xwLen) != xwLen)
+    {
+      fprintf(stderr, "write: %s\n", strerror(errno));
+      return 1;
+    }
+    
+    // Skip echo, events and stale replies until our pong arrives
+    
+    while (ReadLine(xwFd, xnLine, xsPing.sllSent + REPLY_TIMEOUT_US))
+    {
+      int xwNonce;
+      unsigned long xulMicros, xulSeq;
+      size_t xuStart = xnLine.find("pong ");
+      
+      if ((xuStart != std::string::npos) &&
+          (sscanf(xnLine.c_str() + xuStart, "pong %d %lu %lu", 
+                  &xwNonce, &xulMicros, &xulSeq) == 3) &&
+          (xwNonce == i))
+      {
+        xsPing.sllRecv = Now();
+        
+        // Unwrap the 32 bit device clock
+        
+        if ((xllLastDevice >= 0) && ((long long)xulMicros < xllLastDevice))
+        {
+          xllWrap += 1LL << 32;
+        }
+        
+        xllLastDevice = xulMicros;
+        xsPing.sllDevice = xllWrap + xulMicros;
+        xbMatched = true;
+        break;
+      }
+    }
+    
+    if (xbMatched)
+    {
+      xasPings.push_back(xsPing);
+    }
+    
+    usleep(xwInterval * 1000);
+  }
+  
+  close(xwFd);
+  
+  printf("%d pings, %d replies, %d lost\n", xwCount, (int)xasPings.size(),
+         xwCount - (int)xasPings.size());
+  
+  if (xasPings.size() < 2)
+  {
+    return 1;
+  }
+  
+  // Fit offset = a + b * t to the shortest round trips
+  
+  std::vector<Ping_t> xasFit = xasPings;
+  double xfSt = 0, xfSo = 0, xfStt = 0, xfSto = 0;
+  double xfA, xfB;
+  size_t xuFit;
+  
+  std::sort(xasFit.begin(), xasFit.end(), 
+            [](const Ping_t &a, const Ping_t &b) 
+            { return (a.sllRecv - a.sllSent) < (b.sllRecv - b.sllSent); });
+  
+  xuFit = std::max((size_t)2, (size_t)(xasFit.size() * FIT_FRACTION));
+  
+  for (size_t i=0; i < xuFit; i++)
+  {
+    double xfT = (xasFit[i].sllSent + xasFit[i].sllRecv) / 2.0 - 
+                 xasPings[0].sllSent;
+    double xfO = xasFit[i].sllDevice - 
+                 (xasFit[i].sllSent + xasFit[i].sllRecv) / 2.0;
+    
+    xfSt += xfT;
+    xfSo += xfO;
+    xfStt += xfT * xfT;
+    xfSto += xfT * xfO;
+  }
+  
+  if ((xuFit * xfStt - xfSt * xfSt) != 0)
+  {
+    xfB = (xuFit * xfSto - xfSt * xfSo) / (xuFit * xfStt - xfSt * xfSt);
+  }
+  else
+  {
+    xfB = 0;
+  }
+  
+  xfA = (xfSo - xfB * xfSt) / xuFit;
+  
+  printf("clock offset %.0f us, drift %.1f ppm\n", xfA, xfB * 1e6);
+  
+  // Latencies
+  
+  std::vector<double> xafRtt, xafUp, xafDown;
+  
+  for (size_t i=0; i < xasPings.size(); i++)
+  {
+    const Ping_t &xsPing = xasPings[i];
+    double xfT = (xsPing.sllSent + xsPing.sllRecv) / 2.0 - 
+                 xasPings[0].sllSent;
+    double xfDevice = xsPing.sllDevice - (xfA + xfB * xfT);
+    
+    xafRtt.push_back(xsPing.sllRecv - xsPing.sllSent);
+    xafUp.push_back(xfDevice - xsPing.sllSent);
+    xafDown.push_back(xsPing.sllRecv - xfDevice);
+  }
+  
+  Report("round trip", xafRtt);
+  Report("host->dev", xafUp);
+  Report("dev->host", xafDown);
+  
+  return 0;
+}
@@ -0,0 +1,379 @@
+/******************************************************************************
+*
+*    /file    eog_rec.cpp
+*
+*    /desc    Converts a flight recorder dump into a trace that replays
+*             through eog_sim or eog_tpl. The input is whatever was read
+*             from the board's serial port after a "dump" command: the 'R'
+*             frames are picked out of it, checked and joined into the
+*             blob the Record module describes, and ASCII lines and other
+*             frames around them are skipped.
+*
+*             The trace is "vertical horizontal" count lines, one per ms.
+*             Each recorded sample is repeated until the next one, using the
+*             gaps the board recorded between them, so blocking commands
+*             and period changes replay as they happened. The last sample
+*             is held for its own gap. -p (update period in ms, before
+*             decimation) spaces the samples evenly instead. With -l the
+*             line of the sample that changed the state also carries the
+*             new state (i, u, d, l, r, ul, ur, dl, dr), which eog_tpl
+*             reads as a label.
+*
+*             The header and the events, with their times, are printed to
+*             stderr.
+*
+*             Build (Linux):
+*               g++ -O2 -std=c++11 -o eog_rec eog_rec.cpp
+*
+*             Usage:
+*               eog_rec [-p period ms] [-l] [capture] > trace
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// ***** Definitions **********************************************************
+
+#define FRAME_SYNC         0xA5
+#define FRAME_RECORD       'R'
+#define RECORD_VERSION     2
+#define RECORD_HEADER      12              // Bytes before the samples
+#define RECORD_SAMPLE      6
+#define RECORD_EVENT       7
+
+// A decoded recording
+
+typedef struct Recording_s
+{
+  int                    swReason;
+  int                    swDecimate;
+  uint16_t               suwLastNumber;
+  uint32_t               sulLastTime;
+  std::vector<int16_t>   sawSamples;        // (vertical, horizontal) pairs
+  std::vector<uint16_t>  sauwGap;           // ms since the sample before
+  std::vector<uint32_t>  saulEventTime;
+  std::vector<uint16_t>  sauwEventNumber;
+  std::vector<int>       sawEventDirection;
+} Recording_t;
+
+// ***** Local Variables ******************************************************
+
+static const char *macDirections[] =
+{
+  "i", "u", "d", "l", "r", "ul", "ur", "dl", "dr"
+};
+
+static const char *macReasons[] =
+{
+  "running", "mark", "artifact", "stuck"
+};
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       Word
+*
+*    /purpose    Reads a little endian 16 bit value
+*
+*    /ret        uint16_t    Value
+*
+******************************************************************************/
+static uint16_t Word(const uint8_t *zpucData)
+{
+  return (uint16_t)(zpucData[0] | (zpucData[1] << 8));
+}
+
+/******************************************************************************
+*
+*    /name       Long
+*
+*    /purpose    Reads a little endian 32 bit value
+*
+*    /ret        uint32_t    Value
+*
+******************************************************************************/
+static uint32_t Long(const uint8_t *zpucData)
+{
+  return (uint32_t)Word(zpucData) | ((uint32_t)Word(zpucData + 2) << 16);
+}
+
+/******************************************************************************
+*
+*    /name       ReadBlob
+*
+*    /purpose    Joins the data of the checked 'R' frames of a capture. A
+*                chunk index of 0 starts the blob again, so the last dump
+*                in the capture is the one kept.
+*
+*    /param[in]  zpsFile    Capture
+*    /param[out] zpaucBlob  Blob
+*
+*    /ret        bool       Whether the chunks were all there, in order
+*
+******************************************************************************/
+static bool ReadBlob(FILE *zpsFile, std::vector<uint8_t> *zpaucBlob)
+{
+  std::vector<uint8_t> xaucIn;
+  uint8_t xaucBuf[4096];
+  size_t xuRead;
+  int xwNext = 0;
+  bool xbOk = true;
+
+  while ((xuRead = fread(xaucBuf, 1, sizeof(xaucBuf), zpsFile)) > 0)
+  {
+    xaucIn.insert(xaucIn.end(), xaucBuf, xaucBuf + xuRead);
+  }
+
+  // The sync byte never appears in an ASCII line, so a frame starts at
+  // every one of them
+
+  for (size_t i=0; i + 3 < xaucIn.size(); i++)
+  {
+    uint8_t xucType = xaucIn[i + 1];
+    uint8_t xucLen = xaucIn[i + 2];
+    uint8_t xucSum = xucType + xucLen;
+
+    if ((xaucIn[i] != FRAME_SYNC) || (xucType != FRAME_RECORD) ||
+        (xucLen < 1) || (i + 3 + xucLen >= xaucIn.size()))
+    {
+      continue;
+    }
+
+    for (int j=0; j < xucLen; j++)
+    {
+      xucSum += xaucIn[i + 3 + j];
+    }
+
+    if (xucSum != xaucIn[i + 3 + xucLen])
+    {
+      fprintf(stderr, "bad checksum at byte %zu\n", i);
+      xbOk = false;
+      continue;
+    }
+
+    // Chunks must follow on from each other
+
+    if (xaucIn[i + 3] == 0)
+    {
+      zpaucBlob->clear();
+      xwNext = 0;
+      xbOk = true;
+    }
+
+    if (xaucIn[i + 3] != (uint8_t)xwNext)
+    {
+      fprintf(stderr, "chunk %d missing\n", xwNext);
+      xbOk = false;
+    }
+
+    xwNext = (uint8_t)(xaucIn[i + 3] + 1);
+
+    zpaucBlob->insert(zpaucBlob->end(), &xaucIn[i + 4],
+                      &xaucIn[i + 3 + xucLen]);
+
+    i += 3 + xucLen;
+  }
+
+  return xbOk && !zpaucBlob->empty();
+}
+
+/******************************************************************************
+*
+*    /name       ParseBlob
+*
+*    /purpose    Splits a blob into the header, samples and events
+*
+*    /param[in]  zaucBlob   Blob
+*    /param[out] zpsRec     Recording
+*
+*    /ret        bool       Whether the blob was complete
+*
+******************************************************************************/
+static bool ParseBlob(const std::vector<uint8_t> &zaucBlob,
+                      Recording_t *zpsRec)
+{
+  const uint8_t *xpucData = zaucBlob.data();
+  size_t xuSamples, xuEvents;
+
+  if ((zaucBlob.size() < RECORD_HEADER) || (xpucData[0] != RECORD_VERSION))
+  {
+    return false;
+  }
+
+  zpsRec->swReason = xpucData[1];
+  zpsRec->swDecimate = xpucData[2];
+  xuEvents = xpucData[3];
+  xuSamples = Word(&xpucData[4]);
+  zpsRec->suwLastNumber = Word(&xpucData[6]);
+  zpsRec->sulLastTime = Long(&xpucData[8]);
+
+  if (zaucBlob.size() != RECORD_HEADER + xuSamples * RECORD_SAMPLE +
+                         xuEvents * RECORD_EVENT)
+  {
+    return false;
+  }
+
+  xpucData += RECORD_HEADER;
+
+  for (size_t i=0; i < xuSamples; i++, xpucData += RECORD_SAMPLE)
+  {
+    zpsRec->sawSamples.push_back((int16_t)Word(xpucData));
+    zpsRec->sawSamples.push_back((int16_t)Word(xpucData + 2));
+    zpsRec->sauwGap.push_back(Word(xpucData + 4));
+  }
+
+  for (size_t i=0; i < xuEvents; i++, xpucData += RECORD_EVENT)
+  {
+    zpsRec->saulEventTime.push_back(Long(xpucData));
+    zpsRec->sauwEventNumber.push_back(Word(xpucData + 4));
+    zpsRec->sawEventDirection.push_back(xpucData[6]);
+  }
+
+  return true;
+}
+
+/******************************************************************************
+*
+*    /name       main
+*
+*    /purpose    Reads the capture and writes the trace
+*
+*    /ret        int    0 on success
+*
+******************************************************************************/
+int main(int argc, char *argv[])
+{
+  FILE *xpsFile = stdin;
+  std::vector<uint8_t> xaucBlob;
+  std::vector<std::string> xanLabels;
+  Recording_t xsRec;
+  bool xbLabels = false;
+  long xlPeriod = 0;
+  uint32_t xulFirstTime;
+  std::vector<long> xalHold;
+  size_t xuSamples;
+  int xwOpt;
+
+  while ((xwOpt = getopt(argc, argv, "p:l")) != -1)
+  {
+    switch (xwOpt)
+    {
+      case 'p':
+        xlPeriod = atol(optarg);
+        break;
+
+      case 'l':
+        xbLabels = true;
+        break;
+
+      default:
+        fprintf(stderr, "usage: %s [-p period ms] [-l] [capture]\n",
+                argv[0]);
+        return 2;
+    }
+  }
+
+  if ((optind < argc) && ((xpsFile = fopen(argv[optind], "rb")) == NULL))
+  {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  if (!ReadBlob(xpsFile, &xaucBlob) || !ParseBlob(xaucBlob, &xsRec))
+  {
+    fprintf(stderr, "no complete dump found\n");
+    return 1;
+  }
+
+  xuSamples = xsRec.sawSamples.size() / 2;
+
+  if (xuSamples == 0)
+  {
+    fprintf(stderr, "the recording is empty\n");
+    return 1;
+  }
+
+  // Time of the first sample, back from the last over the gaps, and the ms
+  // each sample is held for. A gap of 65535 was at least that long.
+
+  xulFirstTime = xsRec.sulLastTime;
+  xalHold.resize(xuSamples);
+
+  for (size_t i=0; i < xuSamples; i++)
+  {
+    if (i > 0)
+    {
+      xulFirstTime -= xsRec.sauwGap[i];
+    }
+
+    if (xlPeriod > 0)
+    {
+      xalHold[i] = xlPeriod * xsRec.swDecimate;
+    }
+    else
+    {
+      xalHold[i] = xsRec.sauwGap[(i + 1 < xuSamples) ? i + 1 : i];
+    }
+
+    xalHold[i] = (xalHold[i] < 1) ? 1 : xalHold[i];
+  }
+
+  fprintf(stderr, "%s, %zu samples, %u to %u ms, %zu events\n",
+          (xsRec.swReason < 4) ? macReasons[xsRec.swReason] : "?",
+          xuSamples, xulFirstTime, xsRec.sulLastTime,
+          xsRec.saulEventTime.size());
+
+  // Place the events on their samples. Events older than the samples are
+  // only listed.
+
+  xanLabels.resize(xuSamples);
+
+  for (size_t e=0; e < xsRec.saulEventTime.size(); e++)
+  {
+    uint16_t xuwBack = xsRec.suwLastNumber - xsRec.sauwEventNumber[e];
+    int xwDir = xsRec.sawEventDirection[e];
+    const char *xpcName = (xwDir < 9) ? macDirections[xwDir] : "?";
+
+    fprintf(stderr, "  %u ms %s", xsRec.saulEventTime[e], xpcName);
+
+    if (xuwBack < xuSamples)
+    {
+      size_t xuIndex = xuSamples - 1 - xuwBack;
+
+      xanLabels[xuIndex] = xpcName;
+      fprintf(stderr, " at sample %zu\n", xuIndex);
+    }
+    else
+    {
+      fprintf(stderr, " before the samples\n");
+    }
+  }
+
+  // The trace
+
+  for (size_t i=0; i < xuSamples; i++)
+  {
+    for (long t=0; t < xalHold[i]; t++)
+    {
+      printf("%d %d", xsRec.sawSamples[2 * i], xsRec.sawSamples[2 * i + 1]);
+
+      if (xbLabels && (t == 0) && !xanLabels[i].empty())
+      {
+        printf(" %s", xanLabels[i].c_str());
+      }
+
+      printf("\n");
+    }
+  }
+
+  return 0;
+}
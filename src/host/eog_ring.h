@@ -0,0 +1,503 @@
+/******************************************************************************
+*
+*    /file    eog_ring.h
+*
+*    /desc    Shared memory ring written by eogd and read by any number of
+*             local processes. Header only, Linux, C++11.
+*
+*             eogd is the only writer. Each record goes into the next slot
+*             with a per-slot sequence stamp (a seqlock): odd while being
+*             written, even once complete. Readers keep their own position
+*             and read straight out of the mapping, with no system calls and
+*             no locks. A reader that falls more than a ring behind is
+*             moved up to the oldest record and told how many it lost.
+*
+*             Readers register in the consumer table so eogd can report
+*             how far behind each one is. Idle readers can block in
+*             EogRing_Wait, a futex on the publish counter, instead of
+*             polling.
+*
+*             A restarted eogd never clears a ring readers may still have
+*             mapped. It marks the old ring retired, wakes its readers and
+*             creates a new one under the same name. Readers that see
+*             EogRing_Retired close their ring and open it again.
+*
+*             Typical reader:
+*               EogRing *xpsRing = EogRing_Open(EOG_RING_NAME);
+*               int xwSlot = EogRing_Register(xpsRing);
+*               uint64_t xullPos = EogRing_Head(xpsRing);
+*               for (;;)
+*               {
+*                 EogRecord xsRec;
+*                 if (EogRing_Read(xpsRing, &xullPos, &xsRec) > 0) ...
+*                 else if (EogRing_Retired(xpsRing)) ... open it again
+*                 else EogRing_Wait(xpsRing, xullPos, 100);
+*                 EogRing_Ack(xpsRing, xwSlot, xullPos);
+*               }
+*
+******************************************************************************/
+
+#ifndef _EOG_RING_H
+#define _EOG_RING_H
+
+// ***** Include Files ********************************************************
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// ***** Definitions **********************************************************
+
+#define EOG_RING_NAME        "/eogd"
+#define EOG_RING_MAGIC       0x52474F45UL     // "EOGR"
+#define EOG_RING_VERSION     2
+#define EOG_RING_SLOTS       4096             // Power of 2
+#define EOG_RING_CONSUMERS   16
+
+// Record types
+
+typedef enum EogRecordType_e
+{
+  EOG_REC_EVENT = 1,      // Direction event
+  EOG_REC_GAZE  = 2,      // Gaze position frame
+} EogRecordType_t;
+
+// Directions, in the firmware's order
+
+typedef enum EogDirection_e
+{
+  EOG_DIR_NONE,
+  EOG_DIR_UP,
+  EOG_DIR_DOWN,
+  EOG_DIR_LEFT,
+  EOG_DIR_RIGHT,
+  EOG_DIR_UP_LEFT,
+  EOG_DIR_UP_RIGHT,
+  EOG_DIR_DOWN_LEFT,
+  EOG_DIR_DOWN_RIGHT,
+
+  EOG_DIR_MAX
+} EogDirection_t;
+
+// One decoded record. Fields the device did not send are 0.
+
+typedef struct EogRecord_s
+{
+  uint64_t   sullHostNs;      // CLOCK_MONOTONIC when eogd decoded it
+  uint32_t   sulDeviceMs;     // Device sample time
+  uint16_t   suwDeviceSeq;    // Device sequence number
+  uint8_t    sucType;         // EogRecordType_t
+  uint8_t    sucDevice;       // Index of the device on the eogd command line
+  uint8_t    sucDirection;    // EogDirection_t, events only
+  uint8_t    saucPad[3];
+  float      sfWeight;        // Detection weight, events only
+  float      sfPeak;          // Peak delta in Volts, events only
+  int16_t    swX;             // Gaze x, Q15, positive RIGHT
+  int16_t    swY;             // Gaze y, Q15, positive UP
+} EogRecord;
+
+// Slot - the stamp is 2 * position + 1 while writing, 2 * position + 2
+// once the record is complete
+
+typedef struct EogSlot_s
+{
+  std::atomic<uint64_t>  sullStamp;
+  EogRecord              ssRecord;
+} EogSlot;
+
+// Registered reader, pid 0 is a free entry
+
+typedef struct EogConsumer_s
+{
+  std::atomic<int32_t>   slPid;
+  std::atomic<uint64_t>  sullPos;
+} EogConsumer;
+
+// The shared memory layout
+
+typedef struct EogRing_s
+{
+  uint32_t               sulMagic;
+  uint32_t               sulVersion;
+  uint32_t               sulSlots;
+  std::atomic<uint32_t>  sulSignal;       // Futex word, bumped per publish
+  std::atomic<uint32_t>  sulWaiters;
+  std::atomic<uint32_t>  sulRetired;      // Set once a new ring replaces it
+  std::atomic<uint64_t>  sullHead;        // Next position to write
+  EogConsumer            sasConsumers[EOG_RING_CONSUMERS];
+  EogSlot                sasSlots[EOG_RING_SLOTS];
+} EogRing;
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       EogRing_Wake
+*
+*    /purpose    Wakes readers blocked in EogRing_Wait. Costs a system call
+*                only when somebody is waiting.
+*
+*    /ret        void
+*
+******************************************************************************/
+static inline void EogRing_Wake(EogRing *zpsRing)
+{
+  zpsRing->sulSignal.fetch_add(1, std::memory_order_release);
+
+  if (zpsRing->sulWaiters.load(std::memory_order_acquire) != 0)
+  {
+    syscall(SYS_futex, &zpsRing->sulSignal, FUTEX_WAKE, INT32_MAX,
+            NULL, NULL, 0);
+  }
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_Map
+*
+*    /purpose    Maps the ring, creating it if asked (writer). A ring that
+*                already exists is retired and unlinked, and a new one is
+*                created in its place, so readers that still have the old
+*                one mapped never see it cleared.
+*
+*    /param[in]  zpcName     Shared memory name, e.g. EOG_RING_NAME
+*    /param[in]  zbCreate    true to create it (eogd only)
+*
+*    /ret        EogRing*    The ring, NULL on error (errno set)
+*
+******************************************************************************/
+static inline EogRing *EogRing_Map(const char *zpcName, bool zbCreate)
+{
+  int xwFd;
+  void *xpvMem;
+
+  // Retire the ring of a previous writer
+
+  if (zbCreate)
+  {
+    EogRing *xpsOld = EogRing_Map(zpcName, false);
+
+    if (xpsOld != NULL)
+    {
+      xpsOld->sulRetired.store(1, std::memory_order_release);
+      EogRing_Wake(xpsOld);
+      munmap(xpsOld, sizeof(EogRing));
+    }
+
+    shm_unlink(zpcName);
+  }
+
+  xwFd = shm_open(zpcName, zbCreate ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR,
+                  0666);
+
+  if (xwFd < 0)
+  {
+    return NULL;
+  }
+
+  if (zbCreate && (ftruncate(xwFd, sizeof(EogRing)) != 0))
+  {
+    close(xwFd);
+    return NULL;
+  }
+
+  xpvMem = mmap(NULL, sizeof(EogRing), PROT_READ | PROT_WRITE, MAP_SHARED,
+                xwFd, 0);
+  close(xwFd);
+
+  if (xpvMem == MAP_FAILED)
+  {
+    return NULL;
+  }
+
+  EogRing *xpsRing = (EogRing *)xpvMem;
+
+  // A new object reads as zeros, only the header needs setting
+
+  if (zbCreate)
+  {
+    xpsRing->sulSlots = EOG_RING_SLOTS;
+    xpsRing->sulVersion = EOG_RING_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    xpsRing->sulMagic = EOG_RING_MAGIC;
+  }
+  else if ((xpsRing->sulMagic != EOG_RING_MAGIC) ||
+           (xpsRing->sulVersion != EOG_RING_VERSION))
+  {
+    munmap(xpvMem, sizeof(EogRing));
+    errno = EPROTO;
+    return NULL;
+  }
+
+  return xpsRing;
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_Open
+*
+*    /purpose    Maps an existing ring for reading
+*
+*    /param[in]  zpcName     Shared memory name
+*
+*    /ret        EogRing*    The ring, NULL on error (errno set)
+*
+******************************************************************************/
+static inline EogRing *EogRing_Open(const char *zpcName)
+{
+  return EogRing_Map(zpcName, false);
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_Close
+*
+*    /purpose    Unmaps a ring
+*
+*    /ret        void
+*
+******************************************************************************/
+static inline void EogRing_Close(EogRing *zpsRing)
+{
+  munmap(zpsRing, sizeof(EogRing));
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_Retired
+*
+*    /purpose    Returns whether a new ring has replaced this one, after a
+*                restart of the writer. Nothing more is published to it.
+*
+*    /ret        bool    true once retired
+*
+******************************************************************************/
+static inline bool EogRing_Retired(EogRing *zpsRing)
+{
+  return zpsRing->sulRetired.load(std::memory_order_acquire) != 0;
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_Head
+*
+*    /purpose    Returns the position the next record will be written to.
+*                Start reading here to see only new records.
+*
+*    /ret        uint64_t    Head position
+*
+******************************************************************************/
+static inline uint64_t EogRing_Head(EogRing *zpsRing)
+{
+  return zpsRing->sullHead.load(std::memory_order_acquire);
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_Publish
+*
+*    /purpose    Writes a record at the head. Single writer only. Does not
+*                wake waiting readers, see EogRing_Wake.
+*
+*    /param[io]  zpsRing     The ring
+*    /param[in]  zpsRecord   Record to write
+*
+*    /ret        void
+*
+******************************************************************************/
+static inline void EogRing_Publish(EogRing *zpsRing, const EogRecord *zpsRecord)
+{
+  uint64_t xullPos = zpsRing->sullHead.load(std::memory_order_relaxed);
+  EogSlot *xpsSlot = &zpsRing->sasSlots[xullPos & (EOG_RING_SLOTS - 1)];
+
+  xpsSlot->sullStamp.store(2 * xullPos + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  memcpy(&xpsSlot->ssRecord, zpsRecord, sizeof(EogRecord));
+
+  xpsSlot->sullStamp.store(2 * xullPos + 2, std::memory_order_release);
+  zpsRing->sullHead.store(xullPos + 1, std::memory_order_release);
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_Read
+*
+*    /purpose    Copies the record at the reader's position and moves the
+*                position on. A reader that has been overtaken is moved to
+*                the oldest record still in the ring.
+*
+*    /param[in]  zpsRing     The ring
+*    /param[io]  zpullPos    The reader's position
+*    /param[out] zpsRecord   The record
+*
+*    /ret        int         1 record read, 0 nothing new, otherwise minus
+*                            the number of records lost (position moved)
+*
+******************************************************************************/
+static inline int EogRing_Read(EogRing *zpsRing, uint64_t *zpullPos,
+                               EogRecord *zpsRecord)
+{
+  uint64_t xullHead = zpsRing->sullHead.load(std::memory_order_acquire);
+  uint64_t xullPos = *zpullPos;
+  EogSlot *xpsSlot;
+  uint64_t xullStamp;
+
+  if (xullPos >= xullHead)
+  {
+    return 0;
+  }
+
+  // Overtaken, skip to the oldest complete record
+
+  if ((xullHead - xullPos) >= EOG_RING_SLOTS)
+  {
+    *zpullPos = xullHead - EOG_RING_SLOTS + 1;
+    return -(int)(*zpullPos - xullPos);
+  }
+
+  xpsSlot = &zpsRing->sasSlots[xullPos & (EOG_RING_SLOTS - 1)];
+
+  xullStamp = xpsSlot->sullStamp.load(std::memory_order_acquire);
+  memcpy(zpsRecord, &xpsSlot->ssRecord, sizeof(EogRecord));
+  std::atomic_thread_fence(std::memory_order_acquire);
+
+  // Rewritten while copying
+
+  if ((xullStamp != 2 * xullPos + 2) ||
+      (xpsSlot->sullStamp.load(std::memory_order_relaxed) != xullStamp))
+  {
+    xullHead = zpsRing->sullHead.load(std::memory_order_acquire);
+    *zpullPos = xullHead - EOG_RING_SLOTS + 1;
+    return -(int)(*zpullPos - xullPos);
+  }
+
+  *zpullPos = xullPos + 1;
+
+  return 1;
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_Wait
+*
+*    /purpose    Blocks until a record past the position is published or the
+*                timeout passes
+*
+*    /param[in]  zpsRing     The ring
+*    /param[in]  zullPos     The reader's position
+*    /param[in]  zwTimeout   Timeout in ms
+*
+*    /ret        void
+*
+******************************************************************************/
+static inline void EogRing_Wait(EogRing *zpsRing, uint64_t zullPos,
+                                int zwTimeout)
+{
+  struct timespec xsTimeout;
+  uint32_t xulSignal = zpsRing->sulSignal.load(std::memory_order_acquire);
+
+  xsTimeout.tv_sec = zwTimeout / 1000;
+  xsTimeout.tv_nsec = (zwTimeout % 1000) * 1000000L;
+
+  zpsRing->sulWaiters.fetch_add(1, std::memory_order_acq_rel);
+
+  if (EogRing_Head(zpsRing) <= zullPos)
+  {
+    syscall(SYS_futex, &zpsRing->sulSignal, FUTEX_WAIT, xulSignal,
+            &xsTimeout, NULL, 0);
+  }
+
+  zpsRing->sulWaiters.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_Register
+*
+*    /purpose    Takes a consumer table entry so eogd can report this
+*                reader's lag
+*
+*    /ret        int    Entry index, -1 if the table is full
+*
+******************************************************************************/
+static inline int EogRing_Register(EogRing *zpsRing)
+{
+  for (int i=0; i < EOG_RING_CONSUMERS; i++)
+  {
+    int32_t xlFree = 0;
+
+    if (zpsRing->sasConsumers[i].slPid.compare_exchange_strong(xlFree,
+                                                               getpid()))
+    {
+      zpsRing->sasConsumers[i].sullPos.store(EogRing_Head(zpsRing));
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_Ack
+*
+*    /purpose    Publishes the reader's position for lag reporting
+*
+*    /ret        void
+*
+******************************************************************************/
+static inline void EogRing_Ack(EogRing *zpsRing, int zwSlot, uint64_t zullPos)
+{
+  if (zwSlot >= 0)
+  {
+    zpsRing->sasConsumers[zwSlot].sullPos.store(zullPos,
+                                                std::memory_order_relaxed);
+  }
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_Unregister
+*
+*    /purpose    Frees a consumer table entry
+*
+*    /ret        void
+*
+******************************************************************************/
+static inline void EogRing_Unregister(EogRing *zpsRing, int zwSlot)
+{
+  if (zwSlot >= 0)
+  {
+    zpsRing->sasConsumers[zwSlot].slPid.store(0);
+  }
+}
+
+/******************************************************************************
+*
+*    /name       EogRing_NowNs
+*
+*    /purpose    CLOCK_MONOTONIC in ns, the time base of sullHostNs
+*
+*    /ret        uint64_t    Time in ns
+*
+******************************************************************************/
+static inline uint64_t EogRing_NowNs()
+{
+  struct timespec xsTime;
+
+  clock_gettime(CLOCK_MONOTONIC, &xsTime);
+
+  return (uint64_t)xsTime.tv_sec * 1000000000ULL + xsTime.tv_nsec;
+}
+
+#endif    // !defined _EOG_RING_H
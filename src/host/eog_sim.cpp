@@ -0,0 +1,753 @@
+/******************************************************************************
+*
+*    /file    eog_sim.cpp
+*
+*    /desc    Scaling harness for eogd. For each device count N it starts N
+*             simulated boards, each the real EOG_Firmware modules built
+*             against the fake HAL in sim/ and run in its own process on a
+*             pseudo-terminal, starts eogd on those terminals and measures
+*             the host pipeline:
+*               - events per second through the ring
+*               - CPU per simulated board and for eogd
+*               - latency from the tick that produced a sample to a ring
+*                 reader seeing the event for it, p50/p99/p99.9/max
+*
+*             Boards do not run free. A pool of threads drives them, one
+*             byte on a board's tick pipe being one ms of its virtual time
+*             (one ADC sample and one loop() pass), so N boards cost the
+*             host the same whatever the machine, and the latency of each
+*             event is measured from the host time of its sample's tick.
+*
+*             Each board replays its own trace of (vertical, horizontal)
+*             counts: a trace file given on the command line (one pair per
+*             line, one line per ms, used round-robin) or else a seeded
+*             random saccade trace. Boards start with auto calibration,
+*             a 10 ms period and binary events ("evt 2").
+*
+*             The firmware is built for the host, where int is 32 bits, so
+*             the sim does not reproduce the AVR's 16 bit int: overflow and
+*             promotion bugs in int or unsigned arithmetic will not show up
+*             here and must still be checked against the AVR build.
+*
+*             Build (Linux, from src/host):
+*               g++ -O2 -std=gnu++11 -pthread -Isim \
+*                   -I../EOG_Firmware/EOG_Firmware -o eog_sim eog_sim.cpp \
+*                   sim/sim_hal.cpp ../EOG_Firmware/EOG_Firmware/[A-Z]*.cpp \
+*                   -x c++ ../EOG_Firmware/EOG_Firmware/EOG_Firmware.ino \
+*                   -lrt -lutil
+*
+*             Usage:
+*               eog_sim [-n counts] [-r tick Hz] [-t s] [-k threads]
+*                       [-d eogd] [-s seed] [trace ...]
+*               eog_sim -n 1,2,4,8,16,32 -t 10 -d ./eogd
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pty.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "eog_ring.h"
+#include "sim_hal.h"
+
+// ***** Definitions **********************************************************
+
+#define SIM_RING_NAME      "/eogsim"
+#define SIM_STARTUP        "auto 1; set period 10; evt 2\n"
+#define SIM_BOOT_MS        2000             // Virtual ms of tick 0
+#define SIM_SETTLE_MS      500              // Ticks before measuring
+#define SIM_TRACE_MS       20000            // Length of generated traces
+
+// Generated trace shape, in ADC counts
+
+#define TRACE_BASE         8000
+#define TRACE_STEP         600
+#define TRACE_NOISE        8
+
+// Firmware entry points, from EOG_Firmware.ino
+
+void setup();
+void loop();
+
+// One simulated board
+
+typedef struct Board_s
+{
+  pid_t                   slPid;
+  int                     swMaster;
+  int                     swSlave;
+  int                     swTick;
+  char                    sacPath[64];
+  std::vector<int16_t>    sawTrace;
+  std::unique_ptr<std::atomic<uint64_t>[]>
+                          saullTickNs;      // Host ns of each virtual ms,
+                                            // written by the tick threads,
+                                            // read by the ring reader
+} Board_t;
+
+// ***** Local Variables ******************************************************
+
+static volatile sig_atomic_t mbStop = 0;
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       OnSignal
+*
+*    /purpose    Stops the current run
+*
+*    /ret        void
+*
+******************************************************************************/
+static void OnSignal(int)
+{
+  mbStop = 1;
+}
+
+/******************************************************************************
+*
+*    /name       GenerateTrace
+*
+*    /purpose    Makes a random saccade trace: fixations of 100 to 300 ms
+*                with a step of the eyes to one of the eight directions and
+*                back, over a noisy baseline
+*
+*    /param[in]  zulSeed    Random seed
+*    /param[out] zpawTrace  (vertical, horizontal) pairs, one per ms
+*
+*    /ret        void
+*
+******************************************************************************/
+static void GenerateTrace(unsigned long zulSeed,
+                          std::vector<int16_t> *zpawTrace)
+{
+  static const int xaawStep[8][2] =
+  {
+    { 1, 0 }, { -1, 0 }, { 0, -1 }, { 0, 1 },
+    { 1, -1 }, { 1, 1 }, { -1, -1 }, { -1, 1 }
+  };
+  std::mt19937 xsRng(zulSeed);
+  std::normal_distribution<float> xsNoise(0.0f, TRACE_NOISE);
+  int xwDir = 0, xwLeft = 0;
+  bool xbAway = false;
+
+  zpawTrace->resize(2 * SIM_TRACE_MS);
+
+  for (int i=0; i < SIM_TRACE_MS; i++)
+  {
+    float xfV = TRACE_BASE, xfH = TRACE_BASE;
+
+    // Hold, look away, hold, look back
+
+    if (xwLeft-- <= 0)
+    {
+      xbAway = !xbAway;
+      xwLeft = 100 + (int)(xsRng() % 200);
+
+      if (xbAway)
+      {
+        xwDir = (int)(xsRng() % 8);
+      }
+    }
+
+    if (xbAway)
+    {
+      xfV += xaawStep[xwDir][0] * TRACE_STEP;
+      xfH += xaawStep[xwDir][1] * TRACE_STEP;
+    }
+
+    (*zpawTrace)[2 * i] = (int16_t)(xfV + xsNoise(xsRng));
+    (*zpawTrace)[2 * i + 1] = (int16_t)(xfH + xsNoise(xsRng));
+  }
+}
+
+/******************************************************************************
+*
+*    /name       LoadTrace
+*
+*    /purpose    Reads a trace file of "vertical horizontal" count lines
+*
+*    /param[in]  zpcPath    File
+*    /param[out] zpawTrace  (vertical, horizontal) pairs
+*
+*    /ret        bool       Whether at least one sample was read
+*
+******************************************************************************/
+static bool LoadTrace(const char *zpcPath, std::vector<int16_t> *zpawTrace)
+{
+  FILE *xpsFile = fopen(zpcPath, "r");
+  int xwV, xwH;
+
+  if (xpsFile == NULL)
+  {
+    return false;
+  }
+
+  zpawTrace->clear();
+
+  while (fscanf(xpsFile, "%d %d", &xwV, &xwH) == 2)
+  {
+    zpawTrace->push_back((int16_t)xwV);
+    zpawTrace->push_back((int16_t)xwH);
+  }
+
+  fclose(xpsFile);
+
+  return !zpawTrace->empty();
+}
+
+/******************************************************************************
+*
+*    /name       CloseOthers
+*
+*    /purpose    In a child, closes the descriptors inherited for the other
+*                boards, so each tick pipe has a single writer and closes
+*                when the harness closes it
+*
+*    /param[in]  zwKeepA    Descriptor to keep, or -1
+*    /param[in]  zwKeepB    Descriptor to keep, or -1
+*
+*    /ret        void
+*
+******************************************************************************/
+static void CloseOthers(int zwKeepA, int zwKeepB)
+{
+  long xlMax = sysconf(_SC_OPEN_MAX);
+
+  for (int i=3; i < xlMax; i++)
+  {
+    if ((i != zwKeepA) && (i != zwKeepB))
+    {
+      close(i);
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       RunBoard
+*
+*    /purpose    Body of a board process. Runs the firmware, one loop()
+*                per byte read from the tick pipe until the pipe closes.
+*                Tick k runs at SIM_BOOT_MS + k ms of virtual time, after
+*                whatever setup() spent in delays, so the harness can match
+*                event times to ticks.
+*
+*    /param[in]  zpsBoard   Board to run
+*
+*    /ret        void
+*
+******************************************************************************/
+static void RunBoard(Board_t *zpsBoard)
+{
+  unsigned char xaucTicks[64];
+  unsigned long long xullTick = 0;
+  ssize_t xlGot;
+
+  fcntl(zpsBoard->swMaster, F_SETFL, O_NONBLOCK);
+
+  SimHal_Attach(zpsBoard->swMaster, zpsBoard->sawTrace.data(),
+                zpsBoard->sawTrace.size() / 2);
+  SimHal_Inject(SIM_STARTUP);
+
+  setup();
+
+  while ((xlGot = read(zpsBoard->swTick, xaucTicks, sizeof(xaucTicks))) != 0)
+  {
+    if (xlGot < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      break;
+    }
+
+    for (ssize_t i=0; i < xlGot; i++)
+    {
+      xullTick++;
+      SimHal_SetMicros((SIM_BOOT_MS + xullTick) * 1000ULL);
+      loop();
+    }
+  }
+
+  _exit(0);
+}
+
+/******************************************************************************
+*
+*    /name       StartBoard
+*
+*    /purpose    Opens a pseudo-terminal and a tick pipe for a board and forks
+*                its process
+*
+*    /param[io]  zpsBoard   Board, with its trace set
+*
+*    /ret        bool       Whether the board started
+*
+******************************************************************************/
+static bool StartBoard(Board_t *zpsBoard)
+{
+  struct termios xsTio;
+  int xawPipe[2];
+
+  if (openpty(&zpsBoard->swMaster, &zpsBoard->swSlave, zpsBoard->sacPath,
+              NULL, NULL) != 0)
+  {
+    perror("openpty");
+    return false;
+  }
+
+  // Raw on both sides, eogd sets its own modes when it opens the slave
+
+  tcgetattr(zpsBoard->swSlave, &xsTio);
+  cfmakeraw(&xsTio);
+  tcsetattr(zpsBoard->swSlave, TCSANOW, &xsTio);
+
+  if (pipe(xawPipe) != 0)
+  {
+    perror("pipe");
+    return false;
+  }
+
+  zpsBoard->slPid = fork();
+
+  if (zpsBoard->slPid == 0)
+  {
+    zpsBoard->swTick = xawPipe[0];
+    CloseOthers(zpsBoard->swMaster, zpsBoard->swTick);
+    RunBoard(zpsBoard);
+  }
+
+  close(xawPipe[0]);
+  zpsBoard->swTick = xawPipe[1];
+
+  return zpsBoard->slPid > 0;
+}
+
+/******************************************************************************
+*
+*    /name       CpuTicks
+*
+*    /purpose    Reads the user plus system CPU time of a process
+*
+*    /param[in]  zlPid      Process
+*
+*    /ret        unsigned long long    Clock ticks, 0 if unknown
+*
+******************************************************************************/
+static unsigned long long CpuTicks(pid_t zlPid)
+{
+  char xacPath[64], xacBuf[1024];
+  unsigned long long xullUser = 0, xullSystem = 0;
+  const char *xpcFields;
+  FILE *xpsFile;
+  size_t xuLen;
+
+  snprintf(xacPath, sizeof(xacPath), "/proc/%d/stat", (int)zlPid);
+  xpsFile = fopen(xacPath, "r");
+
+  if (xpsFile == NULL)
+  {
+    return 0;
+  }
+
+  xuLen = fread(xacBuf, 1, sizeof(xacBuf) - 1, xpsFile);
+  xacBuf[xuLen] = '\0';
+  fclose(xpsFile);
+
+  // Fields after the command name, utime and stime are the 12th and 13th
+
+  xpcFields = strrchr(xacBuf, ')');
+
+  if ((xpcFields == NULL) ||
+      (sscanf(xpcFields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+              "%llu %llu", &xullUser, &xullSystem) != 2))
+  {
+    return 0;
+  }
+
+  return xullUser + xullSystem;
+}
+
+/******************************************************************************
+*
+*    /name       Percentile
+*
+*    /purpose    Reads a percentile from sorted samples
+*
+*    /ret        double     The sample, 0 if there are none
+*
+******************************************************************************/
+static double Percentile(const std::vector<double> &zafSorted, double zfP)
+{
+  if (zafSorted.empty())
+  {
+    return 0.0;
+  }
+
+  return zafSorted[std::min(zafSorted.size() - 1,
+                            (size_t)(zafSorted.size() * zfP))];
+}
+
+/******************************************************************************
+*
+*    /name       RunStep
+*
+*    /purpose    Measures one device count: starts the boards and eogd,
+*                ticks the boards for the run time and reports
+*
+*    /param[in]  zwBoards   Device count
+*    /param[in]  zwRate     Ticks per second per board
+*    /param[in]  zwSeconds  Run time
+*    /param[in]  zwThreads  Tick threads
+*    /param[in]  zpcEogd    eogd binary
+*    /param[in]  zulSeed    Seed for generated traces
+*    /param[in]  zapcTraces Trace files
+*
+*    /ret        bool       Whether the step ran
+*
+******************************************************************************/
+static bool RunStep(int zwBoards, int zwRate, int zwSeconds, int zwThreads,
+                    const char *zpcEogd, unsigned long zulSeed,
+                    const std::vector<const char *> &zapcTraces)
+{
+  std::vector<Board_t> xasBoards(zwBoards);
+  unsigned long xulTicks = (unsigned long)zwRate * zwSeconds + SIM_SETTLE_MS;
+  std::atomic<bool> xbDone(false);
+  std::vector<std::thread> xasThreads;
+  std::vector<double> xafLatency;
+  std::vector<unsigned long long> xaullCpu(zwBoards + 1);
+  unsigned long long xullCpuBoards = 0, xullCpuEogd;
+  unsigned long xulEvents = 0, xulLost = 0, xulLate = 0;
+  uint64_t xullStart, xullEnd;
+  EogRing *xpsRing;
+  pid_t xlEogd;
+
+  // Boards
+
+  for (int i=0; i < zwBoards; i++)
+  {
+    Board_t *xpsBoard = &xasBoards[i];
+
+    if (!zapcTraces.empty())
+    {
+      if (!LoadTrace(zapcTraces[i % zapcTraces.size()], &xpsBoard->sawTrace))
+      {
+        fprintf(stderr, "%s: no samples\n", zapcTraces[i % zapcTraces.size()]);
+        return false;
+      }
+    }
+    else
+    {
+      GenerateTrace(zulSeed + i, &xpsBoard->sawTrace);
+    }
+
+    xpsBoard->saullTickNs.reset(new std::atomic<uint64_t>[xulTicks + 1]());
+
+    if (!StartBoard(xpsBoard))
+    {
+      return false;
+    }
+  }
+
+  // eogd on the boards' terminals, then a reader on its ring
+
+  xlEogd = fork();
+
+  if (xlEogd == 0)
+  {
+    std::vector<char *> xapcArgs;
+
+    CloseOthers(-1, -1);
+    xapcArgs.push_back((char *)zpcEogd);
+    xapcArgs.push_back((char *)"-n");
+    xapcArgs.push_back((char *)SIM_RING_NAME);
+    xapcArgs.push_back((char *)"-w");
+    xapcArgs.push_back((char *)"0");
+    xapcArgs.push_back((char *)"-s");
+    xapcArgs.push_back((char *)"3600");
+
+    for (int i=0; i < zwBoards; i++)
+    {
+      xapcArgs.push_back(xasBoards[i].sacPath);
+    }
+
+    xapcArgs.push_back(NULL);
+    execv(zpcEogd, xapcArgs.data());
+    perror(zpcEogd);
+    _exit(127);
+  }
+
+  xpsRing = NULL;
+
+  for (int i=0; (i < 200) && (xpsRing == NULL); i++)
+  {
+    usleep(10000);
+    xpsRing = EogRing_Open(SIM_RING_NAME);
+  }
+
+  if (xpsRing == NULL)
+  {
+    fprintf(stderr, "eog_sim: eogd did not open %s\n", SIM_RING_NAME);
+    kill(xlEogd, SIGTERM);
+    return false;
+  }
+
+  // Give eogd time to open every terminal before ticks make output
+
+  usleep(100000);
+
+  // Reader: match each event to the host time of its sample's tick
+
+  std::thread xsReader([&]()
+  {
+    int xwSlot = EogRing_Register(xpsRing);
+    uint64_t xullPos = EogRing_Head(xpsRing);
+
+    while (!xbDone.load())
+    {
+      EogRecord xsRec;
+      int xwGot = EogRing_Read(xpsRing, &xullPos, &xsRec);
+
+      if (xwGot == 0)
+      {
+        EogRing_Ack(xpsRing, xwSlot, xullPos);
+        EogRing_Wait(xpsRing, xullPos, 10);
+      }
+      else if (xwGot < 0)
+      {
+        xulLost += -xwGot;
+      }
+      else if ((xsRec.sucType == EOG_REC_EVENT) &&
+               (xsRec.sucDevice < xasBoards.size()) &&
+               (xsRec.sulDeviceMs > SIM_BOOT_MS + SIM_SETTLE_MS) &&
+               (xsRec.sulDeviceMs <= SIM_BOOT_MS + xulTicks))
+      {
+        uint64_t xullTick = xasBoards[xsRec.sucDevice]
+                              .saullTickNs[xsRec.sulDeviceMs - SIM_BOOT_MS]
+                              .load(std::memory_order_acquire);
+
+        xulEvents++;
+
+        if (xullTick != 0)
+        {
+          xafLatency.push_back((EogRing_NowNs() - xullTick) / 1000.0);
+        }
+        else
+        {
+          xulLate++;
+        }
+      }
+    }
+
+    EogRing_Unregister(xpsRing, xwSlot);
+  });
+
+  // Tick threads, each owning every zwThreads'th board
+
+  for (int t=0; t < zwThreads; t++)
+  {
+    xasThreads.push_back(std::thread([&, t]()
+    {
+      uint64_t xullPeriod = 1000000000ULL / zwRate;
+      struct timespec xsNext;
+
+      clock_gettime(CLOCK_MONOTONIC, &xsNext);
+
+      for (unsigned long k=1; (k <= xulTicks) && !mbStop; k++)
+      {
+        for (int i=t; i < zwBoards; i += zwThreads)
+        {
+          Board_t *xpsBoard = &xasBoards[i];
+          unsigned char xucTick = 0;
+
+          xpsBoard->saullTickNs[k].store(EogRing_NowNs(),
+                                         std::memory_order_release);
+
+          if (write(xpsBoard->swTick, &xucTick, 1) != 1)
+          {
+            mbStop = 1;
+          }
+        }
+
+        xsNext.tv_nsec += xullPeriod;
+
+        while (xsNext.tv_nsec >= 1000000000L)
+        {
+          xsNext.tv_nsec -= 1000000000L;
+          xsNext.tv_sec++;
+        }
+
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &xsNext, NULL);
+      }
+    }));
+  }
+
+  // CPU over the measured part, after the settle time
+
+  usleep((SIM_SETTLE_MS * 1000000ULL) / zwRate);
+
+  for (int i=0; i < zwBoards; i++)
+  {
+    xaullCpu[i] = CpuTicks(xasBoards[i].slPid);
+  }
+
+  xaullCpu[zwBoards] = CpuTicks(xlEogd);
+  xullStart = EogRing_NowNs();
+
+  for (size_t t=0; t < xasThreads.size(); t++)
+  {
+    xasThreads[t].join();
+  }
+
+  xullEnd = EogRing_NowNs();
+
+  for (int i=0; i < zwBoards; i++)
+  {
+    xullCpuBoards += CpuTicks(xasBoards[i].slPid) - xaullCpu[i];
+  }
+
+  xullCpuEogd = CpuTicks(xlEogd) - xaullCpu[zwBoards];
+
+  // Let the last events drain, then stop everything
+
+  usleep(200000);
+  xbDone.store(true);
+  xsReader.join();
+
+  kill(xlEogd, SIGTERM);
+  waitpid(xlEogd, NULL, 0);
+
+  for (int i=0; i < zwBoards; i++)
+  {
+    close(xasBoards[i].swTick);
+    waitpid(xasBoards[i].slPid, NULL, 0);
+    close(xasBoards[i].swMaster);
+    close(xasBoards[i].swSlave);
+  }
+
+  munmap(xpsRing, sizeof(EogRing));
+
+  // Report
+
+  {
+    double xfSeconds = (xullEnd - xullStart) / 1e9;
+    double xfTick = (double)sysconf(_SC_CLK_TCK);
+
+    std::sort(xafLatency.begin(), xafLatency.end());
+
+    printf("%4d %9.1f %8.1f %8.1f %9.1f %9.1f %9.1f %9.1f %6lu %5lu\n",
+           zwBoards, xulEvents / xfSeconds,
+           100.0 * xullCpuBoards / xfTick / xfSeconds / zwBoards,
+           100.0 * xullCpuEogd / xfTick / xfSeconds,
+           Percentile(xafLatency, 0.50), Percentile(xafLatency, 0.99),
+           Percentile(xafLatency, 0.999),
+           xafLatency.empty() ? 0.0 : xafLatency.back(), xulLost, xulLate);
+    fflush(stdout);
+  }
+
+  return !mbStop;
+}
+
+/******************************************************************************
+*
+*    /name       main
+*
+*    /purpose    Runs a step per device count
+*
+*    /ret        int    0 on success
+*
+******************************************************************************/
+int main(int argc, char **argv)
+{
+  std::vector<int> xawCounts;
+  std::vector<const char *> xapcTraces;
+  const char *xpcCounts = "1,2,4,8";
+  const char *xpcEogd = "./eogd";
+  unsigned long xulSeed = 1;
+  int xwRate = 1000, xwSeconds = 5, xwThreads = 4, xwOpt;
+
+  while ((xwOpt = getopt(argc, argv, "n:r:t:k:d:s:")) != -1)
+  {
+    switch (xwOpt)
+    {
+      case 'n': xpcCounts = optarg;                    break;
+      case 'r': xwRate = atoi(optarg);                 break;
+      case 't': xwSeconds = atoi(optarg);              break;
+      case 'k': xwThreads = atoi(optarg);              break;
+      case 'd': xpcEogd = optarg;                      break;
+      case 's': xulSeed = strtoul(optarg, NULL, 0);    break;
+      default:
+        fprintf(stderr, "usage: %s [-n counts] [-r tick Hz] [-t s]"
+                " [-k threads] [-d eogd] [-s seed] [trace ...]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  for (const char *xpc = xpcCounts; *xpc != '\0'; )
+  {
+    char *xpcEnd;
+    long xlCount = strtol(xpc, &xpcEnd, 10);
+
+    if ((xpcEnd == xpc) || (xlCount < 1) || (xlCount > 255))
+    {
+      fprintf(stderr, "%s: device counts are 1 to 255\n", argv[0]);
+      return 1;
+    }
+
+    xawCounts.push_back((int)xlCount);
+    xpc = (*xpcEnd == ',') ? xpcEnd + 1 : xpcEnd;
+  }
+
+  if ((xwRate < 1) || (xwRate > 100000) || (xwSeconds < 1) || (xwThreads < 1))
+  {
+    fprintf(stderr, "%s: bad rate, time or threads\n", argv[0]);
+    return 1;
+  }
+
+  for (int i=optind; i < argc; i++)
+  {
+    xapcTraces.push_back(argv[i]);
+  }
+
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  printf("# %d Hz ticks, %d s per step, %d tick threads\n", xwRate,
+         xwSeconds, xwThreads);
+  printf("#  N  events/s  cpu/dev%%  eogd%%   p50 us    p99 us  p99.9 us"
+         "    max us   lost  late\n");
+
+  for (size_t i=0; (i < xawCounts.size()) && !mbStop; i++)
+  {
+    if (!RunStep(xawCounts[i], xwRate, xwSeconds,
+                 std::min(xwThreads, xawCounts[i]), xpcEogd, xulSeed,
+                 xapcTraces))
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
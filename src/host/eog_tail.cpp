@@ -0,0 +1,182 @@
+/******************************************************************************
+*
+*    /file    eog_tail.cpp
+*
+*    /desc    Example reader of the eogd shared memory ring. Prints each
+*             record as it arrives with the time from eogd decoding it to
+*             this process seeing it, or with -q only a summary of that
+*             handoff latency every second.
+*
+*             Build (Linux):
+*               g++ -O2 -std=c++11 -o eog_tail eog_tail.cpp -lrt
+*
+*             Usage:
+*               eog_tail [-n shm name] [-q]
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <signal.h>
+
+#include "eog_ring.h"
+
+// ***** Local Variables ******************************************************
+
+static volatile sig_atomic_t mbStop = 0;
+
+static const char *macDirections[EOG_DIR_MAX] =
+{
+  "i", "u", "d", "l", "r", "ul", "ur", "dl", "dr"
+};
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       OnSignal
+*
+*    /purpose    Stops the main loop
+*
+*    /ret        void
+*
+******************************************************************************/
+static void OnSignal(int)
+{
+  mbStop = 1;
+}
+
+/******************************************************************************
+*
+*    /name       main
+*
+*    /purpose    Follows the ring until signalled
+*
+*    /ret        int    0 on success
+*
+******************************************************************************/
+int main(int argc, char **argv)
+{
+  const char *xpcName = EOG_RING_NAME;
+  bool xbQuiet = false;
+  std::vector<double> xafLatency;
+  uint64_t xullNextSummary = EogRing_NowNs() + 1000000000ULL;
+  unsigned long xulLost = 0;
+  EogRing *xpsRing;
+  uint64_t xullPos;
+  int xwSlot, xwOpt;
+
+  while ((xwOpt = getopt(argc, argv, "n:q")) != -1)
+  {
+    switch (xwOpt)
+    {
+      case 'n': xpcName = optarg;  break;
+      case 'q': xbQuiet = true;    break;
+      default:
+        fprintf(stderr, "usage: %s [-n shm name] [-q]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  xpsRing = EogRing_Open(xpcName);
+
+  if (xpsRing == NULL)
+  {
+    fprintf(stderr, "%s: %s\n", xpcName, strerror(errno));
+    return 1;
+  }
+
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+
+  // Line buffered, so output can be piped
+
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  xwSlot = EogRing_Register(xpsRing);
+  xullPos = EogRing_Head(xpsRing);
+
+  while (!mbStop)
+  {
+    EogRecord xsRec;
+    int xwGot = EogRing_Read(xpsRing, &xullPos, &xsRec);
+
+    if ((xwGot == 0) && EogRing_Retired(xpsRing))
+    {
+
+      // eogd restarted, follow it to the new ring
+
+      EogRing *xpsNew = EogRing_Open(xpcName);
+
+      if (xpsNew == NULL)
+      {
+        usleep(100000);
+        continue;
+      }
+
+      EogRing_Unregister(xpsRing, xwSlot);
+      EogRing_Close(xpsRing);
+
+      xpsRing = xpsNew;
+      xwSlot = EogRing_Register(xpsRing);
+      xullPos = EogRing_Head(xpsRing);
+    }
+    else if (xwGot == 0)
+    {
+      EogRing_Ack(xpsRing, xwSlot, xullPos);
+      EogRing_Wait(xpsRing, xullPos, 100);
+    }
+    else if (xwGot < 0)
+    {
+      xulLost += -xwGot;
+    }
+    else
+    {
+      double xfUs = (EogRing_NowNs() - xsRec.sullHostNs) / 1000.0;
+
+      if (xbQuiet)
+      {
+        xafLatency.push_back(xfUs);
+      }
+      else if (xsRec.sucType == EOG_REC_EVENT)
+      {
+        printf("%u %-2s %5.2f %.4f %lu %u  %.1f us\n", xsRec.sucDevice,
+               macDirections[xsRec.sucDirection % EOG_DIR_MAX],
+               xsRec.sfWeight, xsRec.sfPeak, (unsigned long)xsRec.sulDeviceMs,
+               xsRec.suwDeviceSeq, xfUs);
+      }
+      else
+      {
+        printf("%u gaze %6d %6d  %.1f us\n", xsRec.sucDevice, xsRec.swX,
+               xsRec.swY, xfUs);
+      }
+    }
+
+    // Summary
+
+    if (xbQuiet && (EogRing_NowNs() >= xullNextSummary))
+    {
+      xullNextSummary += 1000000000ULL;
+
+      if (!xafLatency.empty())
+      {
+        std::sort(xafLatency.begin(), xafLatency.end());
+        printf("%zu records, %lu lost, handoff p50 %.1f p99 %.1f max %.1f us\n",
+               xafLatency.size(), xulLost,
+               xafLatency[xafLatency.size() / 2],
+               xafLatency[(xafLatency.size() * 99) / 100],
+               xafLatency.back());
+        xafLatency.clear();
+      }
+    }
+  }
+
+  EogRing_Unregister(xpsRing, xwSlot);
+
+  return 0;
+}
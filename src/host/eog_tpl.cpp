@@ -0,0 +1,765 @@
+/******************************************************************************
+*
+*    /file    eog_tpl.cpp
+*
+*    /desc    Offline evaluation of the template classifier. Templates are
+*             recorded from a calibration trace through the firmware's own
+*             Template module, then a labelled trace is scored two ways:
+*               - per sample, through Template_Update and Template_Match,
+*                 exactly as the firmware runs
+*               - as a batch, with the window statistics from prefix sums
+*                 and the correlations as contiguous multiply-accumulate
+*                 loops over every window position, which the compiler
+*                 vectorises
+*             The two are checked against each other, timed, and the
+*             movements they report are scored against the labels.
+*
+*             Traces are "vertical horizontal [label]" count lines, one
+*             per ms as for eog_sim, decimated to the update period. A
+*             label (u, d, l, r or b) marks the start of a movement. In the
+*             calibration trace it arms recording of that class, in the
+*             evaluated trace it is the truth a report is scored against.
+*
+*             The match threshold and the stillness floor are the firmware's
+*             tpl_ncc and tpl_floor params, read from the Template module
+*             with "get" so the batch path scores with the same values. -n
+*             and -f set them first with "set".
+*
+*             Movements are reported the way the template detector does:
+*             from idle, a new match is the direction; in a direction,
+*             only the opposite match returns to idle. Blinks are matched
+*             so they are not reported.
+*
+*             Build (Linux, from src/host):
+*               g++ -O3 -march=native -std=gnu++11 -Isim \
+*                   -I../EOG_Firmware/EOG_Firmware -o eog_tpl eog_tpl.cpp \
+*                   sim/sim_hal.cpp \
+*                   ../EOG_Firmware/EOG_Firmware/Template.cpp \
+*                   ../EOG_Firmware/EOG_Firmware/Command.cpp \
+*                   ../EOG_Firmware/EOG_Firmware/Param.cpp
+*
+*             Usage:
+*               eog_tpl -c cal trace [-p period ms] [-r repeats]
+*                       [-n tpl_ncc] [-f tpl_floor] trace
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "sim_hal.h"
+#include "Command.h"
+#include "Param.h"
+#include "Template.h"
+
+// ***** Definitions **********************************************************
+
+// Samples after a label a report still counts for it
+
+#define TPL_TOLERANCE      (2 * TEMPLATE_LENGTH)
+
+// Window positions the batch path scores at a time
+
+#define TPL_BLOCK          256
+
+// Scores of one window position
+
+typedef struct Score_s
+{
+  int    swClass;
+  float  sfWeight;
+} Score_t;
+
+// A decimated trace
+
+typedef struct Trace_s
+{
+  std::vector<int16_t>  saawAxis[TEMPLATE_NUM_AXES];
+  std::vector<int>      sawLabel;           // Class per sample, or NONE
+} Trace_t;
+
+// ***** Local Variables ******************************************************
+
+static const char macNames[TEMPLATE_NUM_CLASSES + 1] =
+{
+  'u', 'd', 'l', 'r', 'b', '-'
+};
+
+// The firmware's tpl_ncc and tpl_floor params, as read back from it
+
+static float mfNcc;
+static long mlFloor;
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       NowNs
+*
+*    /purpose    Monotonic time
+*
+*    /ret        uint64_t    ns
+*
+******************************************************************************/
+static uint64_t NowNs()
+{
+  struct timespec xsNow;
+
+  clock_gettime(CLOCK_MONOTONIC, &xsNow);
+
+  return (uint64_t)xsNow.tv_sec * 1000000000ULL + xsNow.tv_nsec;
+}
+
+/******************************************************************************
+*
+*    /name       Query
+*
+*    /purpose    Sends a command line to the firmware's Serial port, runs it
+*                and reads back the first line of the reply
+*
+*    /param[in]  zwFd       Host end of the Serial socket
+*    /param[in]  zpcLine    Command line, without the line end
+*    /param[out] zpcReply   Reply line, without the line end
+*    /param[in]  zuSize     Size of zpcReply
+*
+*    /ret        bool       Whether a reply came back
+*
+******************************************************************************/
+static bool Query(int zwFd, const char *zpcLine, char *zpcReply, size_t zuSize)
+{
+  std::string xnLine = std::string(zpcLine) + "\n";
+  ssize_t xlRead;
+
+  if (write(zwFd, xnLine.data(), xnLine.size()) != (ssize_t)xnLine.size())
+  {
+    return false;
+  }
+
+  Command_Process();
+
+  xlRead = read(zwFd, zpcReply, zuSize - 1);
+
+  if (xlRead <= 0)
+  {
+    return false;
+  }
+
+  zpcReply[xlRead] = '\0';
+  zpcReply[strcspn(zpcReply, "\r\n")] = '\0';
+
+  return true;
+}
+
+/******************************************************************************
+*
+*    /name       LoadTrace
+*
+*    /purpose    Reads a labelled trace, keeping one sample per period. A
+*                label on a skipped line moves to the next kept sample.
+*
+*    /param[in]  zpcPath    File
+*    /param[in]  zwPeriod   Lines per kept sample
+*    /param[out] zpsTrace   Trace
+*
+*    /ret        bool       Whether a full window was read
+*
+******************************************************************************/
+static bool LoadTrace(const char *zpcPath, int zwPeriod, Trace_t *zpsTrace)
+{
+  FILE *xpsFile = fopen(zpcPath, "r");
+  char xacLine[128];
+  int xwPending = TEMPLATE_NONE;
+  long xlLine = 0;
+
+  if (xpsFile == NULL)
+  {
+    return false;
+  }
+
+  while (fgets(xacLine, sizeof(xacLine), xpsFile) != NULL)
+  {
+    char xacLabel[8] = "";
+    int xwV, xwH;
+
+    if (sscanf(xacLine, "%d %d %7s", &xwV, &xwH, xacLabel) < 2)
+    {
+      continue;
+    }
+
+    for (int c=0; c < TEMPLATE_NUM_CLASSES; c++)
+    {
+      if ((xacLabel[0] == macNames[c]) && (xacLabel[1] == '\0'))
+      {
+        xwPending = c;
+      }
+    }
+
+    if ((xlLine++ % zwPeriod) != 0)
+    {
+      continue;
+    }
+
+    zpsTrace->saawAxis[0].push_back((int16_t)xwV);
+    zpsTrace->saawAxis[1].push_back((int16_t)xwH);
+    zpsTrace->sawLabel.push_back(xwPending);
+
+    xwPending = TEMPLATE_NONE;
+  }
+
+  fclose(xpsFile);
+
+  return zpsTrace->sawLabel.size() >= TEMPLATE_LENGTH;
+}
+
+/******************************************************************************
+*
+*    /name       Record
+*
+*    /purpose    Records templates from a calibration trace through the
+*                firmware module, arming each labelled class
+*
+*    /param[in]  zpsTrace   Calibration trace
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Record(const Trace_t *zpsTrace)
+{
+  size_t xuN = zpsTrace->sawLabel.size();
+
+  for (size_t i=0; i < xuN; i++)
+  {
+    if (zpsTrace->sawLabel[i] != TEMPLATE_NONE)
+    {
+      Template_Record((Template_Class_t)zpsTrace->sawLabel[i]);
+    }
+
+    Template_Update(zpsTrace->saawAxis[0][i], zpsTrace->saawAxis[1][i]);
+  }
+
+  // Let a late label finish
+
+  while (Template_IsRecording())
+  {
+    Template_Update(zpsTrace->saawAxis[0][xuN - 1],
+                    zpsTrace->saawAxis[1][xuN - 1]);
+  }
+}
+
+/******************************************************************************
+*
+*    /name       ScoreSample
+*
+*    /purpose    Scores every window position through the firmware, one
+*                sample at a time. Position p is the window ending at
+*                sample p + L - 1.
+*
+*    /param[in]  zpsTrace   Trace
+*    /param[out] zpasScore  Score per position
+*
+*    /ret        void
+*
+******************************************************************************/
+static void ScoreSample(const Trace_t *zpsTrace,
+                        std::vector<Score_t> *zpasScore)
+{
+  size_t xuN = zpsTrace->sawLabel.size();
+
+  zpasScore->resize(xuN - TEMPLATE_LENGTH + 1);
+
+  for (size_t i=0; i < xuN; i++)
+  {
+    Template_Update(zpsTrace->saawAxis[0][i], zpsTrace->saawAxis[1][i]);
+
+    if (i + 1 >= TEMPLATE_LENGTH)
+    {
+      Score_t *xpsScore = &(*zpasScore)[i + 1 - TEMPLATE_LENGTH];
+
+      xpsScore->swClass = Template_Match(&xpsScore->sfWeight);
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       ScoreBatch
+*
+*    /purpose    Scores every window position at once. The window sums are
+*                differences of prefix sums, and each correlation is built
+*                tap by tap over all positions, so the inner loops are
+*                contiguous and branch free. The window's part of the
+*                denominator is the same for every class, so classes are
+*                ranked by num / sqrt(template den) and only the best one
+*                takes a square root.
+*
+*    /param[in]  zpsTrace   Trace
+*    /param[in]  zpsSet     Templates
+*    /param[out] zpasScore  Score per position
+*
+*    /ret        void
+*
+******************************************************************************/
+static void ScoreBatch(const Trace_t *zpsTrace, const Template_Set_t *zpsSet,
+                       std::vector<Score_t> *zpasScore)
+{
+  const int L = TEMPLATE_LENGTH;
+  size_t xuN = zpsTrace->sawLabel.size();
+  size_t xuM = xuN - L + 1;
+  std::vector<int64_t> xallPre[TEMPLATE_NUM_AXES];
+  std::vector<int64_t> xallPreSq[TEMPLATE_NUM_AXES];
+  double xafScale[TEMPLATE_NUM_CLASSES];
+  int32_t xalTplSum[TEMPLATE_NUM_CLASSES][TEMPLATE_NUM_AXES];
+  double xfFloor = (double)mlFloor * mlFloor * L * L;
+
+  zpasScore->resize(xuM);
+
+  // Prefix sums of the samples and their squares
+
+  for (int a=0; a < TEMPLATE_NUM_AXES; a++)
+  {
+    const int16_t *xpwX = zpsTrace->saawAxis[a].data();
+
+    xallPre[a].assign(xuN + 1, 0);
+    xallPreSq[a].assign(xuN + 1, 0);
+
+    for (size_t i=0; i < xuN; i++)
+    {
+      xallPre[a][i + 1] = xallPre[a][i] + xpwX[i];
+      xallPreSq[a][i + 1] = xallPreSq[a][i] + (int32_t)xpwX[i] * xpwX[i];
+    }
+  }
+
+  // Template constants
+
+  for (int c=0; c < TEMPLATE_NUM_CLASSES; c++)
+  {
+    double xfTplDen = 0.0;
+
+    for (int a=0; a < TEMPLATE_NUM_AXES; a++)
+    {
+      int32_t xlTplSq = 0;
+
+      xalTplSum[c][a] = 0;
+
+      for (int i=0; i < L; i++)
+      {
+        xalTplSum[c][a] += zpsSet->saacShape[c][a][i];
+        xlTplSq += zpsSet->saacShape[c][a][i] * zpsSet->saacShape[c][a][i];
+      }
+
+      xfTplDen += (double)L * xlTplSq -
+                  (double)xalTplSum[c][a] * xalTplSum[c][a];
+    }
+
+    xafScale[c] = (xfTplDen > 0.0) ? 1.0 / sqrt(xfTplDen) : 0.0;
+  }
+
+  // A block of positions at a time, so the work arrays stay in cache
+
+  for (size_t b=0; b < xuM; b += TPL_BLOCK)
+  {
+    size_t xuLen = std::min((size_t)TPL_BLOCK, xuM - b);
+    double xafWinDen[TPL_BLOCK], xafNum[TPL_BLOCK], xafBest[TPL_BLOCK];
+    double xaafSum[TEMPLATE_NUM_AXES][TPL_BLOCK];
+    int32_t xalCross[TPL_BLOCK];
+    int xawBest[TPL_BLOCK];
+
+    // Window sums and the window's part of the denominator
+
+    for (size_t p=0; p < xuLen; p++)
+    {
+      xafWinDen[p] = 0.0;
+      xafBest[p] = 0.0;
+      xawBest[p] = TEMPLATE_NONE;
+    }
+
+    for (int a=0; a < TEMPLATE_NUM_AXES; a++)
+    {
+      const int64_t *xpllPre = xallPre[a].data() + b;
+      const int64_t *xpllPreSq = xallPreSq[a].data() + b;
+
+      for (size_t p=0; p < xuLen; p++)
+      {
+        int64_t xllSum = xpllPre[p + L] - xpllPre[p];
+
+        xaafSum[a][p] = (double)xllSum;
+        xafWinDen[p] += (double)(L * (xpllPreSq[p + L] - xpllPreSq[p]) -
+                                 xllSum * xllSum);
+      }
+    }
+
+    // Each class
+
+    for (int c=0; c < TEMPLATE_NUM_CLASSES; c++)
+    {
+      if (!(zpsSet->sucRecorded & (1 << c)))
+      {
+        continue;
+      }
+
+      for (int a=0; a < TEMPLATE_NUM_AXES; a++)
+      {
+        const int8_t *xpcShape = zpsSet->saacShape[c][a];
+        const int16_t *xpwX = zpsTrace->saawAxis[a].data() + b;
+        double xfTplSum = xalTplSum[c][a];
+
+        for (size_t p=0; p < xuLen; p++)
+        {
+          xalCross[p] = 0;
+        }
+
+        for (int i=0; i < L; i++)
+        {
+          const int32_t xlTap = xpcShape[i];
+          const int16_t *xpwTap = xpwX + i;
+
+          for (size_t p=0; p < xuLen; p++)
+          {
+            xalCross[p] += xlTap * xpwTap[p];
+          }
+        }
+
+        for (size_t p=0; p < xuLen; p++)
+        {
+          double xfNum = (double)L * xalCross[p] - xaafSum[a][p] * xfTplSum;
+
+          xafNum[p] = (a == 0) ? xfNum : xafNum[p] + xfNum;
+        }
+      }
+
+      // Keep the best class of each position
+
+      for (size_t p=0; p < xuLen; p++)
+      {
+        double xfScore = xafNum[p] * xafScale[c];
+        bool xbBetter = xfScore > xafBest[p];
+
+        xafBest[p] = xbBetter ? xfScore : xafBest[p];
+        xawBest[p] = xbBetter ? c : xawBest[p];
+      }
+    }
+
+    // Weights of the best classes
+
+    for (size_t p=0; p < xuLen; p++)
+    {
+      Score_t *xpsScore = &(*zpasScore)[b + p];
+
+      if (xafWinDen[p] < xfFloor)
+      {
+        *xpsScore = (Score_t){TEMPLATE_NONE, 0.0f};
+      }
+      else
+      {
+        xpsScore->swClass = xawBest[p];
+        xpsScore->sfWeight = xafBest[p] / sqrt(xafWinDen[p]) / mfNcc;
+      }
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Detect
+*
+*    /purpose    Turns scores into reported movements the way the firmware's
+*                template detector does
+*
+*    /param[in]  zpasScore  Score per position
+*    /param[out] zpawEvent  Reported class per position, or NONE
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Detect(const std::vector<Score_t> *zpasScore,
+                   std::vector<int> *zpawEvent)
+{
+  static const int xawOpposite[TEMPLATE_NUM_CLASSES] =
+  {
+    TEMPLATE_DOWN, TEMPLATE_UP, TEMPLATE_RIGHT, TEMPLATE_LEFT, TEMPLATE_NONE
+  };
+  int xwMatch = TEMPLATE_NONE;
+  int xwState = TEMPLATE_NONE;
+
+  zpawEvent->assign(zpasScore->size(), TEMPLATE_NONE);
+
+  for (size_t p=0; p < zpasScore->size(); p++)
+  {
+    int xwClass = (*zpasScore)[p].swClass;
+
+    if ((*zpasScore)[p].sfWeight < 1.0f)
+    {
+      xwClass = TEMPLATE_NONE;
+    }
+
+    if ((xwClass == xwMatch) || ((xwMatch = xwClass) == TEMPLATE_NONE) ||
+        (xwClass == TEMPLATE_BLINK))
+    {
+      continue;
+    }
+
+    if (xwState == TEMPLATE_NONE)
+    {
+      xwState = xwClass;
+      (*zpawEvent)[p] = xwClass;
+    }
+    else if (xwClass == xawOpposite[xwState])
+    {
+      xwState = TEMPLATE_NONE;
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Report
+*
+*    /purpose    Scores reported movements against the labels. A report
+*                matches an unmatched label of its class up to
+*                TPL_TOLERANCE samples before it, anything else is false.
+*
+*    /param[in]  zpsTrace   Trace
+*    /param[in]  zpawEvent  Reported class per position
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Report(const Trace_t *zpsTrace, const std::vector<int> *zpawEvent)
+{
+  int xawLabels[TEMPLATE_NUM_CLASSES] = {0};
+  int xawHits[TEMPLATE_NUM_CLASSES] = {0};
+  int xawFalse[TEMPLATE_NUM_CLASSES] = {0};
+  std::vector<bool> xabUsed(zpsTrace->sawLabel.size(), false);
+
+  for (size_t i=0; i < zpsTrace->sawLabel.size(); i++)
+  {
+    if (zpsTrace->sawLabel[i] != TEMPLATE_NONE)
+    {
+      xawLabels[zpsTrace->sawLabel[i]]++;
+    }
+  }
+
+  for (size_t p=0; p < zpawEvent->size(); p++)
+  {
+    int xwClass = (*zpawEvent)[p];
+    size_t xuEnd = p + TEMPLATE_LENGTH - 1;
+    size_t xuFirst = (xuEnd > TPL_TOLERANCE) ? xuEnd - TPL_TOLERANCE : 0;
+    bool xbHit = false;
+
+    if (xwClass == TEMPLATE_NONE)
+    {
+      continue;
+    }
+
+    for (size_t i=xuFirst; (i <= xuEnd) && !xbHit; i++)
+    {
+      if ((zpsTrace->sawLabel[i] == xwClass) && !xabUsed[i])
+      {
+        xabUsed[i] = true;
+        xbHit = true;
+      }
+    }
+
+    if (xbHit)
+    {
+      xawHits[xwClass]++;
+    }
+    else
+    {
+      xawFalse[xwClass]++;
+    }
+  }
+
+  printf("class  labels  hits  missed  false\n");
+
+  for (int c=0; c < TEMPLATE_BLINK; c++)
+  {
+    printf("  %c    %6d %5d %7d %6d\n", macNames[c], xawLabels[c],
+           xawHits[c], xawLabels[c] - xawHits[c], xawFalse[c]);
+  }
+
+  printf("  %c    %6d  (matched, not reported)\n", macNames[TEMPLATE_BLINK],
+         xawLabels[TEMPLATE_BLINK]);
+}
+
+/******************************************************************************
+*
+*    /name       main
+*
+*    /purpose    Records, scores both ways, compares and reports
+*
+*    /ret        int    0 if the two paths agree
+*
+******************************************************************************/
+int main(int argc, char **argv)
+{
+  const char *xpcCal = NULL;
+  const char *xpcNcc = NULL;
+  const char *xpcFloor = NULL;
+  int xwPeriod = 10, xwRepeats = 20, xwOpt;
+  int xawSerial[2];
+  char xacReply[64], xacLine[64];
+  int xwDiffer = 0;
+  float xfMaxDiff = 0.0f;
+  Trace_t xsCal, xsTrace;
+  Template_Set_t xsSet;
+  std::vector<Score_t> xasSample, xasBatch;
+  std::vector<int> xawEvent;
+  uint64_t xullSampleNs, xullBatchNs;
+  double xfWindows;
+
+  while ((xwOpt = getopt(argc, argv, "c:p:r:n:f:")) != -1)
+  {
+    switch (xwOpt)
+    {
+      case 'c': xpcCal = optarg;                         break;
+      case 'p': xwPeriod = std::max(1, atoi(optarg));    break;
+      case 'r': xwRepeats = std::max(1, atoi(optarg));   break;
+      case 'n': xpcNcc = optarg;                         break;
+      case 'f': xpcFloor = optarg;                       break;
+      default:  xpcCal = NULL;  optind = argc + 1;       break;
+    }
+  }
+
+  if ((xpcCal == NULL) || (optind != argc - 1))
+  {
+    fprintf(stderr, "usage: %s -c cal trace [-p period ms] [-r repeats] "
+                    "[-n tpl_ncc] [-f tpl_floor] trace\n", argv[0]);
+    return 1;
+  }
+
+  if (!LoadTrace(xpcCal, xwPeriod, &xsCal) ||
+      !LoadTrace(argv[optind], xwPeriod, &xsTrace))
+  {
+    fprintf(stderr, "%s: can't read traces\n", argv[0]);
+    return 1;
+  }
+
+  // Firmware modules, with their Serial port on a socket
+
+  if ((socketpair(AF_UNIX, SOCK_STREAM, 0, xawSerial) != 0) ||
+      (fcntl(xawSerial[0], F_SETFL, O_NONBLOCK) != 0) ||
+      (fcntl(xawSerial[1], F_SETFL, O_NONBLOCK) != 0))
+  {
+    perror("socketpair");
+    return 1;
+  }
+
+  SimHal_Attach(xawSerial[0], NULL, 0);
+
+  Command_Initialize(115200);
+  Param_Initialize();
+  Template_Initialize();
+  Template_SetPeriod(xwPeriod);
+
+  // Set the params asked for, then read back what the firmware uses
+
+  for (int i=0; i < 2; i++)
+  {
+    const char *xpcName = (i == 0) ? "tpl_ncc" : "tpl_floor";
+    const char *xpcValue = (i == 0) ? xpcNcc : xpcFloor;
+
+    if (xpcValue != NULL)
+    {
+      snprintf(xacLine, sizeof(xacLine), "set %s %s", xpcName, xpcValue);
+
+      if (!Query(xawSerial[1], xacLine, xacReply, sizeof(xacReply)) ||
+          (xacReply[0] != '1'))
+      {
+        fprintf(stderr, "%s: %s refused\n", argv[0], xacLine);
+        return 1;
+      }
+    }
+  }
+
+  snprintf(xacLine, sizeof(xacLine), "get tpl_ncc");
+
+  if (!Query(xawSerial[1], xacLine, xacReply, sizeof(xacReply)) ||
+      ((mfNcc = atof(xacReply)) <= 0.0f))
+  {
+    fprintf(stderr, "%s: no reply to %s\n", argv[0], xacLine);
+    return 1;
+  }
+
+  snprintf(xacLine, sizeof(xacLine), "get tpl_floor");
+
+  if (!Query(xawSerial[1], xacLine, xacReply, sizeof(xacReply)))
+  {
+    fprintf(stderr, "%s: no reply to %s\n", argv[0], xacLine);
+    return 1;
+  }
+
+  mlFloor = atol(xacReply);
+
+  printf("tpl_ncc %.3f, tpl_floor %ld\n", mfNcc, mlFloor);
+
+  Record(&xsCal);
+  Template_GetSet(&xsSet);
+
+  printf("templates:");
+
+  for (int c=0; c < TEMPLATE_NUM_CLASSES; c++)
+  {
+    printf(" %c", (xsSet.sucRecorded & (1 << c)) ? macNames[c] : '.');
+  }
+
+  printf("\n");
+
+  // Score and time both paths
+
+  xullSampleNs = NowNs();
+
+  for (int r=0; r < xwRepeats; r++)
+  {
+    ScoreSample(&xsTrace, &xasSample);
+  }
+
+  xullSampleNs = NowNs() - xullSampleNs;
+  xullBatchNs = NowNs();
+
+  for (int r=0; r < xwRepeats; r++)
+  {
+    ScoreBatch(&xsTrace, &xsSet, &xasBatch);
+  }
+
+  xullBatchNs = NowNs() - xullBatchNs;
+  xfWindows = (double)xasBatch.size() * xwRepeats;
+
+  printf("%zu windows, per sample %.1f ns/window, batch %.1f ns/window\n",
+         xasBatch.size(), xullSampleNs / xfWindows, xullBatchNs / xfWindows);
+
+  // The paths only differ by float rounding
+
+  for (size_t p=0; p < xasBatch.size(); p++)
+  {
+    float xfDiff = fabs(xasSample[p].sfWeight - xasBatch[p].sfWeight);
+
+    xfMaxDiff = std::max(xfMaxDiff, xfDiff);
+
+    if ((xasSample[p].swClass != xasBatch[p].swClass) && (xfDiff > 1e-3f))
+    {
+      xwDiffer++;
+    }
+  }
+
+  printf("paths: %d windows differ, max weight difference %.2g\n",
+         xwDiffer, xfMaxDiff);
+
+  Detect(&xasBatch, &xawEvent);
+  Report(&xsTrace, &xawEvent);
+
+  return (xwDiffer == 0) ? 0 : 2;
+}
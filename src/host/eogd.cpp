@@ -0,0 +1,605 @@
+/******************************************************************************
+*
+*    /file    eogd.cpp
+*
+*    /desc    Host daemon that owns the serial links to one or more EOG
+*             devices and fans their output out to local applications
+*             through the shared memory ring in eog_ring.h.
+*
+*             Each device stream is decoded as it arrives:
+*               - direction strings ("u\r\n", or "u 17\r\n" with the
+*                 sequence number) and extended ASCII events
+*                 ("u 1.42 0.0812 123456 17\r\n")
+*               - binary frames (0xA5 <type> <len> <data> <sum>), 'E'
+*                 events and 'G' gaze positions
+*             and published as EogRecord, stamped with the host time. Other
+*             lines (command replies) are dropped. One thread serves every
+*             device with epoll, so the ring keeps a single writer.
+*
+*             Any number of readers map the ring; see eog_ring.h. Every few
+*             seconds eogd prints the records published and how far behind
+*             each registered reader is, and frees entries of readers that
+*             have exited.
+*
+*             A device path may be a pseudo-terminal, e.g. a simulated
+*             device from eog_sim.
+*
+*             Build (Linux):
+*               g++ -O2 -std=c++11 -pthread -o eogd eogd.cpp -lrt
+*
+*             Usage:
+*               eogd [-n shm name] [-b baud] [-e event format] [-w reset ms]
+*                    [-s stats s] <device> [<device> ...]
+*               eogd -e 2 /dev/ttyACM0 /dev/ttyACM1
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "eog_ring.h"
+
+// ***** Local Definitions ****************************************************
+
+#define DEFAULT_BAUD       115200
+#define DEFAULT_WAIT_MS    2000
+#define DEFAULT_STATS_S    5
+#define MAX_LINE           128
+#define MAX_EVENTS         32
+
+// Binary frame layout, see Command_SendFrame in the firmware
+
+#define FRAME_SYNC         0xA5
+#define FRAME_EVENT        'E'
+#define FRAME_GAZE         'G'
+
+// Frame decoder states
+
+typedef enum Frame_State_e
+{
+  FRAME_IDLE,
+  FRAME_TYPE,
+  FRAME_LEN,
+  FRAME_DATA,
+  FRAME_SUM,
+} Frame_State_t;
+
+// One device link and its decoder
+
+typedef struct Device_s
+{
+  const char *      spcPath;
+  int               swFd;
+  int               swIndex;
+  std::string       snLine;
+  Frame_State_t     seFrame;
+  uint8_t           sucType;
+  uint8_t           sucLen;
+  uint8_t           sucSum;
+  uint8_t           saucData[255];
+  uint8_t           sucGot;
+  unsigned long     sulRecords;
+  unsigned long     sulBadFrames;
+} Device_t;
+
+// ***** Local Variables ******************************************************
+
+static volatile sig_atomic_t mbStop = 0;
+
+// Direction strings, in the firmware's order
+
+static const char *macDirections[EOG_DIR_MAX] =
+{
+  "i", "u", "d", "l", "r", "ul", "ur", "dl", "dr"
+};
+
+// ***** Function Definitions *************************************************
+
+/******************************************************************************
+*
+*    /name       OnSignal
+*
+*    /purpose    Stops the main loop
+*
+*    /ret        void
+*
+******************************************************************************/
+static void OnSignal(int)
+{
+  mbStop = 1;
+}
+
+/******************************************************************************
+*
+*    /name       OpenDevice
+*
+*    /purpose    Opens a device raw, 8N1, non-blocking at the given rate
+*
+*    /param[in]  zpcPath    Device path
+*    /param[in]  zlBaud     Baud rate
+*
+*    /ret        int        File descriptor, -1 on error
+*
+******************************************************************************/
+static int OpenDevice(const char *zpcPath, long zlBaud)
+{
+  struct termios xsTio;
+  speed_t xuSpeed;
+  int xwFd;
+
+  switch (zlBaud)
+  {
+    case 57600:   xuSpeed = B57600;   break;
+    case 115200:  xuSpeed = B115200;  break;
+#ifdef B500000
+    case 500000:  xuSpeed = B500000;  break;
+#endif
+#ifdef B1000000
+    case 1000000: xuSpeed = B1000000; break;
+#endif
+    default:
+      fprintf(stderr, "unsupported baud rate %ld\n", zlBaud);
+      return -1;
+  }
+
+  xwFd = open(zpcPath, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+  if (xwFd < 0)
+  {
+    fprintf(stderr, "%s: %s\n", zpcPath, strerror(errno));
+    return -1;
+  }
+
+  if (tcgetattr(xwFd, &xsTio) == 0)
+  {
+    cfmakeraw(&xsTio);
+    cfsetispeed(&xsTio, xuSpeed);
+    cfsetospeed(&xsTio, xuSpeed);
+    xsTio.c_cflag |= (CLOCAL | CREAD);
+    tcsetattr(xwFd, TCSANOW, &xsTio);
+  }
+
+  return xwFd;
+}
+
+/******************************************************************************
+*
+*    /name       Publish
+*
+*    /purpose    Stamps a record with the device and host time and writes it
+*                to the ring
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Publish(EogRing *zpsRing, Device_t *zpsDev, EogRecord *zpsRec)
+{
+  zpsRec->sucDevice = (uint8_t)zpsDev->swIndex;
+  zpsRec->sullHostNs = EogRing_NowNs();
+
+  EogRing_Publish(zpsRing, zpsRec);
+
+  zpsDev->sulRecords++;
+}
+
+/******************************************************************************
+*
+*    /name       DecodeLine
+*
+*    /purpose    Decodes an ASCII line. Direction strings, alone, with a
+*                sequence number or with the extended event fields, become
+*                event records. Anything else is dropped.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void DecodeLine(EogRing *zpsRing, Device_t *zpsDev,
+                       const std::string &znLine)
+{
+  char xacDir[4];
+  float xfWeight = 0, xfPeak = 0;
+  unsigned long xulMs = 0, xulSeq = 0;
+  int xwFields;
+
+  xwFields = sscanf(znLine.c_str(), "%3s %f %f %lu %lu", xacDir,
+                    &xfWeight, &xfPeak, &xulMs, &xulSeq);
+
+  // Plain strings are exactly the direction, or the direction and the
+  // sequence number. Extended events have all five fields.
+
+  if (xwFields == 2)
+  {
+    xfWeight = 0;
+
+    if (sscanf(znLine.c_str(), "%3s %lu", xacDir, &xulSeq) != 2)
+    {
+      return;
+    }
+  }
+  else if ((xwFields != 5) && ((xwFields != 1) || (znLine.size() > 2)))
+  {
+    return;
+  }
+
+  for (int i=0; i < EOG_DIR_MAX; i++)
+  {
+    if (strcmp(xacDir, macDirections[i]) == 0)
+    {
+      EogRecord xsRec;
+
+      memset(&xsRec, 0, sizeof(xsRec));
+      xsRec.sucType = EOG_REC_EVENT;
+      xsRec.sucDirection = (uint8_t)i;
+      xsRec.sfWeight = xfWeight;
+      xsRec.sfPeak = xfPeak;
+      xsRec.sulDeviceMs = (uint32_t)xulMs;
+      xsRec.suwDeviceSeq = (uint16_t)xulSeq;
+
+      Publish(zpsRing, zpsDev, &xsRec);
+      return;
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       DecodeFrame
+*
+*    /purpose    Decodes a complete, checked binary frame
+*
+*    /ret        void
+*
+******************************************************************************/
+static void DecodeFrame(EogRing *zpsRing, Device_t *zpsDev)
+{
+  const uint8_t *xpucData = zpsDev->saucData;
+  EogRecord xsRec;
+
+  memset(&xsRec, 0, sizeof(xsRec));
+
+  if ((zpsDev->sucType == FRAME_EVENT) && (zpsDev->sucLen == 11))
+  {
+    xsRec.sucType = EOG_REC_EVENT;
+    xsRec.sucDirection = xpucData[0];
+    xsRec.sfWeight = (int16_t)(xpucData[1] | (xpucData[2] << 8)) / 256.0f;
+
+    // Peak is in ADC counts, +/-10 V range
+
+    xsRec.sfPeak = (int16_t)(xpucData[3] | (xpucData[4] << 8)) *
+                   (20.0f / 65536.0f);
+    xsRec.sulDeviceMs = (uint32_t)xpucData[5] |
+                        ((uint32_t)xpucData[6] << 8) |
+                        ((uint32_t)xpucData[7] << 16) |
+                        ((uint32_t)xpucData[8] << 24);
+    xsRec.suwDeviceSeq = (uint16_t)(xpucData[9] | (xpucData[10] << 8));
+  }
+  else if ((zpsDev->sucType == FRAME_GAZE) &&
+           ((zpsDev->sucLen == 4) || (zpsDev->sucLen == 6)))
+  {
+    xsRec.sucType = EOG_REC_GAZE;
+    xsRec.swX = (int16_t)(xpucData[0] | (xpucData[1] << 8));
+    xsRec.swY = (int16_t)(xpucData[2] | (xpucData[3] << 8));
+
+    // Sequenced mode adds the sequence number
+
+    if (zpsDev->sucLen == 6)
+    {
+      xsRec.suwDeviceSeq = (uint16_t)(xpucData[4] | (xpucData[5] << 8));
+    }
+  }
+  else
+  {
+    return;
+  }
+
+  Publish(zpsRing, zpsDev, &xsRec);
+}
+
+/******************************************************************************
+*
+*    /name       Decode
+*
+*    /purpose    Runs received bytes through the decoder. The sync byte is
+*                never part of an ASCII line, so it always starts a frame.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Decode(EogRing *zpsRing, Device_t *zpsDev, const uint8_t *zpucBuf,
+                   size_t zuLen)
+{
+  for (size_t i=0; i < zuLen; i++)
+  {
+    uint8_t xucByte = zpucBuf[i];
+
+    switch (zpsDev->seFrame)
+    {
+      case FRAME_IDLE:
+        if (xucByte == FRAME_SYNC)
+        {
+          zpsDev->seFrame = FRAME_TYPE;
+        }
+        else if (xucByte == '\n')
+        {
+          DecodeLine(zpsRing, zpsDev, zpsDev->snLine);
+          zpsDev->snLine.clear();
+        }
+        else if ((xucByte >= ' ') && (zpsDev->snLine.size() < MAX_LINE))
+        {
+          zpsDev->snLine += (char)xucByte;
+        }
+        break;
+
+      case FRAME_TYPE:
+        zpsDev->sucType = xucByte;
+        zpsDev->sucSum = xucByte;
+        zpsDev->seFrame = FRAME_LEN;
+        break;
+
+      case FRAME_LEN:
+        zpsDev->sucLen = xucByte;
+        zpsDev->sucSum += xucByte;
+        zpsDev->sucGot = 0;
+        zpsDev->seFrame = (xucByte == 0) ? FRAME_SUM : FRAME_DATA;
+        break;
+
+      case FRAME_DATA:
+        zpsDev->saucData[zpsDev->sucGot++] = xucByte;
+        zpsDev->sucSum += xucByte;
+
+        if (zpsDev->sucGot == zpsDev->sucLen)
+        {
+          zpsDev->seFrame = FRAME_SUM;
+        }
+        break;
+
+      case FRAME_SUM:
+        if (xucByte == zpsDev->sucSum)
+        {
+          DecodeFrame(zpsRing, zpsDev);
+        }
+        else
+        {
+          zpsDev->sulBadFrames++;
+        }
+
+        zpsDev->seFrame = FRAME_IDLE;
+        break;
+    }
+  }
+}
+
+/******************************************************************************
+*
+*    /name       Report
+*
+*    /purpose    Prints the records published per device and the lag of each
+*                registered reader. Frees entries of readers that exited.
+*
+*    /ret        void
+*
+******************************************************************************/
+static void Report(EogRing *zpsRing, std::vector<Device_t> &zasDevs)
+{
+  uint64_t xullHead = EogRing_Head(zpsRing);
+
+  fprintf(stderr, "eogd: head %llu", (unsigned long long)xullHead);
+
+  for (size_t i=0; i < zasDevs.size(); i++)
+  {
+    fprintf(stderr, "  dev%zu %lu rec %lu bad", i, zasDevs[i].sulRecords,
+            zasDevs[i].sulBadFrames);
+  }
+
+  fprintf(stderr, "\n");
+
+  for (int i=0; i < EOG_RING_CONSUMERS; i++)
+  {
+    EogConsumer *xpsCon = &zpsRing->sasConsumers[i];
+    int32_t xlPid = xpsCon->slPid.load();
+
+    if (xlPid == 0)
+    {
+      continue;
+    }
+
+    if ((kill(xlPid, 0) != 0) && (errno == ESRCH))
+    {
+      xpsCon->slPid.store(0);
+      fprintf(stderr, "eogd: reader %d (pid %d) gone\n", i, (int)xlPid);
+      continue;
+    }
+
+    fprintf(stderr, "eogd: reader %d (pid %d) lag %llu\n", i, (int)xlPid,
+            (unsigned long long)(xullHead - xpsCon->sullPos.load()));
+  }
+}
+
+/******************************************************************************
+*
+*    /name       main
+*
+*    /purpose    Opens the ring and devices and serves them until signalled
+*
+*    /ret        int    0 on success
+*
+******************************************************************************/
+int main(int argc, char **argv)
+{
+  const char *xpcName = EOG_RING_NAME;
+  long xlBaud = DEFAULT_BAUD;
+  int xwEvent = -1;
+  int xwWait = DEFAULT_WAIT_MS;
+  int xwStats = DEFAULT_STATS_S;
+  std::vector<Device_t> xasDevs;
+  struct epoll_event xsEv;
+  struct itimerspec xsTimer;
+  EogRing *xpsRing;
+  int xwEpoll, xwTimer, xwOpt;
+
+  while ((xwOpt = getopt(argc, argv, "n:b:e:w:s:")) != -1)
+  {
+    switch (xwOpt)
+    {
+      case 'n': xpcName = optarg;         break;
+      case 'b': xlBaud = atol(optarg);    break;
+      case 'e': xwEvent = atoi(optarg);   break;
+      case 'w': xwWait = atoi(optarg);    break;
+      case 's': xwStats = atoi(optarg);   break;
+      default:
+        fprintf(stderr, "usage: %s [-n shm name] [-b baud] [-e event format]"
+                " [-w reset ms] [-s stats s] <device> ...\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if ((optind >= argc) || (argc - optind > 255))
+  {
+    fprintf(stderr, "%s: give 1 to 255 devices\n", argv[0]);
+    return 1;
+  }
+
+  xpsRing = EogRing_Map(xpcName, true);
+
+  if (xpsRing == NULL)
+  {
+    fprintf(stderr, "%s: %s\n", xpcName, strerror(errno));
+    return 1;
+  }
+
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  xwEpoll = epoll_create1(0);
+
+  // Open the devices
+
+  xasDevs.resize(argc - optind);
+
+  for (size_t i=0; i < xasDevs.size(); i++)
+  {
+    Device_t *xpsDev = &xasDevs[i];
+
+    xpsDev->spcPath = argv[optind + i];
+    xpsDev->swIndex = (int)i;
+    xpsDev->seFrame = FRAME_IDLE;
+    xpsDev->sulRecords = 0;
+    xpsDev->sulBadFrames = 0;
+    xpsDev->swFd = OpenDevice(xpsDev->spcPath, xlBaud);
+
+    if (xpsDev->swFd < 0)
+    {
+      return 1;
+    }
+  }
+
+  // Opening resets most boards. Then select the event format, if asked.
+
+  if (xwWait > 0)
+  {
+    usleep(xwWait * 1000);
+  }
+
+  for (size_t i=0; i < xasDevs.size(); i++)
+  {
+    tcflush(xasDevs[i].swFd, TCIFLUSH);
+
+    if (xwEvent >= 0)
+    {
+      char xacCmd[16];
+      int xwLen = snprintf(xacCmd, sizeof(xacCmd), "evt %d\n", xwEvent);
+
+      if (write(xasDevs[i].swFd, xacCmd, xwLen) != xwLen)
+      {
+        fprintf(stderr, "%s: %s\n", xasDevs[i].spcPath, strerror(errno));
+      }
+    }
+
+    xsEv.events = EPOLLIN;
+    xsEv.data.u32 = (uint32_t)i;
+    epoll_ctl(xwEpoll, EPOLL_CTL_ADD, xasDevs[i].swFd, &xsEv);
+  }
+
+  // Stats timer
+
+  xwTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  memset(&xsTimer, 0, sizeof(xsTimer));
+  xsTimer.it_value.tv_sec = xwStats;
+  xsTimer.it_interval.tv_sec = xwStats;
+  timerfd_settime(xwTimer, 0, &xsTimer, NULL);
+
+  xsEv.events = EPOLLIN;
+  xsEv.data.u32 = UINT32_MAX;
+  epoll_ctl(xwEpoll, EPOLL_CTL_ADD, xwTimer, &xsEv);
+
+  // Serve
+
+  while (!mbStop)
+  {
+    struct epoll_event xasEvents[MAX_EVENTS];
+    int xwReady = epoll_wait(xwEpoll, xasEvents, MAX_EVENTS, 1000);
+    uint64_t xullBefore = EogRing_Head(xpsRing);
+
+    for (int i=0; i < xwReady; i++)
+    {
+      uint32_t xulIndex = xasEvents[i].data.u32;
+
+      if (xulIndex == UINT32_MAX)
+      {
+        uint64_t xullTicks;
+
+        if (read(xwTimer, &xullTicks, sizeof(xullTicks)) > 0)
+        {
+          Report(xpsRing, xasDevs);
+        }
+        continue;
+      }
+
+      Device_t *xpsDev = &xasDevs[xulIndex];
+      uint8_t xaucBuf[4096];
+      ssize_t xlRead;
+
+      while ((xlRead = read(xpsDev->swFd, xaucBuf, sizeof(xaucBuf))) > 0)
+      {
+        Decode(xpsRing, xpsDev, xaucBuf, (size_t)xlRead);
+      }
+
+      // Device went away
+
+      if ((xlRead == 0) || ((xlRead < 0) && (errno != EAGAIN) &&
+                            (errno != EINTR)))
+      {
+        fprintf(stderr, "eogd: %s closed\n", xpsDev->spcPath);
+        epoll_ctl(xwEpoll, EPOLL_CTL_DEL, xpsDev->swFd, NULL);
+        close(xpsDev->swFd);
+        xpsDev->swFd = -1;
+      }
+    }
+
+    // One wake per pass, however many records were published
+
+    if (EogRing_Head(xpsRing) != xullBefore)
+    {
+      EogRing_Wake(xpsRing);
+    }
+  }
+
+  Report(xpsRing, xasDevs);
+  shm_unlink(xpcName);
+
+  return 0;
+}
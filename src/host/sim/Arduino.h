@@ -0,0 +1,208 @@
+/******************************************************************************
+*
+*    /file    Arduino.h
+*
+*    /desc    Fake Arduino HAL for building the EOG_Firmware modules on the
+*             host. Covers only what the firmware uses. Time is virtual and
+*             only moves when the simulator or delay() moves it, the Serial
+*             port is a file descriptor (a pseudo-terminal) and the ADC
+*             shield replays a trace. See sim_hal.h.
+*
+******************************************************************************/
+
+#ifndef _SIM_ARDUINO_H
+#define _SIM_ARDUINO_H
+
+// ***** Include Files ********************************************************
+
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// ***** Definitions **********************************************************
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define DEC           10
+#define HEX           16
+
+#define PI            3.1415926535897932384626433832795
+#define RAD_TO_DEG    57.295779513082320876798154814105
+
+#define F(zpcString)  (zpcString)
+
+using std::abs;
+
+template<class A, class B> static inline auto min(A a, B b) -> decltype(a + b)
+{
+  return (a < b) ? a : b;
+}
+
+template<class A, class B> static inline auto max(A a, B b) -> decltype(a + b)
+{
+  return (a > b) ? a : b;
+}
+
+template<class T> static inline T constrain(T x, T lo, T hi)
+{
+  return (x < lo) ? lo : ((x > hi) ? hi : x);
+}
+
+// ***** Time and Pins ********************************************************
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long zulMs);
+void delayMicroseconds(unsigned int zuwUs);
+
+void pinMode(int zwPin, int zwMode);
+void digitalWrite(int zwPin, int zwValue);
+int digitalRead(int zwPin);
+
+// ***** String ***************************************************************
+
+// Arduino String on top of std::string
+
+class String
+{
+public:
+  std::string n;
+
+  String() {}
+  String(const char *zpc) : n(zpc ? zpc : "") {}
+  String(const std::string &zn) : n(zn) {}
+  String(char zc) : n(1, zc) {}
+  String(int zw) : n(std::to_string(zw)) {}
+  String(unsigned int zuw) : n(std::to_string(zuw)) {}
+  String(long zl) : n(std::to_string(zl)) {}
+  String(unsigned long zul) : n(std::to_string(zul)) {}
+  String(float zf, int zwDigits = 2)
+  {
+    char xac[32];
+    snprintf(xac, sizeof(xac), "%.*f", zwDigits, zf);
+    n = xac;
+  }
+
+  void reserve(unsigned int) {}
+  unsigned int length() const { return n.size(); }
+  const char *c_str() const { return n.c_str(); }
+  char charAt(unsigned int i) const { return (i < n.size()) ? n[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+
+  bool equals(const String &zn) const { return n == zn.n; }
+  bool operator==(const String &zn) const { return n == zn.n; }
+  bool operator!=(const String &zn) const { return n != zn.n; }
+  bool startsWith(const String &zn) const
+  {
+    return n.compare(0, zn.n.size(), zn.n) == 0;
+  }
+
+  int indexOf(char zc, unsigned int zuw = 0) const
+  {
+    size_t xu = n.find(zc, zuw);
+    return (xu == std::string::npos) ? -1 : (int)xu;
+  }
+  int indexOf(const String &zn, unsigned int zuw = 0) const
+  {
+    size_t xu = n.find(zn.n, zuw);
+    return (xu == std::string::npos) ? -1 : (int)xu;
+  }
+  int lastIndexOf(char zc) const
+  {
+    size_t xu = n.rfind(zc);
+    return (xu == std::string::npos) ? -1 : (int)xu;
+  }
+
+  String substring(unsigned int zuwFrom) const
+  {
+    return (zuwFrom > n.size()) ? String() : String(n.substr(zuwFrom));
+  }
+  String substring(unsigned int zuwFrom, unsigned int zuwTo) const
+  {
+    if ((zuwFrom > n.size()) || (zuwTo < zuwFrom)) return String();
+    return String(n.substr(zuwFrom, zuwTo - zuwFrom));
+  }
+
+  long toInt() const { return atol(n.c_str()); }
+  float toFloat() const { return (float)atof(n.c_str()); }
+
+  void trim()
+  {
+    size_t xuStart = n.find_first_not_of(" \t\r\n");
+    size_t xuEnd = n.find_last_not_of(" \t\r\n");
+    n = (xuStart == std::string::npos) ? "" :
+        n.substr(xuStart, xuEnd - xuStart + 1);
+  }
+
+  String &operator+=(const String &zn) { n += zn.n; return *this; }
+  String &operator+=(const char *zpc) { n += zpc; return *this; }
+  String &operator+=(char zc) { n += zc; return *this; }
+  friend String operator+(const String &a, const String &b)
+  {
+    return String(a.n + b.n);
+  }
+};
+
+// ***** Serial ***************************************************************
+
+class HardwareSerial
+{
+public:
+  void begin(long zlBaud);
+  void end();
+  void flush();
+  int available();
+  int read();
+
+  size_t write(uint8_t zuc);
+  size_t write(const uint8_t *zpuc, size_t zu);
+
+  size_t print(const String &zn) { return Out(zn.n.data(), zn.n.size()); }
+  size_t print(const char *zpc) { return Out(zpc, strlen(zpc)); }
+  size_t print(char zc) { return Out(&zc, 1); }
+  size_t print(unsigned char zuc, int zwBase = DEC) { return Num(zuc, zwBase); }
+  size_t print(int zw, int zwBase = DEC) { return Num(zw, zwBase); }
+  size_t print(unsigned int zuw, int zwBase = DEC) { return Num(zuw, zwBase); }
+  size_t print(long zl, int zwBase = DEC) { return Num(zl, zwBase); }
+  size_t print(unsigned long zul, int zwBase = DEC) { return Num(zul, zwBase); }
+  size_t print(double zf, int zwDigits = 2)
+  {
+    char xac[40];
+    return Out(xac, snprintf(xac, sizeof(xac), "%.*f", zwDigits, zf));
+  }
+
+  template<class T> size_t println(T zv)
+  {
+    return print(zv) + print("\r\n");
+  }
+  template<class T> size_t println(T zv, int zw)
+  {
+    return print(zv, zw) + print("\r\n");
+  }
+  size_t println() { return print("\r\n"); }
+
+  operator bool() { return true; }
+
+private:
+  size_t Out(const char *zpc, size_t zu);
+  size_t Num(long long zll, int zwBase)
+  {
+    char xac[24];
+    return Out(xac, snprintf(xac, sizeof(xac),
+                             (zwBase == HEX) ? "%llX" : "%lld", zll));
+  }
+};
+
+extern HardwareSerial Serial;
+
+#endif    // !defined _SIM_ARDUINO_H
@@ -0,0 +1,45 @@
+/******************************************************************************
+*
+*    /file    EEPROM.h
+*
+*    /desc    Fake EEPROM for the host simulator, 1 KB in memory. Starts
+*             erased (0xFF) so no calibration is found.
+*
+******************************************************************************/
+
+#ifndef _SIM_EEPROM_H
+#define _SIM_EEPROM_H
+
+#include "Arduino.h"
+
+#define SIM_EEPROM_SIZE   1024
+
+class EEPROMClass
+{
+public:
+  EEPROMClass() { memset(saucData, 0xFF, sizeof(saucData)); }
+
+  uint8_t read(int zw) { return saucData[zw]; }
+  void write(int zw, uint8_t zuc) { saucData[zw] = zuc; }
+  void update(int zw, uint8_t zuc) { saucData[zw] = zuc; }
+  uint16_t length() { return SIM_EEPROM_SIZE; }
+
+  template<class T> T &get(int zw, T &zt)
+  {
+    memcpy(&zt, saucData + zw, sizeof(T));
+    return zt;
+  }
+
+  template<class T> const T &put(int zw, const T &zt)
+  {
+    memcpy(saucData + zw, &zt, sizeof(T));
+    return zt;
+  }
+
+private:
+  uint8_t saucData[SIM_EEPROM_SIZE];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif    // !defined _SIM_EEPROM_H
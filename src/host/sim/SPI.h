@@ -0,0 +1,24 @@
+/******************************************************************************
+*
+*    /file    SPI.h
+*
+*    /desc    Fake SPI for the host simulator. Transfers read the ADC shield
+*             replay, see sim_hal.h.
+*
+******************************************************************************/
+
+#ifndef _SIM_SPI_H
+#define _SIM_SPI_H
+
+#include "Arduino.h"
+
+class SPIClass
+{
+public:
+  void begin() {}
+  uint8_t transfer(uint8_t zuc);
+};
+
+extern SPIClass SPI;
+
+#endif    // !defined _SIM_SPI_H
@@ -0,0 +1,232 @@
+/******************************************************************************
+*
+*    /file    sim_hal.cpp
+*
+*    /desc    Fake Arduino HAL behind Arduino.h, SPI.h and EEPROM.h. The
+*             ADC shields are modelled at the pin level the Analog module
+*             drives: BUSY always reads low, pulling a shield's chip select
+*             low starts a new 16 byte read of the sample at the current
+*             virtual time, big endian per channel. Shields answer on chip
+*             selects 10 (the first shield) and 9, 8 and 7, and all of them
+*             replay the trace.
+*
+******************************************************************************/
+
+// ***** Include Files ********************************************************
+
+#include <string>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "EEPROM.h"
+#include "sim_hal.h"
+
+// ***** Local Definitions ****************************************************
+
+#define SIM_NUM_SHIELDS   4
+#define SIM_NUM_CHANNELS  8
+
+// ***** Global Variables *****************************************************
+
+HardwareSerial Serial;
+SPIClass SPI;
+EEPROMClass EEPROM;
+
+// ***** Local Variables ******************************************************
+
+static unsigned long long Sim__mullMicros;
+static int Sim__mwFd = -1;
+static std::string Sim__mnRx;
+static const int16_t *Sim__mpwTrace;
+static size_t Sim__muSamples;
+static const int Sim__mawChipSelect[SIM_NUM_SHIELDS] = {10, 9, 8, 7};
+static uint8_t Sim__maucSample[SIM_NUM_CHANNELS * 2];
+static unsigned int Sim__muwSpiIndex = sizeof(Sim__maucSample);
+
+// ***** Function Definitions *************************************************
+
+void SimHal_Attach(int zwSerialFd, const int16_t *zpwTrace, size_t zuSamples)
+{
+  Sim__mwFd = zwSerialFd;
+  Sim__mpwTrace = zpwTrace;
+  Sim__muSamples = zuSamples;
+}
+
+void SimHal_Inject(const char *zpcText)
+{
+  Sim__mnRx += zpcText;
+}
+
+void SimHal_SetMicros(unsigned long long zullMicros)
+{
+  if (zullMicros > Sim__mullMicros)
+  {
+    Sim__mullMicros = zullMicros;
+  }
+}
+
+unsigned long millis()
+{
+  return (unsigned long)(Sim__mullMicros / 1000ULL);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)Sim__mullMicros;
+}
+
+void delay(unsigned long zulMs)
+{
+  Sim__mullMicros += zulMs * 1000ULL;
+}
+
+void delayMicroseconds(unsigned int zuwUs)
+{
+  Sim__mullMicros += zuwUs;
+}
+
+void pinMode(int, int)
+{
+}
+
+int digitalRead(int)
+{
+  
+  // BUSY - conversions finish at once
+  
+  return LOW;
+}
+
+void digitalWrite(int zwPin, int zwValue)
+{
+  
+  bool xbSelect = false;
+  
+  for (int i=0; i < SIM_NUM_SHIELDS; i++)
+  {
+    xbSelect = xbSelect || (zwPin == Sim__mawChipSelect[i]);
+  }
+  
+  // Selecting a chip latches the sample at the current time, releasing it
+  // ends the read
+  
+  if (xbSelect && (zwValue == HIGH))
+  {
+    Sim__muwSpiIndex = sizeof(Sim__maucSample);
+  }
+  else if (xbSelect)
+  {
+    int16_t xawCounts[SIM_NUM_CHANNELS] = {0};
+    
+    if (Sim__muSamples > 0)
+    {
+      size_t xuIndex = (size_t)((Sim__mullMicros / 1000ULL) % Sim__muSamples);
+      
+      xawCounts[SIM_VERTICAL_CH] = Sim__mpwTrace[2 * xuIndex];
+      xawCounts[SIM_HORIZONTAL_CH] = Sim__mpwTrace[2 * xuIndex + 1];
+    }
+    
+    for (int i=0; i < SIM_NUM_CHANNELS; i++)
+    {
+      Sim__maucSample[2 * i] = (uint8_t)((uint16_t)xawCounts[i] >> 8);
+      Sim__maucSample[2 * i + 1] = (uint8_t)xawCounts[i];
+    }
+    
+    Sim__muwSpiIndex = 0;
+  }
+}
+
+uint8_t SPIClass::transfer(uint8_t)
+{
+  if (Sim__muwSpiIndex >= sizeof(Sim__maucSample))
+  {
+    return 0;
+  }
+  
+  return Sim__maucSample[Sim__muwSpiIndex++];
+}
+
+void HardwareSerial::begin(long)
+{
+}
+
+void HardwareSerial::end()
+{
+}
+
+void HardwareSerial::flush()
+{
+}
+
+int HardwareSerial::available()
+{
+  char xacBuf[256];
+  ssize_t xlRead;
+  
+  // Pull in anything the host sent
+  
+  if (Sim__mwFd >= 0)
+  {
+    while ((xlRead = ::read(Sim__mwFd, xacBuf, sizeof(xacBuf))) > 0)
+    {
+      Sim__mnRx.append(xacBuf, xlRead);
+    }
+  }
+  
+  return (int)Sim__mnRx.size();
+}
+
+int HardwareSerial::read()
+{
+  int xwChar;
+  
+  if (Sim__mnRx.empty() && (available() == 0))
+  {
+    return -1;
+  }
+  
+  xwChar = (uint8_t)Sim__mnRx[0];
+  Sim__mnRx.erase(0, 1);
+  
+  return xwChar;
+}
+
+size_t HardwareSerial::write(uint8_t zuc)
+{
+  return Out((const char *)&zuc, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *zpuc, size_t zu)
+{
+  return Out((const char *)zpuc, zu);
+}
+
+size_t HardwareSerial::Out(const char *zpc, size_t zu)
+{
+  size_t xuDone = 0;
+  
+  // Blocking, so a slow host back-pressures the device like a real link
+  
+  while ((Sim__mwFd >= 0) && (xuDone < zu))
+  {
+    ssize_t xlWrote = ::write(Sim__mwFd, zpc + xuDone, zu - xuDone);
+    
+    if (xlWrote > 0)
+    {
+      xuDone += xlWrote;
+    }
+    else if ((xlWrote < 0) && (errno != EAGAIN) && (errno != EINTR))
+    {
+      break;
+    }
+    else
+    {
+      usleep(100);
+    }
+  }
+  
+  return zu;
+}
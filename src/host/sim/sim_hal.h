@@ -0,0 +1,35 @@
+/******************************************************************************
+*
+*    /file    sim_hal.h
+*
+*    /desc    Control of the fake Arduino HAL, used by the simulator to run
+*             one firmware instance per process.
+*
+******************************************************************************/
+
+#ifndef _SIM_HAL_H
+#define _SIM_HAL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// ADC channels carrying the trace, as wired on the headset
+
+#define SIM_VERTICAL_CH     4
+#define SIM_HORIZONTAL_CH   5
+
+// Connects the Serial port to a file descriptor and the ADC to a trace of
+// (vertical, horizontal) count pairs, one pair per ms, replayed in a loop
+
+void SimHal_Attach(int zwSerialFd, const int16_t *zpwTrace, size_t zuSamples);
+
+// Queues text as if it had been received on the Serial port
+
+void SimHal_Inject(const char *zpcText);
+
+// Moves virtual time on to the given time, never back. Firmware delays
+// move it too, so the simulator sets it absolutely at each tick.
+
+void SimHal_SetMicros(unsigned long long zullMicros);
+
+#endif    // !defined _SIM_HAL_H